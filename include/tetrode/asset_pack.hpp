@@ -0,0 +1,52 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tetrode {
+
+// Read-only bundle of asset files, mapped into memory in one go so that
+// startup doesn't have to open and read each asset separately. Built with
+// tetrode-pack. All integers are little-endian.
+//
+//   "TPAK" u32 count
+//   count * { u32 offset, u32 size, u16 name length, name }
+//   file data, offsets are from the start of the pack
+class asset_pack {
+	public:
+		asset_pack();
+		~asset_pack();
+
+		asset_pack(const asset_pack&) = delete;
+		asset_pack& operator=(const asset_pack&) = delete;
+
+		// returns false if the pack is missing or malformed. Whatever the
+		// pack had open before is closed first.
+		bool open(const std::string& path);
+		bool is_open(void) const { return map != NULL; }
+
+		// points `data` straight into the mapping, which lives as long as
+		// the pack does. Safe to call from several threads at once.
+		bool find(const std::string& name, const uint8_t **data, size_t *size) const;
+
+		// pack `names`, relative to `root`, into a new pack at `path`.
+		// False if a file can't be read, or a name is over 65535 bytes
+		// or the pack would be over 4 GiB.
+		static bool build(const std::string& path, const std::string& root,
+		                  const std::vector<std::string>& names);
+
+		static bool read_file(const std::string& path, std::vector<uint8_t>& out);
+
+	private:
+		void unmap(void);
+
+		uint8_t *map = NULL;
+		size_t map_len = 0;
+
+		std::map<std::string, std::pair<uint32_t, uint32_t>> entries;
+};
+
+// namespace tetrode
+}
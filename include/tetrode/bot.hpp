@@ -0,0 +1,69 @@
+#pragma once
+#include <tetrode/field_state.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tetrode {
+
+class placement_tables;
+
+// feature weights for heuristic_bot, the defaults are Yiyuan Lee's
+// El-Tetris tuning
+class bot_weights {
+	public:
+		double height    = -0.510066;
+		double lines     =  0.760666;
+		double holes     = -0.35663;
+		double bumpiness = -0.184483;
+};
+
+// Plays a board by feeding it events, one per next_move() call, the same
+// as a player would. Each new piece gets every rotation and column tried
+// on a bitboard copy of the stack, scored by a weighted sum of features,
+// and the best placement is walked to with rotates and moves, then hard
+// dropped.
+//
+// With `tables` set, landing rows come from its lookup tables and the
+// first few placements of a game from its opening book, see
+// placement_tables.hpp.
+class heuristic_bot {
+	public:
+		heuristic_bot(const bot_weights& w = bot_weights(),
+		              const placement_tables *t = NULL)
+		{
+			weight = w;
+			tables = t;
+		}
+
+		// boards up to 16 wide and 64 tall
+		template <class field_t>
+		event next_move(field_t& field);
+
+		// best placement for `shape` on a bitboard (rows[y] bit x), as
+		// right rotations from spawn and leftmost column, coming down
+		// from `spawn_y`. With `lookahead`, each placement is scored by
+		// the best placements of that many more pieces after it,
+		// averaged over every shape. Returns the score, and leaves
+		// `rotations` and `left` alone if nothing fits.
+		double best_placement(const uint16_t *rows, unsigned width, unsigned height,
+		                      int spawn_y, enum tetrimino::shape shape,
+		                      unsigned lookahead, unsigned& rotations, int& left) const;
+
+	private:
+		template <class field_t>
+		void plan(field_t& field);
+
+		double evaluate(const uint16_t *rows, unsigned height, unsigned width) const;
+
+		bot_weights weight;
+		const placement_tables *tables;
+
+		bool planned = false;
+		unsigned rotations_left;
+		int target_x;
+		int last_x;
+};
+
+// namespace tetrode
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <tetrode/field_state.hpp>
+
+#include <stdint.h>
+
+namespace tetrode {
+
+// The line clear animation, kept by whatever draws the board rather than
+// by the engine. The engine takes full rows out as soon as a piece locks
+// and leaves which ones went in cleared_rows. update() notices the line
+// count going up and the cleared rows then close up over `length` seconds
+// of the caller's clock. Nothing waits on it, so it plays the same with
+// or without a clear delay in the rules.
+class clear_effect {
+	public:
+		clear_effect(double len = 0.3) : length(len) {}
+
+		// once a frame before drawing, `now` in seconds
+		template <class field_t>
+		void update(const field_t& field, double now){
+			// a new game or a rewind takes the count back, nothing to show
+			if (seen && field.lines_cleared > lines) {
+				rows = field.cleared_rows;
+				start = now;
+
+			} else if (field.lines_cleared != lines) {
+				rows = 0;
+			}
+
+			lines = field.lines_cleared;
+			seen = true;
+		}
+
+		bool running(double now) const {
+			return rows && now < start + length;
+		}
+
+		// how much of row `y` is still showing, from 1 as it clears down
+		// to 0 once it's gone
+		double left(int y, double now) const {
+			if (y < 0 || y >= 64 || !((rows >> y) & 1) || !running(now)) {
+				return 0;
+			}
+
+			double t = (now - start) / length;
+			return (t < 0)? 1 : 1 - t;
+		}
+
+		double length;
+
+	private:
+		uint64_t rows = 0;
+		double start = 0;
+		unsigned lines = 0;
+		bool seen = false;
+};
+
+// namespace tetrode
+}
@@ -1,11 +1,15 @@
 #pragma once
+#include <tetrode/rules.hpp>
 #include <vector>
 #include <list>
+#include <array>
 #include <utility> // std::pair
 #include <stdint.h>
 
 namespace tetrode {
 
+class game_stats;
+
 enum event {
 	NullEvent,
 
@@ -20,6 +24,12 @@ enum event {
 	Pause,
 
 	Quit,
+
+	// key releases, only used when auto-repeat is enabled, see
+	// basic_field_state::handling
+	ReleaseLeft,
+	ReleaseRight,
+	ReleaseDown,
 };
 
 enum movement {
@@ -36,10 +46,14 @@ enum changes {
 
 class block {
 	public:
-		enum states {
+		// one byte per cell, boards are kept around by the thousand
+		// on servers
+		enum states : uint8_t {
 			Empty,
 			Reserved,
 			Ghost,
+			// the engine takes full rows straight out, this is only
+			// for frontends drawing the clear
 			Cleared,
 
 			Garbage,
@@ -81,24 +95,121 @@ class tetrimino {
 
 		tetrimino(enum shape new_shape=shape::I){
 			shape = new_shape;
+			rotations = 0;
 			regen_blocks();
 		}
 
 		void rotate(enum movement dir);
 
-		std::list<std::pair<block, coord_2d>> blocks;
+		// SRS wall kicks, the offsets tried in order when turning `dir`
+		// from `from` right rotations. The first is the plain rotation,
+		// or for I the nudge that makes it turn about its center.
+		enum { kick_tests = 5 };
+		static coord_2d kick(enum shape shape, unsigned from,
+		                     enum movement dir, unsigned test);
+
+		// fixed size so pieces copy without allocating
+		std::array<std::pair<block, coord_2d>, 4> blocks;
 		unsigned rotations : 2; // only 4 possible states, so we only need two bits
 		enum shape shape;
 
+		// back to spawn orientation
 		void regen_blocks(void);
 };
 
-class field_state {
+// flat copy of everything a board needs to resume play, see
+// basic_field_state::save_state(). Reusing one snapshot across saves
+// doesn't allocate.
+class field_snapshot {
+	public:
+		enum { max_queue = 16 };
+
+		// one byte per cell, row major starting from the bottom row
+		std::vector<uint8_t> cells;
+		int16_t size_x, size_y;
+
+		uint8_t queue[max_queue];
+		uint8_t queue_len;
+
+		uint8_t active_shape;
+		uint8_t active_rotations;
+		int8_t  active_blocks[4][2];
+		int16_t active_x, active_y;
+		uint8_t spin;
+
+		uint8_t hold_shape;
+		bool have_held;
+		bool already_held;
+		bool topped_out;
+
+		uint32_t random_seed;
+		uint32_t movement_ticks;
+		uint32_t clear_ticks;
+		uint32_t drop_ticks;
+		uint8_t  held;
+		uint32_t shift_ticks;
+		uint32_t soft_drop_ticks;
+		uint32_t level;
+		uint32_t score;
+		uint32_t lines_cleared;
+
+		// FNV-1a over the whole state, for spotting desyncs
+		uint32_t checksum(void) const;
+};
+
+// the game engine, specialized at compile time on a rule set from rules.hpp.
+// Member functions are defined in field_state.cpp and explicitly
+// instantiated there for each of the rule sets, so a new rule set needs a
+// matching instantiation at the bottom of that file.
+template <class rules_t>
+class basic_field_state {
 	public:
-		field_state(unsigned board_x=10, unsigned board_y=40, uint32_t seed=0);
+		typedef rules_t rules;
+
+		basic_field_state(unsigned board_x=10, unsigned board_y=40, uint32_t seed=0);
 		void handle_event(enum event ev);
 		coord_2d lower_collide_coord(tetrimino& tet, coord_2d& coord);
 
+		// push `lines` rows of garbage in from the bottom, leaving one
+		// open cell at `hole`, used for versus play. Throws if `hole`
+		// isn't a column of the board.
+		void add_garbage(unsigned lines, unsigned hole);
+
+		// ticks until the next Tick that can change the board, ie. the
+		// first next_event() - 1 Ticks only count timers down. no_event
+		// if nothing will ever happen (the game is over).
+		enum { no_event = ~0u };
+		unsigned next_event(void);
+		// same as handle_event(Tick) `ticks` times, but skips straight
+		// over the idle ticks between events
+		void advance(unsigned ticks);
+
+		// copy the game state out to/back in from a flat snapshot, cheap
+		// enough to do every tick for rollback
+		void save_state(field_snapshot& snap);
+		void load_state(const field_snapshot& snap);
+
+		// auto-repeat for held keys, in ticks. With `enabled` set, MoveLeft,
+		// MoveRight and MoveDown mean the key went down and repeat until the
+		// matching Release* event, otherwise each one is a single step.
+		class handling_settings {
+			public:
+				bool enabled;
+				// ticks a direction is held before it starts repeating
+				unsigned das;
+				// ticks between repeats, 0 goes straight to the wall
+				unsigned arr;
+				// ticks between steps while down is held
+				unsigned soft_drop;
+		};
+
+		handling_settings handling = {
+			false,
+			rules::tick_rate * 167 / 1000,
+			rules::tick_rate * 33 / 1000,
+			rules::tick_rate / 50,
+		};
+
 		coord_2d size;
 		std::pair<tetrimino, coord_2d> active;
 
@@ -109,33 +220,94 @@ class field_state {
 		std::list<tetrimino> next_pieces;
 		std::vector<std::vector<block>> field;
 
-		// TODO: implement prng
+		// xorshift state for the piece randomizer, so games are
+		// reproducible from their seed
 		uint32_t random_seed;
 
 		unsigned movement_ticks;
 		unsigned clear_ticks;
 		unsigned drop_ticks;
 
+		enum held_keys : uint8_t {
+			HeldLeft  = 1 << 0,
+			HeldRight = 1 << 1,
+			HeldDown  = 1 << 2,
+			// which of left/right is repeating when both are held
+			ShiftRight = 1 << 3,
+
+			// pressed during a line clear delay, for the next piece
+			// once it can move (IRS/IHS). Kept with the held keys so
+			// snapshots carry them.
+			BufferedRotateLeft  = 1 << 4,
+			BufferedRotateRight = 1 << 5,
+			BufferedHold        = 1 << 6,
+		};
+
+		uint8_t  held = 0;
+		unsigned shift_ticks = 0;
+		unsigned soft_drop_ticks = 0;
+
 		unsigned level;
 		unsigned score;
 		unsigned lines_cleared;
 
+		// set once a new piece can't spawn, the board ignores events after
+		bool topped_out = false;
+
+		// how the active piece got where it is, for T-spins. Any move
+		// that gets anywhere clears it.
+		enum spin_states : uint8_t {
+			NoSpin,
+			SpinRotated,
+			// rotated with the last kick in the table, which always
+			// scores a full T-spin
+			SpinKicked,
+		};
+
+		uint8_t spin = NoSpin;
+
 		// flag to help renderer know when to redraw
 		unsigned updates;
 
+		// rows (bit y, bottom 64 only, counted before the clear) the last
+		// piece to lock cleared, for following the board without diffing
+		// it and for drawing the clear, see clear_effect.hpp. Not game
+		// state, so it isn't in snapshots.
+		uint64_t cleared_rows = 0;
+
+		// fed as the game goes when set, see game_stats.hpp. Not game
+		// state either.
+		game_stats *stats = nullptr;
+
 	private:
+		uint32_t next_random(void);
+		void skip_idle_ticks(unsigned ticks);
+		void update_held(enum event ev);
+		void buffer_input(enum event ev);
+		void apply_buffered(void);
+		void repeat_held(void);
+		unsigned next_repeat(void);
 		void generate_next_pieces(void);
 		void place_active(void);
 		void get_new_active_tetrimino(void);
 		int  clear_lines(void);
-		int  color_cleared_lines(void);
 
 		bool collides_lower(tetrimino& tet, coord_2d& coord);
+		bool overlaps(const tetrimino& tet, const coord_2d& coord);
+		bool active_overlaps(void);
 		bool active_collides_lower(void);
 		bool active_collides_sides(enum movement dir);
-		void active_normalize(void);
-		void rotation_normalize(void);
+		void rotate_active(enum movement dir);
+		bool active_tspin(bool& mini);
 };
 
+typedef basic_field_state<guideline_rules> field_state;
+typedef basic_field_state<classic_rules>   classic_field_state;
+typedef basic_field_state<twenty_g_rules>  twenty_g_field_state;
+// guideline play at 1000Hz, used by the SDL frontend
+typedef basic_field_state<fine_rules<guideline_rules, 1000>> fine_field_state;
+// guideline without the line clear delay, for bots
+typedef basic_field_state<zero_delay_rules<guideline_rules>> zero_delay_field_state;
+
 // namespace tetrode
 }
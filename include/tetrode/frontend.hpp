@@ -1,6 +1,7 @@
 #pragma once
 
 #include <tetrode/field_state.hpp>
+#include <tetrode/rewind_history.hpp>
 #include <list>
 #include <string>
 #include <cstdio>
@@ -28,10 +29,29 @@ class frontend {
 	public:
 		void handle_event(enum event ev);
 		virtual int run(void){ return -1; };
-		field_state field = field_state();
+		// run at 1000Hz so inputs and auto-repeat land on the millisecond
+		fine_field_state field = fine_field_state();
 
 		std::list<menu> menus;
 		bool paused = true;
+
+		// practice games keep every placement to rewind to. Call
+		// track_history() after each batch of ticks and inputs, before
+		// field.updates is cleared.
+		bool practice = false;
+		rewind_history history;
+		// the placement on the board, earlier than history.last() after
+		// rewinding
+		unsigned long history_at = 0;
+
+		void track_history(void);
+		// move `steps` placements through the history, back if negative,
+		// false if there's nowhere to go
+		bool rewind(long steps);
+
+	private:
+		bool placement_pending = false;
+		field_snapshot rewind_snap;
 };
 
 class main_menu : public menu {
@@ -42,6 +62,24 @@ class main_menu : public menu {
 				virtual void action(frontend *front){
 					puts("Got here");
 
+					front->practice = false;
+					front->menus.pop_back();
+
+					if (front->menus.empty()) {
+						front->paused = false;
+					}
+				}
+		};
+
+		class practice_entry : public menu::entry {
+			public:
+				practice_entry(std::string s){ text = s; };
+				virtual void action(frontend *front){
+					puts("Practice");
+
+					// history starts from wherever the board is now
+					front->practice = true;
+					front->history.clear();
 					front->menus.pop_back();
 
 					if (front->menus.empty()) {
@@ -61,9 +99,9 @@ class main_menu : public menu {
 		};
 
 		main_menu() {
-			for (auto& x : {"Marathon", "Practice", "Multiplayer"}) {
-				entries.push_back(new main_entry(x));
-			}
+			entries.push_back(new main_entry("Marathon"));
+			entries.push_back(new practice_entry("Practice"));
+			entries.push_back(new main_entry("Multiplayer"));
 
 			entries.push_back(new settings_entry("Settings"));
 
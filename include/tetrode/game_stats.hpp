@@ -0,0 +1,82 @@
+#pragma once
+#include <tetrode/field_state.hpp>
+
+#include <stdio.h>
+#include <stdint.h>
+
+namespace tetrode {
+
+// Counters and histograms for one game, filled in by basic_field_state
+// as it goes when its `stats` pointer is set. Everything is fixed size
+// and updated in place, a tick costs one increment.
+//
+// Inputs are the moves, rotations, hard drops and holds that reached the
+// board; soft drops aren't counted since gravity goes through the same
+// path. Finesse is only judged for pieces that could have been hard
+// dropped straight down into place, against the fewest keys that get
+// the piece there on an empty board (see pc_solver::finesse()).
+class game_stats {
+	public:
+		enum {
+			max_lines     = 4,
+			lock_buckets  = 10,
+			input_buckets = 16,
+		};
+
+		game_stats(unsigned rate = 100){ tick_rate = rate; }
+
+		void reset(void);
+
+		// hooks for basic_field_state
+		void input(enum event ev);
+		void lock(const tetrimino& piece, const coord_2d& at, unsigned width,
+		          unsigned lines, unsigned lock_ticks, unsigned lock_delay,
+		          bool straight_down);
+
+		double seconds(void) const { return (double)ticks / tick_rate; }
+		double pieces_per_second(void) const { return ticks? pieces / seconds() : 0; }
+		double inputs_per_piece(void) const { return pieces? (double)inputs / pieces : 0; }
+
+		// one line of JSON, for appending a game to a log, `game` names
+		// it if given
+		void write_json(FILE *out, const char *game = NULL) const;
+
+		unsigned tick_rate;
+
+		uint64_t ticks = 0;
+		// ticks spent waiting on line clears
+		uint64_t clear_ticks = 0;
+
+		uint32_t pieces = 0;
+		uint32_t inputs = 0;
+		uint32_t holds = 0;
+		uint32_t hard_drops = 0;
+		uint32_t finesse_checked = 0;
+		uint32_t finesse_faults = 0;
+
+		// locks by number of lines cleared
+		uint32_t clears[max_lines + 1] = {};
+		// how much of the lock delay pieces sat on the stack for, in
+		// tenths, the last bucket is running out
+		uint32_t lock_delay_used[lock_buckets + 1] = {};
+		// pieces by inputs spent on them, the last bucket is that many
+		// or more
+		uint32_t piece_inputs[input_buckets] = {};
+
+	private:
+		// for the piece in play
+		unsigned cur_inputs = 0;
+		unsigned cur_keys = 0;
+
+		// fewest keys for each shape, right rotations from spawn and x + 2,
+		// plus one, so each placement is only searched for once. 0 is not
+		// known yet, and it's only good for one board width.
+		enum { finesse_xs = 20 };
+		uint8_t optimal[7][4][finesse_xs] = {};
+		unsigned optimal_width = 0;
+
+		unsigned optimal_keys(const tetrimino& piece, const coord_2d& at, unsigned width);
+};
+
+// namespace tetrode
+}
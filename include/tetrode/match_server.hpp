@@ -0,0 +1,184 @@
+#pragma once
+#include <tetrode/field_state.hpp>
+#include <tetrode/timer_wheel.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace tetrode {
+
+// Headless versus server. Clients connect over a unix socket or loopback
+// TCP, get paired with the next waiting client and then:
+//
+//   client -> server: one byte per input, the value of an `event`
+//   server -> client: a match_update, host byte order, whenever the room
+//                     has something new to report, followed by its
+//                     num_events match_events
+//
+// Rooms only run when field_state::next_event() says something is due or
+// input arrives, so quiet ticks send nothing.
+//
+// The events are everything that goes into both boards, so a client can
+// run its own copy of the match and draw it or predict ahead. Both boards
+// are a 10x40 field_state made with the seed from the Start events.
+// Every event happens once the board has run `tick` Ticks, in the order
+// they arrive, and covers the client's own board and the opponent's:
+// accepted inputs, and garbage rows with the column left open. The
+// match_update itself is only a summary. A client too slow to read can
+// miss updates, their events go out with the next one instead, and a
+// client whose events pile up past match_room::max_backlog is dropped.
+//
+// Each worker thread is a shard with its own epoll set and tick timer.
+// Connections are accepted by whichever shard wakes up first and stay
+// owned by that shard along with the room they end up in, so the tick
+// path never takes a lock. Rooms sit in the shard's timer wheel and are
+// only touched when one of their boards has an event due or a client
+// sends input, idle ticks in between are skipped with field_state::advance().
+
+struct match_update {
+	enum flags {
+		Waiting = 1 << 0,
+		Playing = 1 << 1,
+		Won     = 1 << 2,
+		Lost    = 1 << 3,
+	};
+
+	uint32_t tick;
+	uint32_t score;
+	uint16_t lines_cleared;
+	uint16_t opponent_lines;
+	uint8_t  level;
+	uint8_t  pending_garbage;
+	uint8_t  flags;
+	uint8_t  num_events;
+};
+
+struct match_event {
+	enum kinds {
+		Start,
+		Input,
+		Garbage,
+	};
+
+	uint32_t tick;
+	// Start: the board's seed, Input: the `event`, Garbage: rows added
+	uint32_t value;
+	uint8_t  kind;
+	// 0 for the client's own board, 1 for the opponent's
+	uint8_t  board;
+	// Garbage: the open column
+	uint8_t  hole;
+	uint8_t  reserved;
+};
+
+class match_room {
+	public:
+		// size of the per-tick input log, extra inputs are dropped
+		enum { max_inputs = 16 };
+		// unsent events a client can fall behind by before it's dropped
+		enum { max_backlog = 4096 };
+
+		match_room(uint32_t seed);
+
+		// advance both boards by one tick, applying the buffered inputs
+		// and exchanging garbage
+		void tick(void);
+		// same as calling tick() until `ticks` reaches `target`, without
+		// buffered inputs
+		void advance_to(uint32_t target);
+		// apply an input right away
+		void apply_input(unsigned player, event ev);
+		// tick at which something happens next, see field_state::next_event()
+		uint32_t next_event(void);
+		// feed random inputs to simulated rooms when they're due
+		void simulate_inputs(void);
+		bool finished(void);
+		size_t memory_used(void);
+		match_update update_for(unsigned player);
+		// queue an event on `board` for both players, as they see it
+		void log_event(unsigned board, match_event::kinds kind,
+		               uint32_t value, uint8_t hole = 0);
+
+		// everything tick() depends on, for rolling a room back
+		class snapshot {
+			public:
+				field_snapshot boards[2];
+				uint8_t pending_garbage[2];
+				uint16_t prev_lines[2];
+				uint32_t ticks;
+				uint32_t rng;
+		};
+
+		void save_state(snapshot& snap);
+		void load_state(const snapshot& snap);
+
+		field_state boards[2];
+		int fds[2] = {-1, -1};
+
+		// rollback's input log: rollback_session (rollback.hpp) fills it
+		// with each player's inputs for the next tick() to apply. The
+		// server never fills it, client input goes straight in through
+		// apply_input().
+		uint8_t inputs[2][max_inputs];
+		uint8_t num_inputs[2] = {0, 0};
+		uint8_t pending_garbage[2] = {0, 0};
+		uint16_t prev_lines[2] = {0, 0};
+		// events each player hasn't been sent yet, only kept for
+		// players with a socket
+		std::vector<match_event> events[2];
+
+		uint32_t ticks = 0;
+		uint32_t rng;
+		// socketless room from simulate_rooms(), restarted when finished
+		bool simulated = false;
+		uint32_t next_input = 0;
+
+		// scheduling state for the shard that owns the room, room ticks
+		// count from `epoch` on the shard's clock
+		timer_wheel::entry timer;
+		uint64_t epoch = 0;
+
+	private:
+		void exchange_garbage(void);
+};
+
+class match_server {
+	public:
+		match_server(unsigned threads);
+		~match_server();
+
+		void listen_unix(const std::string& path);
+		void listen_tcp(uint16_t port);
+		// host `rooms` socketless rooms driven by random inputs, for
+		// measuring how many rooms a box can take
+		void simulate_rooms(unsigned rooms);
+
+		void start(void);
+		void stop(void);
+
+		struct stats {
+			unsigned long rooms;
+			unsigned long connections;
+			// game ticks covered, and time spent running them
+			unsigned long room_ticks;
+			unsigned long tick_ns;
+			unsigned long room_bytes;
+			unsigned long dropped_updates;
+		};
+
+		stats get_stats(void);
+
+	private:
+		class shard;
+
+		std::vector<shard*> shards;
+		std::vector<int> listen_fds;
+		std::vector<std::thread> threads;
+		std::string unix_path;
+};
+
+// namespace tetrode
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <tetrode/field_state.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+namespace tetrode {
+
+// Finds perfect clears (placements that leave the board completely
+// empty) from a board and its piece queue, and the fewest keypresses
+// that land a piece on a given placement ("finesse").
+//
+// The rows a clear has to fill are kept as one 64 bit word, bit
+// y * width + x, so that's boards up to 16 wide and 64 / width rows.
+// Placements are whatever a piece can reach from above the stack with
+// the engine's own moves and rotations, tucks and spins included, so a
+// solution can be played straight into a basic_field_state.
+//
+// The search is a depth first search over placements, pruned by:
+//   - cells: the queue needs at least (empty cells) / 4 pieces left
+//   - column parity: counting empty cells on odd and even columns,
+//     S, Z and O always cover two of each, J and L three of one, T and
+//     an upright I can cover unevenly, so the queue has to be able to
+//     make up the difference
+//   - walls: with no row open on both sides of a column boundary, no
+//     piece can cross it, so each side needs a multiple of 4 empty cells
+//     and one column wide stretches need an I for every 4
+// Boards already searched go in a hash set shared by all the threads,
+// sharded so they rarely wait on each other's locks, and the threads
+// split the first placements between them.
+class pc_solver {
+	public:
+		// finesse counts a DAS to the wall and a soft drop to the floor
+		// as one key each, same as the usual finesse charts
+		enum key : uint8_t {
+			KeyLeft,
+			KeyRight,
+			KeyDasLeft,
+			KeyDasRight,
+			KeyRotateLeft,
+			KeyRotateRight,
+			KeySoftDrop,
+			KeyHardDrop,
+		};
+
+		class placement {
+			public:
+				enum tetrimino::shape shape;
+				// swapped with hold first
+				bool hold;
+				// where it lands, as right rotations from spawn and the
+				// piece origin, y counts from the bottom row at the time
+				unsigned rotations;
+				int x, y;
+				// bit y * width + x for each block
+				uint64_t cells;
+
+				std::vector<key> keys;
+				// the same path as events for a board without auto-repeat
+				std::vector<event> events;
+		};
+
+		class result {
+			public:
+				bool found = false;
+				// height of the clear
+				unsigned lines = 0;
+				std::vector<placement> placements;
+
+				unsigned long nodes = 0;
+				double ms = 0;
+		};
+
+		// 0 threads means one per core
+		pc_solver(unsigned threads = 0);
+
+		// row pieces spawn on, basic_field_state uses size.y / 2 + 1.
+		// Only changes how many MoveDown events a soft drop turns into.
+		unsigned spawn_height = 21;
+
+		// rows[y] bit x is a filled cell, starting from the bottom row.
+		// queue[0] is the piece in play, hold_shape is -1 when hold's empty.
+		result solve(const std::vector<uint16_t>& rows, unsigned width,
+		             const std::vector<uint8_t>& queue, int hold_shape,
+		             bool allow_hold, unsigned max_lines = 4);
+
+		// from the board, active piece, preview and hold of a game, assumes
+		// the active piece can still be held
+		template <class field_t>
+		result solve(field_t& field, unsigned max_lines = 4);
+
+		// fewest keys from spawn to land `shape` exactly on `target` on a
+		// board `height` rows high, false if it can't get there
+		static bool finesse(uint64_t board, unsigned width, unsigned height,
+		                    enum tetrimino::shape shape, uint64_t target,
+		                    placement& out, unsigned spawn_height = 21);
+
+	private:
+		unsigned threads;
+};
+
+// namespace tetrode
+}
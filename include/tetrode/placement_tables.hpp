@@ -0,0 +1,109 @@
+#pragma once
+#include <tetrode/field_state.hpp>
+#include <tetrode/bot.hpp>
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tetrode {
+
+// Precomputed lookups for heuristic_bot, generated offline by
+// tetrode-tables and mapped in read-only at startup.
+//
+// Landing rows: where a piece dropped straight down comes to rest only
+// depends on the heights of the columns under it relative to the
+// tallest one, and anything more than 4 below that can't be what it
+// lands on. So for each shape and rotation there's a table keyed by the
+// (at most 4) column heights below the tallest, clamped to 4, base 5.
+//
+// Opening book: the best move for each board and piece of the first few
+// placements of a game, searched a piece deeper than the bot can afford
+// to during play (every placement of the next piece, averaged over all
+// 7 shapes). Boards are the ones the book itself leads to from an empty
+// board, keyed by a hash of the stack and the piece. Only good for the
+// bot weights it was built with.
+//
+// All integers are little-endian:
+//
+//   "TTBL" u32 version, u32 shapes fingerprint
+//   u32 book width, u32 book height, u32 book slots
+//   4 * u64 weights (doubles: height, lines, holes, bumpiness)
+//   7 * 4 * 625 * s8 landing rows, relative to the tallest column
+//   pad to 8 bytes
+//   book slots * { u64 key, u8 rotations, s8 leftmost column, 6 * u8 }
+//   open addressed, key 0 is an empty slot
+class placement_tables {
+	public:
+		enum {
+			version      = 1,
+			skyline_keys = 625,
+		};
+
+		placement_tables();
+		~placement_tables();
+
+		placement_tables(const placement_tables&) = delete;
+		placement_tables& operator=(const placement_tables&) = delete;
+
+		// returns false if the file is missing, malformed, from another
+		// version or built for different pieces
+		bool open(const std::string& path);
+		bool is_open(void) const { return map != NULL; }
+
+		// row the piece origin rests on, `rotations` right from spawn,
+		// with `heights` the columns from its leftmost block. Doesn't
+		// see overhangs, the piece comes down from above everything.
+		int landing(enum tetrimino::shape shape, unsigned rotations,
+		            const int *heights) const
+		{
+			unsigned span = spans[shape][rotations];
+			int top = heights[0];
+
+			for (unsigned c = 1; c < span; c++) {
+				top = (heights[c] > top)? heights[c] : top;
+			}
+
+			unsigned key = 0;
+
+			for (unsigned c = span; c-- > 0;) {
+				int d = top - heights[c];
+				key = key * 5 + ((d < 4)? d : 4);
+			}
+
+			return top + land[(shape * 4 + rotations) * skyline_keys + key];
+		}
+
+		// the book's move for `shape` on this board, if it has one
+		bool book_move(const uint16_t *rows, unsigned width, unsigned height,
+		               enum tetrimino::shape shape, unsigned& rotations,
+		               int& left) const;
+		bool book_matches(const bot_weights& w) const;
+		unsigned long book_size(void) const { return book_entries; }
+
+		static uint64_t board_key(const uint16_t *rows, unsigned width, unsigned height,
+		                          enum tetrimino::shape shape);
+
+		// generate tables at `path`, with a book covering the first
+		// `book_pieces` placements on a width x height board
+		static bool build(const std::string& path, unsigned book_pieces,
+		                  unsigned threads, const bot_weights& w = bot_weights(),
+		                  unsigned width = 10, unsigned height = 40);
+
+	private:
+		uint8_t *map = NULL;
+		size_t map_len = 0;
+
+		const int8_t *land = NULL;
+		const uint8_t *book = NULL;
+		uint32_t book_slots = 0;
+		unsigned long book_entries = 0;
+		unsigned book_width = 0, book_height = 0;
+		bot_weights weights;
+
+		// columns each rotation covers, worked out from the pieces
+		uint8_t spans[7][4] = {};
+};
+
+// namespace tetrode
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <tetrode/field_state.hpp>
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace tetrode {
+
+// A recorded game: the board it started from and every event sent to it,
+// stamped with the number of ticks that had run before it. The engine is
+// deterministic, so playing the events back on the same rules rebuilds
+// every tick of the game. All integers are little-endian.
+//
+//   "TRPL" u8 version, u8 name length, rules name
+//   u8 auto-repeat enabled, u32 das, u32 arr, u32 soft drop
+//   u64 length in ticks
+//   u32 size, wire keyframe of the start
+//   u32 count, count * { varint ticks since the last event, u8 event }
+class replay {
+	public:
+		enum { version = 1 };
+
+		class input {
+			public:
+				uint64_t tick;
+				enum event ev;
+		};
+
+		// start over from the board as it is now. `rules` names the rule
+		// set for playing it back, eg. "guideline".
+		template <class field_t>
+		void begin(field_t& field, const std::string& rules);
+
+		// call alongside the board's own advance() and handle_event()
+		void advance(uint64_t ticks){ length += ticks; }
+		void add(enum event ev){ inputs.push_back(input{length, ev}); }
+
+		// put `field` back where the recording starts, it has to be the
+		// same size
+		template <class field_t>
+		void restore(field_t& field) const;
+
+		bool save(const std::string& path) const;
+		bool load(const std::string& path);
+
+		std::string rules;
+		field_snapshot start;
+		bool repeat = false;
+		unsigned das = 0, arr = 0, soft_drop = 0;
+
+		uint64_t length = 0;
+		std::vector<input> inputs;
+};
+
+// namespace tetrode
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <tetrode/field_state.hpp>
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tetrode {
+
+// Every placement of a game, for rewinding practice games. A full
+// snapshot (a keyframe) is kept every `keyframe_every` placements, and
+// the placements in between are small deltas from the one before: the
+// rows cleared, the cells that changed after that, how the queue moved
+// on and the counters. Appending is O(1), and seeking loads the nearest
+// keyframe and plays at most keyframe_every - 1 deltas forward.
+//
+// Both the deltas and the keyframes are fixed size rings, so memory
+// stops growing once they're full. The oldest keyframe and its deltas
+// are dropped together to make room, so everything still kept can be
+// rebuilt.
+class rewind_history {
+	public:
+		rewind_history(unsigned capacity = 8192, unsigned keyframe_every = 32);
+
+		// call once a piece has locked and the next one can move, ie.
+		// clear_ticks is back to 0. The first call stores the start.
+		template <class field_t>
+		void record(field_t& field);
+
+		void clear(void);
+
+		// placement ids count up from the start of the game, first() is
+		// the oldest one still kept
+		bool empty(void) const { return next_id == first_id; }
+		unsigned long first(void) const { return first_id; }
+		unsigned long last(void) const { return next_id - 1; }
+
+		// the board as it was at placement `id`
+		bool seek(unsigned long id, field_snapshot& out);
+		// forget everything after `id`, for carrying on from there
+		void truncate(unsigned long id);
+
+		// bytes used by both rings, fixed once they've filled up
+		size_t memory_used(void) const;
+		unsigned long keyframes(void) const { return next_key - first_key; }
+
+	private:
+		enum { max_changes = 8, max_pushes = 10 };
+
+		class delta {
+			public:
+				// what's needed to get here from the placement before
+				uint64_t cleared_rows;
+				uint16_t change_at[max_changes];
+				uint8_t  change_to[max_changes];
+				uint8_t  num_changes;
+
+				uint8_t  queue_pops;
+				uint8_t  queue_pushes;
+				// 3 bits per shape pushed onto the end
+				uint32_t pushed;
+
+				uint8_t  active_shape, active_rotations;
+				int8_t   active_blocks[4][2];
+				int16_t  active_x, active_y;
+				uint8_t  spin;
+				uint8_t  hold_shape;
+				bool     have_held, already_held, topped_out;
+
+				uint8_t  held;
+				uint32_t random_seed;
+				uint32_t movement_ticks, clear_ticks, drop_ticks;
+				uint32_t shift_ticks, soft_drop_ticks;
+				uint32_t level, score, lines_cleared;
+
+				// the keyframe this placement is rebuilt from
+				uint32_t keyframe;
+		};
+
+		bool make_delta(const field_snapshot& from, const field_snapshot& to,
+		                uint64_t cleared_rows, delta& out);
+		void apply(const delta& d, field_snapshot& snap);
+		void append(const delta& d, bool key);
+		void drop_oldest(void);
+
+		delta& entry(unsigned long id){ return deltas[id % deltas.size()]; }
+
+		std::vector<delta> deltas;
+		std::vector<field_snapshot> keys;
+		// placement id of each keyframe
+		std::vector<unsigned long> key_ids;
+		unsigned keyframe_every;
+
+		unsigned long first_id = 0, next_id = 0;
+		unsigned long first_key = 0, next_key = 0;
+
+		// the newest placement, and scratch space for the next one
+		field_snapshot latest, scratch;
+		std::vector<uint8_t> work;
+};
+
+// namespace tetrode
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <tetrode/match_server.hpp>
+
+#include <deque>
+#include <stdint.h>
+
+namespace tetrode {
+
+// Rollback netcode for versus games. Both boards are simulated on both
+// ends with match_room, so the game only needs inputs to cross the wire.
+// Local inputs apply immediately; remote inputs that haven't arrived yet
+// are predicted, and when a late input turns out to differ from the
+// prediction the session restores the saved state for that tick and
+// resimulates back up to the present.
+
+// inputs for a run of ticks, sent once per tick. Each side resends every
+// input the other hasn't acknowledged, so lost packets cost latency rather
+// than desyncing the game.
+struct rollback_packet {
+	enum { max_inputs = 32 };
+
+	// remote inputs received so far, ie. the first tick still missing
+	uint32_t ack;
+	uint32_t first_tick;
+	uint8_t  count;
+	uint8_t  inputs[max_inputs];
+};
+
+class rollback_transport {
+	public:
+		virtual ~rollback_transport(){};
+		virtual void send(const rollback_packet& packet) = 0;
+		virtual bool receive(rollback_packet& packet) = 0;
+};
+
+// in-process link between two sessions with simulated latency, jitter and
+// packet loss, for testing rollback without a network
+class loopback_link {
+	public:
+		loopback_link(unsigned latency, unsigned jitter = 0,
+		              unsigned loss_percent = 0, uint32_t seed = 1);
+
+		rollback_transport& endpoint(unsigned side);
+		// advance the link's clock by one tick
+		void tick(void);
+
+	private:
+		struct in_flight {
+			uint32_t arrival;
+			rollback_packet packet;
+		};
+
+		class end : public rollback_transport {
+			public:
+				virtual void send(const rollback_packet& packet);
+				virtual bool receive(rollback_packet& packet);
+
+				loopback_link *link;
+				unsigned side;
+		};
+
+		uint32_t random(void);
+
+		end ends[2];
+		std::deque<in_flight> queues[2];
+
+		unsigned latency;
+		unsigned jitter;
+		unsigned loss_percent;
+		uint32_t rng;
+		uint32_t now = 0;
+};
+
+class rollback_session {
+	public:
+		// how far ahead of the last confirmed remote input a session may
+		// run before it stalls, in ticks
+		enum { max_rollback = rollback_packet::max_inputs };
+
+		rollback_session(unsigned local_player, uint32_t seed,
+		                 rollback_transport& transport);
+
+		// run one tick with `local` as this side's input. Returns false
+		// without advancing when the remote side is too far behind to keep
+		// predicting, the caller should retry with the same input next frame.
+		bool advance(event local);
+
+		// apply received inputs and resend unacknowledged ones without
+		// advancing, for when the game is paused or over
+		void poll(void);
+
+		// true once every input up to the current tick is known by both ends
+		bool synchronized(void);
+
+		// the room as it was before `tick` ran, kept for the last
+		// 2 * max_rollback ticks. Final once tick <= confirmed, for
+		// checking both ends agree.
+		const match_room::snapshot& saved_state(uint32_t tick){
+			return states[tick % history];
+		}
+
+		match_room room;
+		unsigned local_player;
+
+		// ticks simulated, and remote inputs known for ticks < confirmed
+		uint32_t current_tick = 0;
+		uint32_t confirmed = 0;
+
+		struct {
+			unsigned long rollbacks;
+			unsigned long resimulated_ticks;
+			unsigned long stalls;
+			unsigned max_depth;
+			unsigned long max_resim_us;
+		} stats = {};
+
+	private:
+		// saved states and inputs cover twice the rollback window, so inputs
+		// received ahead of time have room too. Indexed by tick % history
+		enum { history = max_rollback * 2 };
+
+		void receive(void);
+		void catch_up(void);
+		void rollback(uint32_t tick);
+		void simulate(uint32_t tick);
+		void send(void);
+
+		rollback_transport& transport;
+		uint32_t remote_ack = 0;
+		uint32_t rollback_from;
+
+		uint8_t local_inputs[history];
+		uint8_t remote_inputs[history];
+		match_room::snapshot states[history];
+};
+
+// namespace tetrode
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+namespace tetrode {
+
+// Rule sets are plugged into basic_field_state as template parameters, so
+// every timing and scoring decision below is resolved at compile time and
+// each variant gets its own specialized engine. All timings are in ticks,
+// at tick_rate ticks per second.
+//
+// A rule set has to provide:
+//   tick_rate                      ticks per second the timings assume
+//   instant_gravity                piece falls to the stack every tick (20G)
+//   allow_hold                     whether Hold events do anything
+//   lock_delay                     ticks a grounded piece waits before locking
+//   clear_delay                    ticks the next piece waits after a line
+//                                  clear, see basic_field_state::handle_event()
+//   gravity_ticks(level)           ticks between gravity steps
+//   level_for(lines)               level reached after clearing `lines`
+//   srs                            SRS wall kicks and T-spins, otherwise a
+//                                  rotation only happens if it fits as is
+//   line_score(cleared, level)     points for clearing `cleared` lines
+//   tspin_score(cleared, level, mini)
+//                                  points for a T-spin clearing `cleared`
+
+// modern guideline rules, the default
+struct guideline_rules {
+	static const unsigned tick_rate   = 100;
+	static const bool instant_gravity = false;
+	static const bool allow_hold      = true;
+	static const unsigned lock_delay  = 50;
+	static const unsigned clear_delay = 30;
+	static const bool srs             = true;
+
+	static unsigned gravity_ticks(unsigned level){
+		// the old fixed 15 ticks per row, until the guideline curve,
+		// (0.8 - (level - 1) * 0.007)^(level - 1) seconds per row rounded
+		// to ticks, gets faster than that
+		static const unsigned table[] = {
+			15, 15, 15, 15, 15, 15, 15, 14, 9, 6, 4, 3, 2, 1, 1,
+		};
+
+		const unsigned n = sizeof(table) / sizeof(table[0]);
+		return (level - 1 < n)? table[level - 1] : 1;
+	}
+
+	static unsigned level_for(unsigned lines){
+		return 1 + lines / 10;
+	}
+
+	static unsigned line_score(unsigned cleared, unsigned level){
+		static const unsigned table[] = { 0, 100, 300, 500, 800 };
+		return (cleared <= 4)? table[cleared] * level : 0;
+	}
+
+	static unsigned tspin_score(unsigned cleared, unsigned level, bool mini){
+		static const unsigned table[] = { 400, 800, 1200, 1600 };
+		static const unsigned mini_table[] = { 100, 200, 400 };
+
+		if (mini) {
+			return (cleared <= 2)? mini_table[cleared] * level : 0;
+		}
+
+		return (cleared <= 3)? table[cleared] * level : 0;
+	}
+};
+
+// NES-style rules, no hold, no lock delay and the old scoring table
+struct classic_rules {
+	static const unsigned tick_rate   = 100;
+	static const bool instant_gravity = false;
+	static const bool allow_hold      = false;
+	static const unsigned lock_delay  = 0;
+	static const unsigned clear_delay = 30;
+	static const bool srs             = false;
+
+	static unsigned gravity_ticks(unsigned level){
+		// NES frames per row at 60Hz, converted to ticks
+		static const unsigned table[] = {
+			80, 72, 63, 55, 47, 38, 30, 22, 13, 10,
+			8, 8, 8, 7, 7, 7, 5, 5, 5,
+			3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+		};
+
+		const unsigned n = sizeof(table) / sizeof(table[0]);
+		return (level - 1 < n)? table[level - 1] : 2;
+	}
+
+	static unsigned level_for(unsigned lines){
+		return 1 + lines / 10;
+	}
+
+	static unsigned line_score(unsigned cleared, unsigned level){
+		static const unsigned table[] = { 0, 40, 100, 300, 1200 };
+		return (cleared <= 4)? table[cleared] * level : 0;
+	}
+
+	static unsigned tspin_score(unsigned cleared, unsigned level, bool /* mini */){
+		return line_score(cleared, level);
+	}
+};
+
+// 20G: pieces drop to the stack as soon as they spawn or move, so the only
+// timing that matters is lock delay
+struct twenty_g_rules {
+	static const unsigned tick_rate   = 100;
+	static const bool instant_gravity = true;
+	static const bool allow_hold      = true;
+	static const unsigned lock_delay  = 50;
+	static const unsigned clear_delay = 25;
+	static const bool srs             = true;
+
+	static unsigned gravity_ticks(unsigned /* level */){
+		return 1;
+	}
+
+	static unsigned level_for(unsigned lines){
+		return 1 + lines / 10;
+	}
+
+	static unsigned line_score(unsigned cleared, unsigned level){
+		return guideline_rules::line_score(cleared, level);
+	}
+
+	static unsigned tspin_score(unsigned cleared, unsigned level, bool mini){
+		return guideline_rules::tspin_score(cleared, level, mini);
+	}
+};
+
+// runs another rule set at `rate` ticks per second, for frontends that
+// want finer input timing than the 100Hz the rule sets are written for.
+// Timings are scaled to match, so the game plays at the same speed.
+template <class base, unsigned rate>
+struct fine_rules {
+	static const unsigned tick_rate   = rate;
+	static const bool instant_gravity = base::instant_gravity;
+	static const bool allow_hold      = base::allow_hold;
+	static const unsigned lock_delay  = base::lock_delay * rate / base::tick_rate;
+	static const unsigned clear_delay = base::clear_delay * rate / base::tick_rate;
+	static const bool srs             = base::srs;
+
+	static unsigned gravity_ticks(unsigned level){
+		return base::gravity_ticks(level) * rate / base::tick_rate;
+	}
+
+	static unsigned level_for(unsigned lines){
+		return base::level_for(lines);
+	}
+
+	static unsigned line_score(unsigned cleared, unsigned level){
+		return base::line_score(cleared, level);
+	}
+
+	static unsigned tspin_score(unsigned cleared, unsigned level, bool mini){
+		return base::tspin_score(cleared, level, mini);
+	}
+};
+
+// another rule set with the line clear delay taken out, so the next piece
+// can move as soon as the last one locks, without waiting for a tick. For
+// bots and servers, where nobody needs time to watch the rows go.
+template <class base>
+struct zero_delay_rules {
+	static const unsigned tick_rate   = base::tick_rate;
+	static const bool instant_gravity = base::instant_gravity;
+	static const bool allow_hold      = base::allow_hold;
+	static const unsigned lock_delay  = base::lock_delay;
+	static const unsigned clear_delay = 0;
+	static const bool srs             = base::srs;
+
+	static unsigned gravity_ticks(unsigned level){
+		return base::gravity_ticks(level);
+	}
+
+	static unsigned level_for(unsigned lines){
+		return base::level_for(lines);
+	}
+
+	static unsigned line_score(unsigned cleared, unsigned level){
+		return base::line_score(cleared, level);
+	}
+
+	static unsigned tspin_score(unsigned cleared, unsigned level, bool mini){
+		return base::tspin_score(cleared, level, mini);
+	}
+};
+
+// namespace tetrode
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <tetrode/spsc_queue.hpp>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_mixer.h>
+
+#include <atomic>
+#include <stdint.h>
+
+namespace tetrode {
+
+// Small sound effect mixer. Effects are Mix_Chunks, which SDL_mixer has
+// already converted to the device's PCM format when they were loaded, so
+// the audio callback only has to add samples together. play() hands the
+// effect over through a lock-free ring, so the game never waits on the
+// audio lock, and any number of effects can start on the same tick.
+//
+// Latency is bounded by the ring being drained at the start of every
+// callback: an effect starts at most one buffer after play(), plus the
+// device's own buffering.
+class sdl2_audio {
+	public:
+		enum {
+			max_sounds = 16,
+			max_voices = 16,
+		};
+
+		// opens the mixer with a `buffer` frame device buffer
+		sdl2_audio(unsigned buffer = 256);
+		~sdl2_audio();
+
+		// the chunk has to outlive the mixer, safe to call while sounds
+		// are playing
+		void set_sound(unsigned id, Mix_Chunk *chunk);
+		// only ever call from one thread, that's the ring's producer
+		void play(unsigned id, uint8_t volume = MIX_MAX_VOLUME);
+
+		unsigned buffer_frames(void){ return frames; }
+		unsigned sample_rate(void){ return rate; }
+
+		// trigger to mix times, in performance counter units
+		struct {
+			std::atomic<uint64_t> total{0};
+			std::atomic<uint64_t> worst{0};
+			std::atomic<unsigned long> played{0};
+			std::atomic<unsigned long> dropped{0};
+		} latency;
+
+	private:
+		static void mix(void *data, Uint8 *stream, int len);
+
+		class command {
+			public:
+				uint8_t sound;
+				uint8_t volume;
+				uint64_t stamp;
+		};
+
+		// only touched by the audio thread
+		class voice {
+			public:
+				const int16_t *pcm;
+				size_t left;
+				int volume;
+		};
+
+		spsc_queue<command, 64> commands;
+		voice voices[max_voices] = {};
+
+		// sounds load in the background, so one can be set after a play()
+		// of it is already queued and the ring doesn't order the two. The
+		// callback skips a play() that beats its sound there.
+		std::atomic<Mix_Chunk*> sounds[max_sounds] = {};
+
+		unsigned frames;
+		unsigned rate;
+};
+
+// namespace tetrode
+}
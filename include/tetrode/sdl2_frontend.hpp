@@ -1,19 +1,50 @@
 #pragma once
 #include <tetrode/frontend.hpp>
+#include <tetrode/sdl2_grid_renderer.hpp>
+#include <tetrode/spsc_queue.hpp>
+#include <tetrode/asset_pack.hpp>
+#include <tetrode/sdl2_audio.hpp>
+#include <tetrode/pc_solver.hpp>
+#include <tetrode/game_stats.hpp>
+#include <tetrode/replay.hpp>
+#include <tetrode/clear_effect.hpp>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include <SDL2/SDL_mixer.h>
 
+#include <chrono>
+#include <future>
+#include <memory>
 #include <string>
+#include <vector>
+#include <stdint.h>
 
 namespace tetrode {
 
+extern const SDL_Color block_palette[block::states::Orange + 1];
+
+// a key press and when it happened, on the SDL_GetPerformanceCounter() clock
+class timed_event {
+	public:
+		event ev;
+		uint64_t stamp;
+};
+
 class sdl2_frontend : public frontend {
 	public:
-		sdl2_frontend();
+		sdl2_frontend(unsigned audio_buffer = 256);
 		~sdl2_frontend();
 
 		virtual int run(void);
+		// watch `boards` bot-driven games side by side
+		int run_grid(unsigned boards);
+
+		// the game being played, fed by `field`
+		game_stats stats = game_stats(fine_field_state::rules::tick_rate);
+
+		// a replay of the game goes here when set, for tetrode-render.
+		// Rewinding starts it over from the placement rewound to.
+		std::string record_path;
 
 	private:
 		void redraw(void);
@@ -21,26 +52,96 @@ class sdl2_frontend : public frontend {
 		void clear(void);
 		void present(void);
 
-		event get_event(void);
+		static int input_watch(void *data, SDL_Event *e);
+		// returns false once the window's been closed
+		bool pump_events(unsigned timeout);
+		bool handle_input(event ev, uint64_t stamp);
+
 		void draw_menus(void);
-		void draw_field(field_state& field);
+		void draw_field(fine_field_state& field);
 		void draw_tetrimino(tetrimino& tet, coord_2d coord);
 		void draw_text(std::string& text, coord_2d coord);
 		void play_sfx(void);
 
-		unsigned get_block_full_size(void);
-		unsigned get_block_filled_size(void);
+		// look for a perfect clear from the current board, shown until
+		// the next piece locks
+		void find_perfect_clear(void);
+		void draw_perfect_clear(void);
+
+		unsigned get_block_full_size(void){ return full_size; }
+		unsigned get_block_filled_size(void){ return filled_size; }
+
+		// recompute block sizes and reopen the font, only needed when the
+		// window changes size
+		void update_layout(void);
+		void open_font(void);
+
+		// start decoding every asset on worker threads, poll_assets()
+		// picks them up as they finish
+		void load_assets(void);
+		void poll_assets(void);
+		bool asset_data(const std::string& name, std::vector<uint8_t>& storage,
+		                const uint8_t **data, size_t *len);
 
 		SDL_Window   *window;
 		SDL_Renderer *renderer;
 		TTF_Font     *font;
 
+		int window_w = 0, window_h = 0;
+		unsigned full_size = 0;
+		unsigned filled_size = 0;
+		bool needs_redraw = false;
+
+		// line clears, timed on the performance counter in seconds
+		clear_effect clears;
+		double seconds_now(void){
+			return (double)SDL_GetPerformanceCounter() / SDL_GetPerformanceFrequency();
+		}
+
+		// filled in by input_watch(), drained by the simulation
+		spsc_queue<timed_event, 256> input;
+
+		// time from a key being seen to it hitting the board, in
+		// performance counter units
 		struct {
-			Mix_Chunk *rotation;
-			Mix_Chunk *locked;
-			Mix_Chunk *wallhit;
-			Mix_Chunk *tspin;
-		} sfx;
+			uint64_t total;
+			uint64_t worst;
+			unsigned long count;
+			unsigned long dropped;
+		} latency = {};
+
+		replay recording;
+
+		pc_solver solver;
+		pc_solver::result pc_hint;
+		bool show_pc_hint = false;
+
+		std::unique_ptr<sdl2_grid_renderer> grid;
+		std::vector<field_state> grid_boards;
+
+		enum sounds {
+			SfxLocked,
+			SfxRotation,
+			SfxTspin,
+			SfxWallhit,
+			SfxCount,
+		};
+
+		Mix_Chunk *sfx[SfxCount] = {};
+		std::unique_ptr<sdl2_audio> audio;
+
+		std::chrono::steady_clock::time_point startup;
+		asset_pack pack;
+		std::string asset_dir = "assets/";
+
+		std::future<bool> font_load;
+		std::future<Mix_Chunk*> sfx_loads[SfxCount];
+		bool assets_ready = false;
+
+		// font file contents, either in the pack or font_data
+		std::vector<uint8_t> font_data;
+		const uint8_t *font_ptr = NULL;
+		size_t font_len = 0;
 };
 
 // namespace tetrode
@@ -0,0 +1,39 @@
+#pragma once
+#include <tetrode/field_state.hpp>
+#include <SDL2/SDL.h>
+
+#include <vector>
+
+namespace tetrode {
+
+// Draws many boards at once, for spectating a whole lobby. Every cell of
+// every board goes into one vertex buffer that's submitted with a single
+// SDL_RenderGeometry() call (SDL 2.0.18+), and board placement is only
+// worked out again by layout() when the window or the lobby changes.
+class sdl2_grid_renderer {
+	public:
+		sdl2_grid_renderer(SDL_Renderer *renderer);
+
+		void layout(int window_w, int window_h, unsigned boards, coord_2d board_size);
+		void draw(std::vector<field_state>& boards);
+
+		bool needs_layout(unsigned boards){ return boards != laid_out; }
+
+	private:
+		void push_quad(float x, float y, float size, const SDL_Color& color);
+		void push_board(field_state& board, float x, float y);
+
+		SDL_Renderer *renderer;
+
+		std::vector<SDL_Vertex> vertices;
+		std::vector<int> indices;
+		std::vector<SDL_FPoint> origins;
+
+		unsigned laid_out = 0;
+		unsigned visible_rows = 0;
+		float full_size = 0;
+		float filled_size = 0;
+};
+
+// namespace tetrode
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <tetrode/field_state.hpp>
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+namespace tetrode {
+
+// Shared memory channel between a game and a bot in another process, so
+// bots in any language can play without a socket round trip. The game
+// publishes an observation of the board every tick and the bot answers
+// with events. Everything lives in one POSIX shared memory object laid
+// out as shm_bot_layout below; all integers are native endian and the
+// atomics are plain 32 bit words, so other languages can map it with the
+// offsets from offsetof().
+//
+// Observations are double buffered: the game fills the buffer the bot
+// isn't reading, then bumps obs_seq. obs[obs_seq & 1] is the latest one,
+// and a reader that sees obs_seq change while copying should retry.
+// Inputs go the other way through a single-producer/single-consumer ring.
+// Both sides sleep on futexes (obs_seq and input_tail) rather than spin.
+
+// one tick's view of the board
+struct shm_observation {
+	enum { max_width = 16, max_height = 64, max_queue = 16 };
+
+	uint32_t tick;
+	uint8_t  size_x, size_y;
+	uint8_t  topped_out;
+	uint8_t  clearing;
+
+	// block::states, row major starting from the bottom row
+	uint8_t  cells[max_height][max_width];
+
+	// tetrimino::shape, and block offsets from (active_x, active_y)
+	uint8_t  active_shape;
+	int8_t   active_blocks[4][2];
+	int16_t  active_x, active_y;
+
+	uint8_t  queue[max_queue];
+	uint8_t  queue_len;
+	uint8_t  hold_shape;
+	uint8_t  have_held;
+
+	uint32_t score;
+	uint32_t lines_cleared;
+	uint32_t level;
+};
+
+struct shm_bot_input {
+	// the observation this answers, for measuring round trips
+	uint32_t tick;
+	uint32_t ev;
+};
+
+struct shm_bot_layout {
+	enum { magic_value = 0x54425431, version_value = 1, ring_size = 256 };
+
+	uint32_t magic;
+	uint32_t version;
+
+	alignas(64) std::atomic<uint32_t> obs_seq;
+	shm_observation obs[2];
+
+	// bot writes input_tail, game writes input_head
+	alignas(64) std::atomic<uint32_t> input_head;
+	alignas(64) std::atomic<uint32_t> input_tail;
+	shm_bot_input inputs[ring_size];
+};
+
+// the game's end, creates the shared memory object
+class shm_bot_host {
+	public:
+		shm_bot_host(const std::string& name);
+		~shm_bot_host();
+
+		template <class field_t>
+		void publish(field_t& field, uint32_t tick);
+
+		// returns false when there's nothing waiting
+		bool poll_input(shm_bot_input& input);
+		// sleep until the bot sends something or `timeout_us` passes
+		void wait_input(unsigned timeout_us);
+
+	private:
+		std::string name;
+		shm_bot_layout *shm;
+		field_snapshot snap;
+};
+
+// the bot's end, for C++ bots and for benchmarking
+class shm_bot_client {
+	public:
+		shm_bot_client(const std::string& name);
+		~shm_bot_client();
+
+		// wait for an observation newer than `seen` and copy it out,
+		// returns its sequence number
+		uint32_t wait_observation(uint32_t seen, shm_observation& out);
+		// false if the ring is full
+		bool send(uint32_t tick, event ev);
+
+	private:
+		shm_bot_layout *shm;
+};
+
+// namespace tetrode
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <tetrode/field_state.hpp>
+#include <tetrode/clear_effect.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace tetrode {
+
+// Draws a board with its ghost, queue, hold and score into an RGBA frame
+// on the CPU, for exporting replays without a window or a GPU.
+//
+// draw() lays the frame out as a list of rectangles and text, and
+// rasterize() bins them into 64x64 tiles and has a pool of threads fill
+// the tiles in, each thread only ever touching the pixels of the tiles it
+// took. The same pass can also convert the frame to YUV 4:2:0 (BT.601,
+// limited range), tiles are even sized so each one owns its chroma.
+class soft_renderer {
+	public:
+		enum { tile_size = 64 };
+
+		// `block` pixels per cell. 0 threads means one per core.
+		soft_renderer(unsigned block, coord_2d board_size, unsigned threads = 0);
+		~soft_renderer();
+
+		soft_renderer(const soft_renderer&) = delete;
+		soft_renderer& operator=(const soft_renderer&) = delete;
+
+		template <class field_t>
+		void draw(field_t& field, double seconds);
+		void rasterize(bool yuv);
+
+		// both even
+		unsigned width, height;
+
+		// a pixel each, R, G, B, A in memory order, rows top to bottom
+		std::vector<uint32_t> rgba;
+		// Y plane, then U and V at half size
+		std::vector<uint8_t> yuv;
+
+	private:
+		class rect {
+			public:
+				int x0, y0, x1, y1;
+				uint32_t color;
+		};
+
+		class glyph {
+			public:
+				int x, y;
+				uint8_t ch;
+				uint32_t color;
+		};
+
+		void push_rect(int x, int y, int w, int h, uint32_t color);
+		void push_cell(int x, int y, enum block::states state);
+		void push_piece(const tetrimino& tet, int x, int y);
+		void push_text(int x, int y, const std::string& text, uint32_t color);
+
+		void bin(void);
+		void work(void);
+		void worker(void);
+		void draw_tile(unsigned tile);
+
+		unsigned block_full, block_filled;
+		unsigned text_scale;
+		unsigned tiles_x, tiles_y;
+
+		// this frame's layout and which of it lands on each tile, in
+		// drawing order
+		std::vector<rect> rects;
+		std::vector<glyph> glyphs;
+		std::vector<std::vector<uint32_t>> rect_bins, glyph_bins;
+
+		// on the replay's clock, from draw()'s `seconds`
+		clear_effect clears;
+
+		std::vector<std::thread> pool;
+		std::mutex lock;
+		std::condition_variable wake, finished;
+		unsigned long generation = 0;
+		std::atomic<unsigned> next_tile{0};
+		unsigned tiles_done = 0;
+		bool want_yuv = false;
+		bool quit = false;
+};
+
+// namespace tetrode
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <tetrode/field_state.hpp>
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+namespace tetrode {
+
+// one tick's update, encoded once and shared between every subscriber.
+// `data` holds a 4 byte little-endian length followed by a wire frame.
+class spectator_frame {
+	public:
+		uint32_t tick;
+		bool keyframe;
+		std::vector<uint8_t> data;
+};
+
+typedef std::shared_ptr<const spectator_frame> spectator_frame_ptr;
+
+// Broadcasts one game to many viewers. Each published tick is encoded
+// once, as a delta against the last tick, and queued by reference to
+// every subscriber. flush() hands each subscriber's queue to sendmsg()
+// straight out of the shared buffers, so nothing is copied per viewer.
+//
+// Viewers that fall more than `max_queue` frames behind have their queue
+// thrown away and resume from the next keyframe, so a slow viewer never
+// holds up the game or the other viewers.
+class spectator_service {
+	public:
+		spectator_service(unsigned keyframe_interval = 100, unsigned max_queue = 64);
+		~spectator_service();
+
+		// takes ownership of a connected stream socket, switching it to
+		// non-blocking mode
+		void add_subscriber(int fd);
+		// accept every pending connection on a listening socket
+		void accept_from(int listen_fd);
+
+		void publish(field_state& field, uint32_t tick);
+		// write out as much as every subscriber will take without blocking
+		void flush(void);
+
+		size_t subscribers(void){ return subs.size(); }
+
+		struct {
+			unsigned long frames;
+			unsigned long keyframes;
+			unsigned long bytes_encoded;
+			unsigned long bytes_sent;
+			unsigned long resyncs;
+			unsigned long disconnects;
+		} stats = {};
+
+	private:
+		class subscriber {
+			public:
+				int fd;
+				std::deque<spectator_frame_ptr> queue;
+				// bytes of queue.front() already sent
+				size_t offset = 0;
+				bool needs_keyframe = true;
+		};
+
+		spectator_frame_ptr make_frame(uint32_t tick, bool keyframe);
+		// drop everything not already partly written
+		void drop_queue(subscriber& sub);
+
+		std::vector<subscriber> subs;
+		field_snapshot prev, cur;
+		bool have_prev = false;
+
+		unsigned keyframe_interval;
+		unsigned max_queue;
+		uint32_t last_keyframe = 0;
+};
+
+// namespace tetrode
+}
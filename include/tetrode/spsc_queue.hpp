@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+
+namespace tetrode {
+
+// Fixed size ring for handing items from exactly one producer thread to
+// exactly one consumer thread. Neither side ever blocks or allocates, push()
+// just fails when the ring is full. `size` has to be a power of two.
+template <class T, size_t size>
+class spsc_queue {
+	static_assert(size && (size & (size - 1)) == 0,
+	              "spsc_queue size must be a power of two");
+
+	public:
+		// producer side
+		bool push(const T& item){
+			size_t pos = tail.load(std::memory_order_relaxed);
+
+			// only go and look at the consumer's cache line when the ring
+			// looks full
+			if (pos - cached_head >= size) {
+				cached_head = head.load(std::memory_order_acquire);
+
+				if (pos - cached_head >= size) {
+					return false;
+				}
+			}
+
+			items[pos & (size - 1)] = item;
+			tail.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		// consumer side, returns NULL when empty
+		T *front(void){
+			size_t pos = head.load(std::memory_order_relaxed);
+
+			if (pos == cached_tail) {
+				cached_tail = tail.load(std::memory_order_acquire);
+
+				if (pos == cached_tail) {
+					return NULL;
+				}
+			}
+
+			return &items[pos & (size - 1)];
+		}
+
+		void pop_front(void){
+			head.store(head.load(std::memory_order_relaxed) + 1,
+			           std::memory_order_release);
+		}
+
+		bool pop(T& item){
+			T *ptr = front();
+
+			if (!ptr) {
+				return false;
+			}
+
+			item = *ptr;
+			pop_front();
+			return true;
+		}
+
+	private:
+		// keep each side's index on its own cache line, along with that
+		// side's stale copy of the other index. Padded rather than alignas()
+		// so the queue can still be new'd without C++17 aligned new.
+		std::atomic<size_t> head{0};
+		size_t cached_tail = 0;
+		char pad_head[64];
+
+		std::atomic<size_t> tail{0};
+		size_t cached_head = 0;
+		char pad_tail[64];
+
+		T items[size];
+};
+
+// namespace tetrode
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <stdint.h>
+
+namespace tetrode {
+
+// Hierarchical timer wheel, for driving lots of boards that each only have
+// something to do every so often. Four levels of 64 slots cover 2^24 ticks,
+// anything further out is parked on the top level until it comes in range.
+// Advancing only visits non-empty slots and one block boundary per 64
+// ticks, so idle stretches are close to free.
+class timer_wheel {
+	public:
+		enum {
+			slot_bits = 6,
+			slots     = 1 << slot_bits,
+			levels    = 4,
+		};
+
+		class entry {
+			public:
+				uint64_t expires = 0;
+				void *data = nullptr;
+
+				bool scheduled(void) const { return pprev != nullptr; }
+
+			private:
+				friend class timer_wheel;
+
+				entry *next = nullptr;
+				entry **pprev = nullptr;
+				uint8_t level = 0;
+				uint8_t slot = 0;
+		};
+
+		timer_wheel(uint64_t start = 0);
+
+		// (re)schedule an entry, entries already due fire on the next
+		// call to advance()
+		void schedule(entry *e, uint64_t expires);
+		void cancel(entry *e);
+
+		// move everything expiring at or before `now` to the ready list
+		void advance(uint64_t now);
+		entry *pop_ready(void);
+
+		uint64_t current(void) const { return now; }
+
+	private:
+		// level used for the ready list
+		enum { ready_level = 0xff };
+
+		void insert(entry *e);
+		void link(entry **head, entry *e, uint8_t level, uint8_t slot);
+		void cascade(unsigned level, unsigned slot);
+
+		entry *wheel[levels][slots];
+		uint64_t occupied[levels];
+		entry *ready;
+		uint64_t now;
+};
+
+// namespace tetrode
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <tetrode/field_state.hpp>
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tetrode {
+
+// Compact encoding of field_snapshot, for streaming boards to clients and
+// storing them in bulk. A frame is either a keyframe, which stands alone,
+// or a delta against the previous snapshot the receiver decoded.
+//
+//   byte 0      kind | version << 4
+//   keyframe    varint width, height, rows in use; the rows; counters
+//   delta       varint changed rows, their index gaps; the rows; counters
+//
+// Rows are packed into a bitstream. Each row starts with a 2-bit kind:
+// empty, colored (occupancy mask followed by a 3-bit color per set
+// cell), cleared (every cell in the line clear state) or raw (4 bits per
+// cell for anything else). Counters are a varint bitmap of the fields that
+// follow, always all of them in a keyframe and only changed ones in a
+// delta. Board scanning uses SSE2 on boards up to 16 wide.
+class wire {
+	public:
+		enum kinds {
+			Keyframe = 1,
+			Delta    = 2,
+		};
+
+		enum { version = 3 };
+
+		// append a frame to `out`, returns the number of bytes written
+		static size_t encode(const field_snapshot& snap, std::vector<uint8_t>& out);
+		static size_t encode_delta(const field_snapshot& prev,
+		                           const field_snapshot& snap,
+		                           std::vector<uint8_t>& out);
+
+		// decode a keyframe into `snap`, or apply a delta on top of it.
+		// Returns the number of bytes used, 0 if the frame is malformed or
+		// a delta doesn't match the board it's applied to, in which case
+		// `snap` is left untouched.
+		static size_t decode(const uint8_t *data, size_t len, field_snapshot& snap);
+};
+
+// namespace tetrode
+}
@@ -0,0 +1,177 @@
+#include <tetrode/asset_pack.hpp>
+
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace tetrode {
+
+static uint32_t get_u32(const uint8_t *p){
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_u32(std::vector<uint8_t>& out, uint32_t n){
+	for (unsigned i = 0; i < 4; i++) {
+		out.push_back(n >> (8 * i));
+	}
+}
+
+asset_pack::asset_pack(){ }
+
+asset_pack::~asset_pack(){
+	unmap();
+}
+
+void asset_pack::unmap(void){
+	if (map) {
+		munmap(map, map_len);
+	}
+
+	map = NULL;
+	map_len = 0;
+	entries.clear();
+}
+
+bool asset_pack::open(const std::string& path){
+	// whatever was open before goes, even if this one fails
+	unmap();
+
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat st;
+
+	if (fd < 0) {
+		return false;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size < 8) {
+		close(fd);
+		return false;
+	}
+
+	// the mapping stays valid after the fd is closed
+	void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	close(fd);
+
+	if (ptr == MAP_FAILED) {
+		return false;
+	}
+
+	map = static_cast<uint8_t*>(ptr);
+	map_len = st.st_size;
+
+	const uint8_t *p = map + 8;
+	const uint8_t *end = map + map_len;
+	uint32_t count = get_u32(map + 4);
+	bool ok = memcmp(map, "TPAK", 4) == 0;
+
+	for (uint32_t i = 0; ok && i < count; i++) {
+		if (end - p < 10) {
+			ok = false;
+			break;
+		}
+
+		uint32_t offset = get_u32(p);
+		uint32_t size = get_u32(p + 4);
+		unsigned name_len = p[8] | p[9] << 8;
+		p += 10;
+
+		if ((size_t)(end - p) < name_len || offset > map_len || size > map_len - offset) {
+			ok = false;
+			break;
+		}
+
+		entries[std::string((const char*)p, name_len)] = std::make_pair(offset, size);
+		p += name_len;
+	}
+
+	if (!ok) {
+		unmap();
+	}
+
+	return ok;
+}
+
+bool asset_pack::find(const std::string& name, const uint8_t **data, size_t *size) const {
+	auto it = entries.find(name);
+
+	if (it == entries.end()) {
+		return false;
+	}
+
+	*data = map + it->second.first;
+	*size = it->second.second;
+	return true;
+}
+
+bool asset_pack::read_file(const std::string& path, std::vector<uint8_t>& out){
+	FILE *fp = fopen(path.c_str(), "rb");
+
+	if (!fp) {
+		return false;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	long len = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	out.resize((len > 0)? len : 0);
+	bool ok = len >= 0 && fread(out.data(), 1, out.size(), fp) == out.size();
+
+	fclose(fp);
+	return ok;
+}
+
+bool asset_pack::build(const std::string& path, const std::string& root,
+                       const std::vector<std::string>& names)
+{
+	std::vector<std::vector<uint8_t>> files(names.size());
+	std::vector<uint8_t> header;
+	size_t offset = 8;
+
+	for (size_t i = 0; i < names.size(); i++) {
+		// the name length is 16 bits
+		if (names[i].size() > 0xffff || !read_file(root + "/" + names[i], files[i])) {
+			return false;
+		}
+
+		offset += 10 + names[i].size();
+	}
+
+	header.insert(header.end(), { 'T', 'P', 'A', 'K' });
+	put_u32(header, names.size());
+
+	for (size_t i = 0; i < names.size(); i++) {
+		// and offsets and sizes are 32
+		if (offset + files[i].size() > UINT32_MAX) {
+			return false;
+		}
+
+		put_u32(header, offset);
+		put_u32(header, files[i].size());
+		header.push_back(names[i].size());
+		header.push_back(names[i].size() >> 8);
+		header.insert(header.end(), names[i].begin(), names[i].end());
+
+		offset += files[i].size();
+	}
+
+	FILE *fp = fopen(path.c_str(), "wb");
+
+	if (!fp) {
+		return false;
+	}
+
+	bool ok = fwrite(header.data(), 1, header.size(), fp) == header.size();
+
+	for (auto& file : files) {
+		ok = ok && fwrite(file.data(), 1, file.size(), fp) == file.size();
+	}
+
+	return (fclose(fp) == 0) && ok;
+}
+
+// namespace tetrode
+}
@@ -0,0 +1,249 @@
+#include <tetrode/bot.hpp>
+#include <tetrode/placement_tables.hpp>
+
+#include <limits.h>
+#include <string.h>
+
+namespace tetrode {
+
+double heuristic_bot::evaluate(const uint16_t *rows, unsigned height, unsigned width) const {
+	// column heights, a hole is any empty cell with a block above it
+	int heights[16] = {};
+	unsigned holes = 0;
+
+	for (unsigned x = 0; x < width; x++) {
+		uint16_t bit = 1 << x;
+		bool covered = false;
+
+		for (int y = height - 1; y >= 0; y--) {
+			if (rows[y] & bit) {
+				if (!covered) {
+					heights[x] = y + 1;
+					covered = true;
+				}
+
+			} else if (covered) {
+				holes++;
+			}
+		}
+	}
+
+	int total = 0, bumpiness = 0;
+
+	for (unsigned x = 0; x < width; x++) {
+		total += heights[x];
+
+		if (x > 0) {
+			int d = heights[x] - heights[x - 1];
+			bumpiness += (d < 0)? -d : d;
+		}
+	}
+
+	return weight.height * total + weight.holes * holes + weight.bumpiness * bumpiness;
+}
+
+double heuristic_bot::best_placement(const uint16_t *rows, unsigned width, unsigned height,
+                                     int spawn_y, enum tetrimino::shape shape,
+                                     unsigned lookahead, unsigned& rotations,
+                                     int& left) const
+{
+	const uint16_t full = (1 << width) - 1;
+	uint16_t tmp[64];
+
+	// column heights, only needed for the landing tables. Padded so a
+	// piece's columns can always be read from its leftmost one.
+	int heights[16 + 4] = {};
+
+	if (tables) {
+		for (unsigned x = 0; x < width; x++) {
+			int y = height;
+
+			while (y > 0 && !((rows[y - 1] >> x) & 1)) {
+				y--;
+			}
+
+			heights[x] = y;
+		}
+	}
+
+	tetrimino tet(shape);
+	double best = -1e300;
+
+	auto fits = [&](int x, int y){
+		for (auto& b : tet.blocks) {
+			int by = b.second.y + y;
+
+			if (by < 0 || by >= (int)height || (rows[by] >> (b.second.x + x)) & 1) {
+				return false;
+			}
+		}
+
+		return true;
+	};
+
+	for (unsigned r = 0; r < 4; r++) {
+		if (r > 0) {
+			if (tet.shape == tetrimino::shape::O) {
+				break;
+			}
+
+			tet.rotate(movement::Right);
+		}
+
+		int min_x = INT_MAX, max_x = INT_MIN;
+
+		for (auto& b : tet.blocks) {
+			min_x = (b.second.x < min_x)? b.second.x : min_x;
+			max_x = (b.second.x > max_x)? b.second.x : max_x;
+		}
+
+		for (int x = -min_x; x + max_x < (int)width; x++) {
+			int y = spawn_y;
+			int land = tables? tables->landing(shape, r, heights + x + min_x) : INT_MAX;
+
+			// anything the tables say is above the spawn row might still
+			// fit under an overhang, so go the long way round for those
+			if (land <= y) {
+				y = land;
+
+			} else {
+				if (!fits(x, y)) {
+					continue;
+				}
+
+				while (fits(x, y - 1)) {
+					y--;
+				}
+			}
+
+			memcpy(tmp, rows, height * sizeof(uint16_t));
+
+			for (auto& b : tet.blocks) {
+				tmp[b.second.y + y] |= 1 << (b.second.x + x);
+			}
+
+			// clear full rows, shifting the rest down
+			unsigned cleared = 0;
+
+			for (unsigned src = 0; src < height; src++) {
+				if (tmp[src] == full) {
+					cleared++;
+
+				} else {
+					tmp[src - cleared] = tmp[src];
+				}
+			}
+
+			for (unsigned k = height - cleared; k < height; k++) {
+				tmp[k] = 0;
+			}
+
+			double score = weight.lines * cleared;
+
+			if (lookahead > 0) {
+				double next = 0;
+
+				for (unsigned s = 0; s < 7; s++) {
+					unsigned next_r;
+					int next_left;
+
+					next += best_placement(tmp, width, height, spawn_y,
+					                       (enum tetrimino::shape)s, lookahead - 1,
+					                       next_r, next_left);
+				}
+
+				score += next / 7;
+
+			} else {
+				score += evaluate(tmp, height, width);
+			}
+
+			if (score > best) {
+				best = score;
+				rotations = r;
+				left = x + min_x;
+			}
+		}
+	}
+
+	return best;
+}
+
+template <class field_t>
+void heuristic_bot::plan(field_t& field){
+	const unsigned width = field.size.x;
+	const unsigned height = (field.size.y < 64)? field.size.y : 64;
+
+	uint16_t rows[64];
+
+	for (unsigned y = 0; y < height; y++) {
+		rows[y] = 0;
+
+		for (unsigned x = 0; x < width; x++) {
+			rows[y] |= (field.field[y][x].state != block::states::Empty) << x;
+		}
+	}
+
+	rotations_left = 0;
+	target_x = field.active.second.x;
+
+	enum tetrimino::shape shape = field.active.first.shape;
+
+	if (!tables || !tables->book_matches(weight)
+	    || !tables->book_move(rows, width, height, shape, rotations_left, target_x))
+	{
+		best_placement(rows, width, height, field.active.second.y, shape, 0,
+		               rotations_left, target_x);
+	}
+
+	planned = true;
+	last_x = INT_MIN;
+}
+
+template <class field_t>
+event heuristic_bot::next_move(field_t& field){
+	// locked by gravity before we got to drop it
+	if (field.updates & changes::Locked) {
+		planned = false;
+	}
+
+	// the board only keeps one rotation and a hold from the line clear
+	// delay, easier to wait it out
+	if (field.clear_ticks > 0) {
+		return event::NullEvent;
+	}
+
+	if (!planned) {
+		plan(field);
+	}
+
+	if (rotations_left > 0) {
+		rotations_left--;
+		return event::RotateRight;
+	}
+
+	int x = INT_MAX;
+
+	for (auto& b : field.active.first.blocks) {
+		int bx = b.second.x + field.active.second.x;
+		x = (bx < x)? bx : x;
+	}
+
+	// give up and drop wherever it is if the last move didn't go anywhere
+	if (x != target_x && x != last_x) {
+		last_x = x;
+		return (x < target_x)? event::MoveRight : event::MoveLeft;
+	}
+
+	planned = false;
+	return event::Drop;
+}
+
+template event heuristic_bot::next_move(field_state&);
+template event heuristic_bot::next_move(classic_field_state&);
+template event heuristic_bot::next_move(twenty_g_field_state&);
+template event heuristic_bot::next_move(fine_field_state&);
+template event heuristic_bot::next_move(zero_delay_field_state&);
+
+// namespace tetrode
+}
@@ -1,13 +1,15 @@
 #include <tetrode/field_state.hpp>
-#include <stdlib.h> // rand(), TODO: implement prng
+#include <tetrode/game_stats.hpp>
 
 #include <stdio.h>
 
 namespace tetrode {
 
-field_state::field_state(unsigned board_x, unsigned board_y, uint32_t seed){
+template <class rules_t>
+basic_field_state<rules_t>::basic_field_state(unsigned board_x, unsigned board_y, uint32_t seed){
 	// initialize game state
-	random_seed = seed;
+	// xorshift gets stuck on zero
+	random_seed = seed? seed : 0x2545f491;
 	size = coord_2d(board_x, board_y);
 	lines_cleared = score = drop_ticks = movement_ticks = clear_ticks = 0;
 	level = 1;
@@ -22,7 +24,8 @@ field_state::field_state(unsigned board_x, unsigned board_y, uint32_t seed){
 	}
 }
 
-void field_state::get_new_active_tetrimino(void){
+template <class rules_t>
+void basic_field_state<rules_t>::get_new_active_tetrimino(void){
 	// make sure there's enough pieces in the queue for the preview
 	// and popping a new block
 	if (next_pieces.size() < 2) {
@@ -32,30 +35,119 @@ void field_state::get_new_active_tetrimino(void){
 	tetrimino piece = next_pieces.front();
 	next_pieces.pop_front();
 	active = { piece, coord_2d(size.x / 2 - 1, size.y / 2 + 1) };
+	spin = NoSpin;
+
+	// field isn't allocated yet when called from the constructor
+	if (!field.empty() && active_overlaps()) {
+		topped_out = true;
+	}
+}
+
+template <class rules_t>
+bool basic_field_state<rules_t>::overlaps(const tetrimino& tet, const coord_2d& coord){
+	for (auto& block : tet.blocks) {
+		int y = block.second.y + coord.y;
+		int x = block.second.x + coord.x;
+
+		if (x < 0 || x >= size.x || y < 0 || y >= size.y
+		    || field[y][x].state != block::states::Empty)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+template <class rules_t>
+bool basic_field_state<rules_t>::active_overlaps(void){
+	return overlaps(active.first, active.second);
 }
 
-void field_state::place_active(void){
+template <class rules_t>
+void basic_field_state<rules_t>::add_garbage(unsigned lines, unsigned hole){
+	if (hole >= (unsigned)size.x) {
+		throw "field_state::add_garbage(): hole outside the board";
+	}
+
+	if (lines == 0) {
+		return;
+	}
+
+	if (lines >= (unsigned)size.y) {
+		topped_out = true;
+		return;
+	}
+
+	// anything pushed off the top of the field ends the game
+	for (int y = size.y - lines; y < size.y; y++) {
+		for (auto& block : field[y]) {
+			if (block.state != block::states::Empty) {
+				topped_out = true;
+			}
+		}
+	}
+
+	for (int y = size.y - 1; y >= (int)lines; y--) {
+		field[y].swap(field[y - lines]);
+	}
+
+	for (unsigned y = 0; y < lines; y++) {
+		for (int x = 0; x < size.x; x++) {
+			field[y][x] = (x == (int)hole)? block::states::Empty
+			                              : block::states::Garbage;
+		}
+	}
+
+	// keep the falling piece on top of the new rows. One pushed out of
+	// the top ends the game, it can't lock up there.
+	while (active_overlaps()) {
+		if (active.second.y >= size.y) {
+			topped_out = true;
+			break;
+		}
+
+		active.second.y += 1;
+	}
+
+	updates |= changes::Updated;
+}
+
+template <class rules_t>
+void basic_field_state<rules_t>::place_active(void){
 	int cleared = 0;
+	bool straight = false;
+	bool mini = false;
+	bool tspin = active_tspin(mini);
+
+	if (stats) {
+		// could it have gone straight down from the spawn row
+		coord_2d top(active.second.x, size.y/2 + 1);
+		straight = lower_collide_coord(active.first, top).y == active.second.y;
+	}
 
 	for (auto& block : active.first.blocks) {
 		auto& coord = active.second;
 		field[coord.y + block.second.y][coord.x + block.second.x] = block.first;
 	}
 
-	if ((cleared = color_cleared_lines())) {
-		clear_ticks = 30;
+	if ((cleared = clear_lines())) {
+		clear_ticks = rules::clear_delay;
 		lines_cleared += cleared;
+		level = rules::level_for(lines_cleared);
+	}
 
-		// TODO: variable goal levels
-		level = 1 + (lines_cleared / 10);
+	if (tspin) {
+		score += rules::tspin_score(cleared, level, mini);
+		updates |= changes::Tspin;
 
-		switch (cleared) {
-			case 1: score += 100 * level; break;
-			case 2: score += 300 * level; break;
-			case 3: score += 500 * level; break;
-			case 4: score += 800 * level; break;
-			default: /* wut */ break;
-		}
+	} else {
+		score += rules::line_score(cleared, level);
+	}
+
+	if (stats) {
+		stats->lock(active.first, active.second, size.x, cleared,
+		            drop_ticks, rules::lock_delay, straight);
 	}
 
 	get_new_active_tetrimino();
@@ -66,7 +158,8 @@ void field_state::place_active(void){
 	updates |= changes::Locked | changes::Updated;
 }
 
-bool field_state::collides_lower(tetrimino& tet, coord_2d& coord){
+template <class rules_t>
+bool basic_field_state<rules_t>::collides_lower(tetrimino& tet, coord_2d& coord){
 	for (auto& block : tet.blocks) {
 		int y = block.second.y + coord.y;
 		int x = block.second.x + coord.x;
@@ -83,11 +176,13 @@ bool field_state::collides_lower(tetrimino& tet, coord_2d& coord){
 	return false;
 }
 
-bool field_state::active_collides_lower(void){
+template <class rules_t>
+bool basic_field_state<rules_t>::active_collides_lower(void){
 	return collides_lower(active.first, active.second);
 }
 
-coord_2d field_state::lower_collide_coord(tetrimino& tet, coord_2d& coord){
+template <class rules_t>
+coord_2d basic_field_state<rules_t>::lower_collide_coord(tetrimino& tet, coord_2d& coord){
 	coord_2d ret = coord;
 
 	while (!collides_lower(tet, ret)){
@@ -97,7 +192,8 @@ coord_2d field_state::lower_collide_coord(tetrimino& tet, coord_2d& coord){
 	return ret;
 }
 
-bool field_state::active_collides_sides(enum movement dir){
+template <class rules_t>
+bool basic_field_state<rules_t>::active_collides_sides(enum movement dir){
 	for (auto& block : active.first.blocks) {
 		auto& coord = active.second;
 
@@ -128,71 +224,444 @@ bool field_state::active_collides_sides(enum movement dir){
 	return false;
 }
 
-void field_state::active_normalize(void){
-	int min_x = 0;
-	int min_y = 0;
+template <class rules_t>
+void basic_field_state<rules_t>::rotate_active(enum movement dir){
+	tetrimino turned = active.first;
+	turned.rotate(dir);
 
-	int over_x = 0;
-	int over_y = 0;
+	// without SRS a rotation that doesn't fit as is just doesn't happen
+	const unsigned tests = rules::srs? tetrimino::kick_tests : 1;
 
-	for (auto& block : active.first.blocks) {
-		auto& coord = active.second;
+	for (unsigned i = 0; i < tests; i++) {
+		coord_2d kick = tetrimino::kick(turned.shape, active.first.rotations, dir, i);
+		coord_2d at(active.second.x + kick.x, active.second.y + kick.y);
 
-		int y = block.second.y + coord.y;
-		int x = block.second.x + coord.x;
+		if (!overlaps(turned, at)) {
+			active = { turned, at };
+			spin = (i == tetrimino::kick_tests - 1)? SpinKicked : SpinRotated;
+			updates |= changes::Rotated | changes::Updated;
+			return;
+		}
+	}
+
+	updates |= changes::WallHit;
+}
+
+template <class rules_t>
+bool basic_field_state<rules_t>::active_tspin(bool& mini){
+	if (!rules::srs || spin == NoSpin || active.first.shape != tetrimino::shape::T) {
+		return false;
+	}
+
+	// the cells diagonal to the T's center, clockwise from top left.
+	// Walls and the floor count as filled.
+	static const int corners[4][2] = { { -1, 1 }, { 1, 1 }, { 1, -1 }, { -1, -1 } };
+	// the two corners either side of the point, for each rotation
+	static const unsigned front[4] = { 0x3, 0x6, 0xc, 0x9 };
+	// corner masks with three or four bits set
+	const unsigned three_corners = 1 << 7 | 1 << 11 | 1 << 13 | 1 << 14 | 1 << 15;
+
+	unsigned filled = 0;
 
-		if (y < min_y){
-			min_y = y;
+	for (unsigned i = 0; i < 4; i++) {
+		int x = active.second.x + corners[i][0];
+		int y = active.second.y + corners[i][1];
+
+		bool wall = x < 0 || x >= size.x || y < 0;
+		filled |= (wall || (y < size.y && field[y][x].state != block::states::Empty)) << i;
+	}
+
+	unsigned point = front[active.first.rotations];
+	mini = (filled & point) != point && spin != SpinKicked;
+
+	return (three_corners >> filled) & 1;
+}
+
+template <class rules_t>
+unsigned basic_field_state<rules_t>::next_event(void){
+	if (topped_out) {
+		return no_event;
+	}
+
+	// the tick that brings clear_ticks to zero clears the lines
+	if (clear_ticks > 0) {
+		return clear_ticks;
+	}
+
+	bool grounded = active_collides_lower();
+
+	// a piece that was lifted off the stack resets the lock timer on the
+	// next tick, 20G pieces fall or start their lock timer on it
+	if (drop_ticks && !grounded) {
+		return 1;
+	}
+
+	if (rules::instant_gravity && (!grounded || drop_ticks == 0)) {
+		return 1;
+	}
+
+	unsigned ret = no_event;
+
+	if (!rules::instant_gravity) {
+		unsigned gravity = rules::gravity_ticks(level);
+		ret = (movement_ticks >= gravity)? 1 : gravity - movement_ticks + 1;
+	}
+
+	if (drop_ticks) {
+		unsigned lock = (drop_ticks > rules::lock_delay)? 1
+		              : rules::lock_delay - drop_ticks + 1;
+		ret = (lock < ret)? lock : ret;
+	}
+
+	unsigned repeat = next_repeat();
+	return (repeat < ret)? repeat : ret;
+}
+
+template <class rules_t>
+unsigned basic_field_state<rules_t>::next_repeat(void){
+	unsigned ret = no_event;
+
+	// soft drop always counts, even the steps that can't move reset the
+	// counter
+	if (held & HeldDown) {
+		ret = (soft_drop_ticks + 1 >= handling.soft_drop)? 1
+		    : handling.soft_drop - soft_drop_ticks;
+	}
+
+	enum movement dir = (held & ShiftRight)? movement::Right : movement::Left;
+	unsigned key = (dir == movement::Right)? HeldRight : HeldLeft;
+
+	// repeats into a wall don't do anything, so they can be skipped
+	if ((held & key) && !active_collides_sides(dir)) {
+		unsigned at = (shift_ticks + 1 > handling.das)? shift_ticks + 1 : handling.das;
+
+		if (handling.arr > 0) {
+			unsigned over = at - handling.das;
+			at = handling.das + (over + handling.arr - 1) / handling.arr * handling.arr;
 		}
 
-		if (x < min_x){
-			min_x = x;
+		ret = (at - shift_ticks < ret)? at - shift_ticks : ret;
+	}
+
+	return ret;
+}
+
+template <class rules_t>
+void basic_field_state<rules_t>::skip_idle_ticks(unsigned ticks){
+	// only valid for ticks < next_event(), where a Tick does nothing but
+	// count, see handle_event()
+	if (stats) {
+		stats->ticks += ticks;
+		stats->clear_ticks += (clear_ticks > 0)? ticks : 0;
+	}
+
+	if (clear_ticks > 0) {
+		clear_ticks -= ticks;
+		return;
+	}
+
+	movement_ticks += ticks;
+	drop_ticks += drop_ticks? ticks : 0;
+
+	unsigned key = (held & ShiftRight)? HeldRight : HeldLeft;
+	shift_ticks += (held & key)? ticks : 0;
+	soft_drop_ticks += (held & HeldDown)? ticks : 0;
+}
+
+template <class rules_t>
+void basic_field_state<rules_t>::advance(unsigned ticks){
+	while (ticks > 0 && !topped_out) {
+		unsigned idle = next_event() - 1;
+		unsigned skip = (idle < ticks)? idle : ticks;
+
+		skip_idle_ticks(skip);
+		ticks -= skip;
+
+		if (ticks > 0) {
+			handle_event(event::Tick);
+			ticks--;
 		}
+	}
+}
 
-		if (y >= size.y && y > over_y) {
-			over_y = y;
+template <class rules_t>
+void basic_field_state<rules_t>::save_state(field_snapshot& snap){
+	snap.size_x = size.x;
+	snap.size_y = size.y;
+	snap.cells.resize(size.x * size.y);
+
+	uint8_t *cell = snap.cells.data();
+	for (auto& row : field) {
+		for (auto& block : row) {
+			*cell++ = block.state;
 		}
+	}
 
-		if (x >= size.x && x > over_x) {
-			over_x = x;
+	snap.queue_len = 0;
+	for (auto& piece : next_pieces) {
+		if (snap.queue_len < field_snapshot::max_queue) {
+			snap.queue[snap.queue_len++] = piece.shape;
 		}
 	}
 
-	active.second.x -= min_x;
-	active.second.y -= min_y;
+	snap.active_shape = active.first.shape;
+	snap.active_rotations = active.first.rotations;
+	snap.active_x = active.second.x;
+	snap.active_y = active.second.y;
+	snap.spin = spin;
 
-	active.second.x -= over_x? over_x - size.x + 1: 0;
-	active.second.y -= over_y? over_y - size.y + 1: 0;
+	for (unsigned i = 0; i < 4; i++) {
+		snap.active_blocks[i][0] = active.first.blocks[i].second.x;
+		snap.active_blocks[i][1] = active.first.blocks[i].second.y;
+	}
+
+	snap.hold_shape     = hold.shape;
+	snap.have_held      = have_held;
+	snap.already_held   = already_held;
+	snap.topped_out     = topped_out;
+	snap.random_seed    = random_seed;
+	snap.movement_ticks = movement_ticks;
+	snap.clear_ticks    = clear_ticks;
+	snap.drop_ticks     = drop_ticks;
+	snap.held           = held;
+	snap.shift_ticks    = shift_ticks;
+	snap.soft_drop_ticks = soft_drop_ticks;
+	snap.level          = level;
+	snap.score          = score;
+	snap.lines_cleared  = lines_cleared;
 }
 
-void field_state::rotation_normalize(void){
-	bool collided = false;
+template <class rules_t>
+void basic_field_state<rules_t>::load_state(const field_snapshot& snap){
+	if (snap.size_x != size.x || snap.size_y != size.y) {
+		throw "field_state::load_state(): board size mismatch";
+	}
+
+	// overwrite in place, none of this allocates once the queue has been
+	// as long as the snapshot's before
+	const uint8_t *cell = snap.cells.data();
+	for (auto& row : field) {
+		for (auto& block : row) {
+			block.state = static_cast<block::states>(*cell++);
+		}
+	}
 
-	active_normalize();
-	while (active_collides_lower()) {
-		active.second.y += 1;
-		collided = true;
+	next_pieces.resize(snap.queue_len);
+	unsigned i = 0;
+	for (auto& piece : next_pieces) {
+		piece = tetrimino(static_cast<enum tetrimino::shape>(snap.queue[i++]));
+	}
+
+	active.first = tetrimino(static_cast<enum tetrimino::shape>(snap.active_shape));
+	active.first.rotations = snap.active_rotations;
+	active.second = coord_2d(snap.active_x, snap.active_y);
+	spin = snap.spin;
+
+	for (unsigned k = 0; k < 4; k++) {
+		active.first.blocks[k].second.x = snap.active_blocks[k][0];
+		active.first.blocks[k].second.y = snap.active_blocks[k][1];
 	}
 
-	active.second.y -= collided;
+	hold           = tetrimino(static_cast<enum tetrimino::shape>(snap.hold_shape));
+	have_held      = snap.have_held;
+	already_held   = snap.already_held;
+	topped_out     = snap.topped_out;
+	random_seed    = snap.random_seed;
+	movement_ticks = snap.movement_ticks;
+	clear_ticks    = snap.clear_ticks;
+	drop_ticks     = snap.drop_ticks;
+	held           = snap.held;
+	shift_ticks    = snap.shift_ticks;
+	soft_drop_ticks = snap.soft_drop_ticks;
+	level          = snap.level;
+	score          = snap.score;
+	lines_cleared  = snap.lines_cleared;
+	updates        = changes::Updated;
+	cleared_rows   = 0;
 }
 
-void field_state::handle_event(enum event ev){
-	// clear_ticks set by place_active, to add a delay when a row is cleared
+template <class rules_t>
+void basic_field_state<rules_t>::update_held(enum event ev){
+	switch (ev) {
+		// the last direction pressed is the one that repeats
+		case event::MoveLeft:
+			held = (held | HeldLeft) & ~ShiftRight;
+			shift_ticks = 0;
+			break;
+
+		case event::MoveRight:
+			held |= HeldRight | ShiftRight;
+			shift_ticks = 0;
+			break;
+
+		case event::ReleaseLeft:
+			held &= ~HeldLeft;
+
+			if (!(held & ShiftRight) && (held & HeldRight)) {
+				held |= ShiftRight;
+				shift_ticks = 0;
+			}
+
+			break;
+
+		case event::ReleaseRight:
+			held &= ~HeldRight;
+
+			if ((held & ShiftRight) && (held & HeldLeft)) {
+				shift_ticks = 0;
+			}
+
+			held &= ~ShiftRight;
+			break;
+
+		case event::MoveDown:
+			held |= HeldDown;
+			soft_drop_ticks = 0;
+			break;
+
+		case event::ReleaseDown:
+			held &= ~HeldDown;
+			break;
+
+		default: break;
+	}
+}
+
+// Only rotations and hold are kept for the next piece. MoveLeft,
+// MoveRight and Drop pressed during the clear delay are dropped, the
+// only part of a shift that carries over is the held key, through
+// update_held() when handling is on, so DAS picks it back up once the
+// piece can move.
+template <class rules_t>
+void basic_field_state<rules_t>::buffer_input(enum event ev){
+	switch (ev) {
+		// the last rotation pressed wins
+		case event::RotateLeft:
+			held = (held | BufferedRotateLeft) & ~BufferedRotateRight;
+			break;
+
+		case event::RotateRight:
+			held = (held | BufferedRotateRight) & ~BufferedRotateLeft;
+			break;
+
+		case event::Hold:
+			held |= BufferedHold;
+			break;
+
+		default: break;
+	}
+}
+
+template <class rules_t>
+void basic_field_state<rules_t>::apply_buffered(void){
+	uint8_t buffered = held;
+	held &= ~(BufferedRotateLeft | BufferedRotateRight | BufferedHold);
+
+	// hold first, so the rotation goes to the piece that comes out
+	if (buffered & BufferedHold)        handle_event(event::Hold);
+	if (buffered & BufferedRotateLeft)  handle_event(event::RotateLeft);
+	if (buffered & BufferedRotateRight) handle_event(event::RotateRight);
+}
+
+template <class rules_t>
+void basic_field_state<rules_t>::repeat_held(void){
+	if (held & HeldDown) {
+		if (++soft_drop_ticks >= handling.soft_drop) {
+			soft_drop_ticks = 0;
+
+			if (!active_collides_lower()) {
+				active.second.y -= 1;
+				spin = NoSpin;
+				updates |= changes::Updated;
+
+			} else if (drop_ticks == 0) {
+				drop_ticks = 1;
+			}
+		}
+	}
+
+	enum movement dir = (held & ShiftRight)? movement::Right : movement::Left;
+	unsigned key = (dir == movement::Right)? HeldRight : HeldLeft;
+
+	if (!(held & key)) {
+		return;
+	}
+
+	shift_ticks++;
+
+	if (shift_ticks < handling.das
+	    || (handling.arr > 0 && (shift_ticks - handling.das) % handling.arr != 0))
+	{
+		return;
+	}
+
+	// an arr of 0 slides all the way over in one go
+	do {
+		if (active_collides_sides(dir)) {
+			break;
+		}
+
+		active.second.x += (dir == movement::Right)? 1 : -1;
+		spin = NoSpin;
+		updates |= changes::Updated;
+	} while (handling.arr == 0);
+}
+
+template <class rules_t>
+void basic_field_state<rules_t>::handle_event(enum event ev){
+	if (topped_out) {
+		return;
+	}
+
+	// key state is tracked even through line clears, so releases aren't
+	// lost
+	if (handling.enabled) {
+		update_held(ev);
+	}
+
+	if (stats && ev == event::Tick) {
+		stats->ticks++;
+		stats->clear_ticks += clear_ticks > 0;
+	}
+
+	// clear_ticks set by place_active, the rows are already gone but the
+	// next piece waits that many ticks before it moves. Only ticks count
+	// it down, and rotations and holds pressed meanwhile are saved for
+	// the piece instead of being dropped.
 	if (clear_ticks > 0) {
-		clear_ticks--;
+		if (ev != event::Tick) {
+			buffer_input(ev);
 
-		if (clear_ticks == 0) {
-			clear_lines();
+		} else if (--clear_ticks == 0) {
+			apply_buffered();
 			updates |= changes::Updated;
 		}
 
 		return;
 	}
 
+	if (stats && ev != event::Tick) {
+		stats->input(ev);
+	}
+
 	switch (ev) {
 		case event::Tick:
-			if (movement_ticks >= 15){
+			repeat_held();
+
+			// rules are compile-time constants, so only one of these
+			// branches survives in each specialization
+			if (rules::instant_gravity) {
+				while (!active_collides_lower()) {
+					active.second.y -= 1;
+					spin = NoSpin;
+					updates |= changes::Updated;
+				}
+
+				if (drop_ticks == 0) {
+					drop_ticks = 1;
+				}
+
+			} else if (movement_ticks >= rules::gravity_ticks(level)){
 				movement_ticks = 0;
 				handle_event(event::MoveDown);
 			}
@@ -200,7 +669,7 @@ void field_state::handle_event(enum event ev){
 			if (drop_ticks && active_collides_lower()) {
 				drop_ticks++;
 
-				if (drop_ticks > 50) {
+				if (drop_ticks > rules::lock_delay) {
 					place_active();
 					drop_ticks = 0;
 				}
@@ -216,6 +685,7 @@ void field_state::handle_event(enum event ev){
 			// TODO: timeout for moving pieces around after collision
 			if (!active_collides_lower()) {
 				active.second.y -= 1;
+				spin = NoSpin;
 				updates |= changes::Updated;
 
 			} else if (drop_ticks == 0) {
@@ -228,13 +698,14 @@ void field_state::handle_event(enum event ev){
 		case event::Drop:
 			while (!active_collides_lower()) {
 				active.second.y -= 1;
+				spin = NoSpin;
 			}
 
 			place_active();
 			break;
 
 		case event::Hold:
-			if (!already_held) {
+			if (rules::allow_hold && !already_held) {
 				if (have_held) {
 					next_pieces.push_front(hold);
 				}
@@ -253,6 +724,7 @@ void field_state::handle_event(enum event ev){
 		case event::MoveLeft:
 			if (!active_collides_sides(movement::Left)) {
 				active.second.x -= 1;
+				spin = NoSpin;
 				updates |= changes::Updated;
 			}
 			
@@ -265,6 +737,7 @@ void field_state::handle_event(enum event ev){
 		case event::MoveRight:
 			if (!active_collides_sides(movement::Right)) {
 				active.second.x += 1;
+				spin = NoSpin;
 				updates |= changes::Updated;
 			}
 
@@ -275,22 +748,27 @@ void field_state::handle_event(enum event ev){
 			break;
 
 		case event::RotateLeft:
-			active.first.rotate(movement::Left);
-			rotation_normalize();
-			updates |= changes::Rotated | changes::Updated;
+			rotate_active(movement::Left);
 			break;
 
 		case event::RotateRight:
-			active.first.rotate(movement::Right);
-			rotation_normalize();
-			updates |= changes::Rotated | changes::Updated;
+			rotate_active(movement::Right);
 			break;
 
 		default: break;
 	}
 }
 
-void field_state::generate_next_pieces(void){
+template <class rules_t>
+uint32_t basic_field_state<rules_t>::next_random(void){
+	random_seed ^= random_seed << 13;
+	random_seed ^= random_seed >> 17;
+	random_seed ^= random_seed << 5;
+	return random_seed;
+}
+
+template <class rules_t>
+void basic_field_state<rules_t>::generate_next_pieces(void){
 	std::list<tetrimino> pieces;
 
 	// 7-bag random generator, generate a list of all 7 tetriminos
@@ -301,7 +779,7 @@ void field_state::generate_next_pieces(void){
 
 	// then insert them into the piece queue in a random order
 	while (!pieces.empty()) {
-		unsigned index = rand() % pieces.size();
+		unsigned index = next_random() % pieces.size();
 		std::list<tetrimino>::iterator it = std::next(pieces.begin(), index);
 
 		next_pieces.push_back(*it);
@@ -309,10 +787,15 @@ void field_state::generate_next_pieces(void){
 	}
 }
 
-int field_state::clear_lines(void){
+template <class rules_t>
+int basic_field_state<rules_t>::clear_lines(void){
 	int cleared = 0;
+	int dst = 0;
+	cleared_rows = 0;
 
-	for (int y = 0; y < size.y;) {
+	// full rows are skipped over and everything else slides down into
+	// place, swapping rows rather than copying them
+	for (int y = 0; y < size.y; y++) {
 		bool full = true;
 
 		for (auto& block : field[y]) {
@@ -326,47 +809,52 @@ int field_state::clear_lines(void){
 
 		if (full) {
 			cleared++;
+			cleared_rows |= (y < 64)? 1ull << y : 0;
+			continue;
+		}
 
-			for (int j = y; j < size.y - 1; j++) {
-				field[j] = field[j + 1];
-			}
-
-			field[size.y - 1].resize(size.x);
+		if (dst != y) {
+			field[dst].swap(field[y]);
 		}
 
-		else {
-			y += 1;
+		dst++;
+	}
+
+	for (int y = dst; y < size.y; y++) {
+		for (auto& block : field[y]) {
+			block.state = block::states::Empty;
 		}
 	}
 
 	return cleared;
 }
 
-int field_state::color_cleared_lines(void){
-	int cleared = 0;
+uint32_t field_snapshot::checksum(void) const {
+	uint32_t hash = 2166136261u;
 
-	for (int y = 0; y < size.y; y++) {
-		bool full = true;
+	auto mix = [&](const void *data, size_t len){
+		const uint8_t *p = static_cast<const uint8_t*>(data);
 
-		for (auto& block : field[y]) {
-			if (block.state == block::states::Empty
-			    || block.state == block::states::Reserved)
-			{
-				full = false;
-				break;
-			}
+		for (size_t i = 0; i < len; i++) {
+			hash = (hash ^ p[i]) * 16777619u;
 		}
-
-		if (full) {
-			cleared++;
-
-			for (auto& block : field[y]) {
-				block.state = block::states::Cleared;
-			}
-		}
-	}
-
-	return cleared;
+	};
+
+	const uint32_t counters[] = {
+		random_seed, movement_ticks, clear_ticks, drop_ticks,
+		held, shift_ticks, soft_drop_ticks,
+		level, score, lines_cleared,
+		(uint32_t)active_x, (uint32_t)active_y, active_rotations, spin,
+		hold_shape, have_held, already_held, topped_out,
+	};
+
+	mix(cells.data(), cells.size());
+	mix(queue, queue_len);
+	mix(&active_shape, 1);
+	mix(active_blocks, sizeof(active_blocks));
+	mix(counters, sizeof(counters));
+
+	return hash;
 }
 
 void tetrimino::rotate(enum movement dir){
@@ -375,6 +863,8 @@ void tetrimino::rotate(enum movement dir){
 		return;
 	}
 
+	rotations += (dir == movement::Right)? 1 : 3;
+
 	for (auto& block : blocks) {
 		auto orig = block.second;
 
@@ -390,75 +880,118 @@ void tetrimino::rotate(enum movement dir){
 	}
 }
 
+coord_2d tetrimino::kick(enum shape shape, unsigned from,
+                         enum movement dir, unsigned test)
+{
+	// SRS offsets for each rotation, pieces turn about their (0, 0)
+	// block and the kicks to try are the offsets of the rotation being
+	// left minus those of the one being entered
+	static const int8_t offsets[3][4][kick_tests][2] = {
+		// J, L, S, T, Z
+		{
+			{ {  0, 0 }, {  0, 0 }, {  0,  0 }, { 0,  0 }, {  0,  0 } },
+			{ {  0, 0 }, {  1, 0 }, {  1, -1 }, { 0,  2 }, {  1,  2 } },
+			{ {  0, 0 }, {  0, 0 }, {  0,  0 }, { 0,  0 }, {  0,  0 } },
+			{ {  0, 0 }, { -1, 0 }, { -1, -1 }, { 0,  2 }, { -1,  2 } },
+		},
+		// I
+		{
+			{ {  0, 0 }, { -1, 0 }, {  2,  0 }, { -1, 0 }, {  2,  0 } },
+			{ { -1, 0 }, {  0, 0 }, {  0,  0 }, { 0,  1 }, {  0, -2 } },
+			{ { -1, 1 }, {  1, 1 }, { -2,  1 }, { 1,  0 }, { -2,  0 } },
+			{ {  0, 1 }, {  0, 1 }, {  0,  1 }, { 0, -1 }, {  0,  2 } },
+		},
+		// O, which doesn't turn at all here
+		{},
+	};
+
+	const unsigned set = (shape == shape::I)? 1 : (shape == shape::O)? 2 : 0;
+	const unsigned to = (from + ((dir == movement::Right)? 1 : 3)) & 3;
+
+	const int8_t *a = offsets[set][from & 3][test];
+	const int8_t *b = offsets[set][to][test];
+
+	return coord_2d(a[0] - b[0], a[1] - b[1]);
+}
+
 void tetrimino::regen_blocks(void){
+	rotations = 0;
+
 	// TODO: maybe find a more concise way to do this
 	switch (shape) {
 		case shape::I:
-			blocks = {
+			blocks = {{
 				{ block(block::states::Cyan), coord_2d(-1, 0) },
 				{ block(block::states::Cyan), coord_2d( 0, 0) },
 				{ block(block::states::Cyan), coord_2d( 1, 0) },
 				{ block(block::states::Cyan), coord_2d( 2, 0) },
-			};
+			}};
 			break;
 
 		case shape::O:
-			blocks = {
+			blocks = {{
 				{ block(block::states::Yellow), coord_2d(0, 0) },
 				{ block(block::states::Yellow), coord_2d(0, 1) },
 				{ block(block::states::Yellow), coord_2d(1, 0) },
 				{ block(block::states::Yellow), coord_2d(1, 1) },
-			};
+			}};
 			break;
 
 		case shape::T:
-			blocks = {
+			blocks = {{
 				{ block(block::states::Purple), coord_2d( 0, 1) },
 				{ block(block::states::Purple), coord_2d(-1, 0) },
 				{ block(block::states::Purple), coord_2d( 0, 0) },
 				{ block(block::states::Purple), coord_2d( 1, 0) },
-			};
+			}};
 			break;
 
 		case shape::S:
-			blocks = {
+			blocks = {{
 				{ block(block::states::Green), coord_2d(-1, 0) },
 				{ block(block::states::Green), coord_2d( 0, 0) },
 				{ block(block::states::Green), coord_2d( 0, 1) },
 				{ block(block::states::Green), coord_2d( 1, 1) },
-			};
+			}};
 			break;
 
 		case shape::Z:
-			blocks = {
+			blocks = {{
 				{ block(block::states::Red), coord_2d( 0, 0) },
 				{ block(block::states::Red), coord_2d( 1, 0) },
 				{ block(block::states::Red), coord_2d(-1, 1) },
 				{ block(block::states::Red), coord_2d( 0, 1) },
-			};
+			}};
 			break;
 
 		case shape::J:
-			blocks = {
+			blocks = {{
 				{ block(block::states::Blue), coord_2d(-1, 0) },
 				{ block(block::states::Blue), coord_2d( 0, 0) },
 				{ block(block::states::Blue), coord_2d( 1, 0) },
 				{ block(block::states::Blue), coord_2d(-1, 1) },
-			};
+			}};
 			break;
 
 		case shape::L:
-			blocks = {
+			blocks = {{
 				{ block(block::states::Orange), coord_2d(-1, 0) },
 				{ block(block::states::Orange), coord_2d( 0, 0) },
 				{ block(block::states::Orange), coord_2d( 1, 0) },
 				{ block(block::states::Orange), coord_2d( 1, 1) },
-			};
+			}};
 			break;
 
 		default: break;
 	}
 }
 
+// every rule set used by the frontends needs an instantiation here
+template class basic_field_state<guideline_rules>;
+template class basic_field_state<classic_rules>;
+template class basic_field_state<twenty_g_rules>;
+template class basic_field_state<fine_rules<guideline_rules, 1000>>;
+template class basic_field_state<zero_delay_rules<guideline_rules>>;
+
 // namespace tetrode
 }
@@ -10,6 +10,54 @@ void frontend::handle_event(enum event ev){
 	}
 }
 
+void frontend::track_history(void){
+	if (!practice) {
+		return;
+	}
+
+	if (field.updates & changes::Locked) {
+		placement_pending = true;
+	}
+
+	// placements are taken once the clear delay is over, so rewinding
+	// never lands in the middle of one
+	if ((placement_pending || history.empty()) && field.clear_ticks == 0) {
+		// playing on from an earlier placement replaces what came after
+		if (!history.empty() && history_at != history.last()) {
+			history.truncate(history_at);
+		}
+
+		history.record(field);
+		history_at = history.last();
+		placement_pending = false;
+	}
+}
+
+bool frontend::rewind(long steps){
+	if (!practice || history.empty()) {
+		return false;
+	}
+
+	long target = (long)history_at + steps;
+	target = (target < (long)history.first())? history.first() : target;
+	target = (target > (long)history.last())?  history.last()  : target;
+
+	if (target == (long)history_at || !history.seek(target, rewind_snap)) {
+		return false;
+	}
+
+	field.load_state(rewind_snap);
+
+	// keys held back then aren't being held now
+	field.held = 0;
+	field.shift_ticks = 0;
+	field.soft_drop_ticks = 0;
+
+	history_at = target;
+	placement_pending = false;
+	return true;
+}
+
 void menu::handle_event(frontend *front, event ev){
 	// XXX: maps the standard key mappings to menu movements through events,
 	//      probably want to change this at some point
@@ -0,0 +1,146 @@
+#include <tetrode/game_stats.hpp>
+#include <tetrode/pc_solver.hpp>
+
+#include <limits.h>
+#include <string.h>
+
+namespace tetrode {
+
+void game_stats::reset(void){
+	*this = game_stats(tick_rate);
+}
+
+void game_stats::input(enum event ev){
+	switch (ev) {
+		case event::MoveLeft:
+		case event::MoveRight:
+		case event::RotateLeft:
+		case event::RotateRight:
+			inputs++;
+			cur_inputs++;
+			cur_keys++;
+			break;
+
+		case event::Drop:
+			inputs++;
+			cur_inputs++;
+			hard_drops++;
+			break;
+
+		// a new piece comes out, finesse starts again
+		case event::Hold:
+			inputs++;
+			cur_inputs++;
+			cur_keys = 0;
+			holds++;
+			break;
+
+		default: break;
+	}
+}
+
+void game_stats::lock(const tetrimino& piece, const coord_2d& at, unsigned width,
+                      unsigned lines, unsigned lock_ticks, unsigned lock_delay,
+                      bool straight_down)
+{
+	pieces++;
+	clears[(lines < max_lines)? lines : (unsigned)max_lines]++;
+	piece_inputs[(cur_inputs < input_buckets - 1)? cur_inputs : input_buckets - 1]++;
+
+	if (lock_delay > 0) {
+		unsigned used = lock_ticks * lock_buckets / lock_delay;
+		lock_delay_used[(used < lock_buckets)? used : (unsigned)lock_buckets]++;
+	}
+
+	if (straight_down) {
+		unsigned needed = optimal_keys(piece, at, width);
+
+		if (needed != ~0u) {
+			finesse_checked++;
+			finesse_faults += (cur_keys > needed);
+		}
+	}
+
+	cur_inputs = 0;
+	cur_keys = 0;
+}
+
+unsigned game_stats::optimal_keys(const tetrimino& piece, const coord_2d& at,
+                                  unsigned width)
+{
+	if (width > 16 || at.x + 2 < 0 || at.x + 2 >= finesse_xs) {
+		return ~0u;
+	}
+
+	if (width != optimal_width) {
+		memset(optimal, 0, sizeof(optimal));
+		optimal_width = width;
+	}
+
+	uint8_t& known = optimal[piece.shape][piece.rotations][at.x + 2];
+
+	if (known == 0) {
+		// the same shape sat on the floor of an empty board
+		int min_y = INT_MAX;
+		uint64_t target = 0;
+
+		for (auto& b : piece.blocks) {
+			min_y = (b.second.y < min_y)? b.second.y : min_y;
+		}
+
+		for (auto& b : piece.blocks) {
+			target |= 1ull << ((b.second.y - min_y) * width + b.second.x + at.x);
+		}
+
+		pc_solver::placement best;
+		unsigned needed = 0;
+
+		if (pc_solver::finesse(0, width, 4, piece.shape, target, best)) {
+			for (auto k : best.keys) {
+				needed += (k != pc_solver::KeyHardDrop && k != pc_solver::KeySoftDrop);
+			}
+
+			known = needed + 1;
+
+		} else {
+			known = 0xff;
+		}
+	}
+
+	return (known == 0xff)? ~0u : known - 1u;
+}
+
+void game_stats::write_json(FILE *out, const char *game) const {
+	fputc('{', out);
+
+	if (game) {
+		fprintf(out, "\"game\": \"%s\", ", game);
+	}
+
+	fprintf(out,
+	        "\"seconds\": %.2f, \"pieces\": %u, \"pps\": %.3f, \"inputs\": %u, "
+	        "\"inputs_per_piece\": %.3f, \"holds\": %u, \"hard_drops\": %u, "
+	        "\"finesse_checked\": %u, \"finesse_faults\": %u, "
+	        "\"clear_stall_seconds\": %.2f",
+	        seconds(), pieces, pieces_per_second(), inputs, inputs_per_piece(),
+	        holds, hard_drops, finesse_checked, finesse_faults,
+	        (double)clear_ticks / tick_rate);
+
+	auto list = [&](const char *name, const uint32_t *values, unsigned n){
+		fprintf(out, ", \"%s\": [", name);
+
+		for (unsigned i = 0; i < n; i++) {
+			fprintf(out, "%s%u", i? ", " : "", values[i]);
+		}
+
+		fputc(']', out);
+	};
+
+	list("clears", clears, max_lines + 1);
+	list("lock_delay_used", lock_delay_used, lock_buckets + 1);
+	list("piece_inputs", piece_inputs, input_buckets);
+	fputs("}\n", out);
+}
+
+// namespace tetrode
+}
@@ -0,0 +1,794 @@
+#include <tetrode/match_server.hpp>
+#include <tetrode/field_state.hpp>
+
+#include <unordered_map>
+#include <algorithm>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+namespace tetrode {
+
+static uint32_t xorshift32(uint32_t& state){
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static unsigned long now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+match_room::match_room(uint32_t seed)
+	: boards{ field_state(10, 40, seed), field_state(10, 40, seed) }
+{
+	rng = seed? seed : 0x9e3779b9;
+}
+
+void match_room::tick(void){
+	// counted first, so events logged below land after this tick
+	ticks++;
+
+	for (unsigned p = 0; p < 2; p++) {
+		field_state& board = boards[p];
+
+		board.updates = 0;
+		board.handle_event(event::Tick);
+
+		for (unsigned i = 0; i < num_inputs[p]; i++) {
+			board.handle_event(static_cast<event>(inputs[p][i]));
+			log_event(p, match_event::Input, inputs[p][i]);
+		}
+
+		num_inputs[p] = 0;
+	}
+
+	exchange_garbage();
+}
+
+void match_room::advance_to(uint32_t target){
+	while (ticks < target) {
+		// skip to the tick before the next event, then run that one
+		// normally so locks exchange garbage
+		uint32_t next = std::min(next_event(), target);
+
+		for (auto& board : boards) {
+			board.advance(next - ticks - 1);
+		}
+
+		ticks = next - 1;
+		tick();
+	}
+}
+
+void match_room::apply_input(unsigned player, event ev){
+	boards[player].updates = 0;
+	boards[!player].updates = 0;
+	boards[player].handle_event(ev);
+	log_event(player, match_event::Input, ev);
+	exchange_garbage();
+}
+
+uint32_t match_room::next_event(void){
+	uint64_t ret = (uint64_t)ticks
+	             + std::min(boards[0].next_event(), boards[1].next_event());
+
+	if (simulated) {
+		ret = std::min<uint64_t>(ret, next_input);
+	}
+
+	// never in the past, and clamped for boards with nothing scheduled
+	return std::max<uint64_t>(std::min<uint64_t>(ret, UINT32_MAX), ticks + 1);
+}
+
+void match_room::exchange_garbage(void){
+	// lines sent for 0-4 cleared lines
+	static const uint8_t garbage_for[] = { 0, 0, 1, 2, 4 };
+
+	for (unsigned p = 0; p < 2; p++) {
+		field_state& board = boards[p];
+
+		if (!(board.updates & changes::Locked)) {
+			continue;
+		}
+
+		unsigned cleared = board.lines_cleared - prev_lines[p];
+		prev_lines[p] = board.lines_cleared;
+
+		// pieces that don't clear anything let queued garbage in
+		if (cleared == 0) {
+			unsigned hole = xorshift32(rng) % board.size.x;
+
+			if (pending_garbage[p]) {
+				board.add_garbage(pending_garbage[p], hole);
+				log_event(p, match_event::Garbage, pending_garbage[p], hole);
+			}
+
+			pending_garbage[p] = 0;
+			continue;
+		}
+
+		unsigned send   = garbage_for[std::min(cleared, 4u)];
+		unsigned cancel = std::min<unsigned>(send, pending_garbage[p]);
+
+		pending_garbage[p] -= cancel;
+		send -= cancel;
+
+		unsigned other = pending_garbage[!p] + send;
+		pending_garbage[!p] = std::min(other, 255u);
+	}
+}
+
+void match_room::simulate_inputs(void){
+	static const event choices[] = {
+		event::MoveLeft, event::MoveRight, event::RotateLeft,
+		event::RotateRight, event::MoveDown, event::Drop,
+	};
+
+	if (!simulated || ticks < next_input) {
+		return;
+	}
+
+	// roughly what a fast human does, one input every ~8 ticks each
+	apply_input(xorshift32(rng) & 1, choices[xorshift32(rng) % 6]);
+	next_input = ticks + 1 + xorshift32(rng) % 8;
+}
+
+bool match_room::finished(void){
+	return boards[0].topped_out || boards[1].topped_out;
+}
+
+size_t match_room::memory_used(void){
+	// list nodes carry two pointers on top of the stored value
+	const size_t node_overhead = 2 * sizeof(void*);
+	size_t ret = sizeof(*this);
+
+	for (auto& board : boards) {
+		ret += board.field.capacity() * sizeof(std::vector<block>);
+
+		for (auto& row : board.field) {
+			ret += row.capacity() * sizeof(block);
+		}
+
+		ret += board.next_pieces.size() * (node_overhead + sizeof(tetrimino));
+	}
+
+	for (auto& log : events) {
+		ret += log.capacity() * sizeof(match_event);
+	}
+
+	return ret;
+}
+
+void match_room::save_state(snapshot& snap){
+	for (unsigned p = 0; p < 2; p++) {
+		boards[p].save_state(snap.boards[p]);
+		snap.pending_garbage[p] = pending_garbage[p];
+		snap.prev_lines[p] = prev_lines[p];
+	}
+
+	snap.ticks = ticks;
+	snap.rng = rng;
+}
+
+void match_room::load_state(const snapshot& snap){
+	for (unsigned p = 0; p < 2; p++) {
+		boards[p].load_state(snap.boards[p]);
+		pending_garbage[p] = snap.pending_garbage[p];
+		prev_lines[p] = snap.prev_lines[p];
+		num_inputs[p] = 0;
+	}
+
+	ticks = snap.ticks;
+	rng = snap.rng;
+}
+
+match_update match_room::update_for(unsigned player){
+	field_state& board = boards[player];
+	match_update ret;
+
+	ret.tick            = ticks;
+	ret.score           = board.score;
+	ret.lines_cleared   = board.lines_cleared;
+	ret.opponent_lines  = boards[!player].lines_cleared;
+	ret.level           = board.level;
+	ret.pending_garbage = pending_garbage[player];
+	ret.num_events      = std::min<size_t>(events[player].size(), 255);
+
+	if (!finished()) {
+		ret.flags = match_update::Playing;
+
+	} else {
+		ret.flags = board.topped_out? match_update::Lost : match_update::Won;
+	}
+
+	return ret;
+}
+
+void match_room::log_event(unsigned board, match_event::kinds kind,
+                           uint32_t value, uint8_t hole)
+{
+	for (unsigned p = 0; p < 2; p++) {
+		// nobody to send it to, eg. simulated and rollback rooms
+		if (fds[p] < 0) {
+			continue;
+		}
+
+		match_event ev = {};
+		ev.tick  = ticks;
+		ev.value = value;
+		ev.kind  = kind;
+		ev.board = board != p;
+		ev.hole  = hole;
+		events[p].push_back(ev);
+	}
+}
+
+class match_server::shard {
+	public:
+		shard(uint32_t seed);
+		~shard();
+
+		void add_listener(int fd);
+		void add_simulated(unsigned n);
+		void run(void);
+		void stop(void);
+
+		std::atomic<unsigned long> num_rooms{0};
+		std::atomic<unsigned long> num_connections{0};
+		std::atomic<unsigned long> room_ticks{0};
+		std::atomic<unsigned long> tick_ns{0};
+		std::atomic<unsigned long> room_bytes{0};
+		std::atomic<unsigned long> dropped_updates{0};
+
+	private:
+		struct handle {
+			enum kinds { Listener, Timer, Stop, Client } kind;
+			int fd;
+			match_room *room;
+			unsigned player;
+		};
+
+		void watch(handle *h);
+		void accept_from(handle *h);
+		void read_from(handle *h);
+		void send_update(match_room *room, unsigned player);
+		void drop_client(handle *h);
+		void close_room(match_room *room);
+		void finish(match_room *room);
+		void do_tick(uint64_t expired);
+
+		int epoll_fd;
+		handle timer;
+		handle stopper;
+
+		std::vector<handle*> listeners;
+		std::vector<match_room*> rooms;
+		std::unordered_map<int, handle*> clients;
+		std::vector<handle*> dropped;
+		handle *waiting = nullptr;
+
+		timer_wheel wheel;
+		uint64_t now = 0;
+		uint64_t next_memory_check = 0;
+
+		uint32_t rng;
+};
+
+match_server::shard::shard(uint32_t seed){
+	rng = seed;
+
+	if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		throw "epoll_create1()";
+	}
+
+	timer.kind = handle::Timer;
+	timer.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	stopper.kind = handle::Stop;
+	stopper.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (timer.fd < 0 || stopper.fd < 0) {
+		throw "timerfd_create()/eventfd()";
+	}
+
+	const long period = 1000000000l / field_state::rules::tick_rate;
+	struct itimerspec spec;
+	spec.it_interval.tv_sec  = spec.it_value.tv_sec  = 0;
+	spec.it_interval.tv_nsec = spec.it_value.tv_nsec = period;
+
+	if (timerfd_settime(timer.fd, 0, &spec, NULL) < 0) {
+		throw "timerfd_settime()";
+	}
+
+	watch(&timer);
+	watch(&stopper);
+}
+
+match_server::shard::~shard(){
+	while (!rooms.empty()) {
+		close_room(rooms.back());
+	}
+
+	if (waiting) {
+		drop_client(waiting);
+	}
+
+	for (handle *h : listeners) {
+		delete h;
+	}
+
+	for (handle *h : dropped) {
+		delete h;
+	}
+
+	close(timer.fd);
+	close(stopper.fd);
+	close(epoll_fd);
+}
+
+void match_server::shard::watch(handle *h){
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = h;
+
+	// only wake one shard per incoming connection
+	if (h->kind == handle::Listener) {
+		ev.events |= EPOLLEXCLUSIVE;
+	}
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, h->fd, &ev) < 0) {
+		throw "epoll_ctl()";
+	}
+}
+
+void match_server::shard::add_listener(int fd){
+	handle *h = new handle{handle::Listener, fd, nullptr, 0};
+	listeners.push_back(h);
+	watch(h);
+}
+
+void match_server::shard::add_simulated(unsigned n){
+	for (unsigned i = 0; i < n; i++) {
+		match_room *room = new match_room(xorshift32(rng));
+
+		room->simulated = true;
+		room->epoch = now;
+		room->timer.data = room;
+		wheel.schedule(&room->timer, now + room->next_event());
+		rooms.push_back(room);
+	}
+
+	num_rooms.store(rooms.size(), std::memory_order_relaxed);
+}
+
+void match_server::shard::stop(void){
+	uint64_t one = 1;
+
+	if (write(stopper.fd, &one, sizeof(one)) < 0) {
+		throw "write()";
+	}
+}
+
+void match_server::shard::accept_from(handle *listener){
+	int fd;
+
+	while ((fd = accept4(listener->fd, NULL, NULL,
+	                     SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		int one = 1;
+		// fails harmlessly on unix sockets
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		handle *h = new handle{handle::Client, fd, nullptr, 0};
+		clients[fd] = h;
+		watch(h);
+
+		if (!waiting) {
+			match_update update = {};
+			update.flags = match_update::Waiting;
+			send(fd, &update, sizeof(update), MSG_NOSIGNAL | MSG_DONTWAIT);
+
+			waiting = h;
+			continue;
+		}
+
+		uint32_t seed = xorshift32(rng);
+		match_room *room = new match_room(seed);
+		room->fds[0] = waiting->fd;
+		room->fds[1] = fd;
+
+		// both boards start from the same seed
+		room->log_event(0, match_event::Start, seed);
+		room->log_event(1, match_event::Start, seed);
+
+		room->epoch = now;
+		room->timer.data = room;
+
+		waiting->room = room;
+		h->room = room;
+		h->player = 1;
+		waiting = nullptr;
+
+		rooms.push_back(room);
+		finish(room);
+	}
+
+	num_rooms.store(rooms.size(), std::memory_order_relaxed);
+	num_connections.store(clients.size(), std::memory_order_relaxed);
+}
+
+void match_server::shard::read_from(handle *h){
+	match_room *room = h->room;
+	uint8_t buf[64];
+	ssize_t n;
+	bool changed = false;
+
+	while ((n = recv(h->fd, buf, sizeof(buf), 0)) > 0) {
+		// still waiting for an opponent, nothing to apply input to
+		if (!room) {
+			continue;
+		}
+
+		// inputs apply as soon as they arrive, on top of the room's state
+		// at the current tick
+		uint32_t before = room->ticks;
+		room->advance_to(now - room->epoch);
+		room_ticks.fetch_add(room->ticks - before, std::memory_order_relaxed);
+
+		for (ssize_t i = 0; i < n; i++) {
+			// only accept gameplay inputs from clients
+			if (buf[i] >= event::RotateLeft && buf[i] <= event::Hold) {
+				room->apply_input(h->player, static_cast<event>(buf[i]));
+				changed = true;
+			}
+		}
+	}
+
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+		if (room) {
+			// leaving forfeits the match
+			room->fds[h->player] = -1;
+			room->boards[h->player].topped_out = true;
+			changed = true;
+		}
+
+		drop_client(h);
+	}
+
+	// may close the room and with it `h`
+	if (changed) {
+		finish(room);
+	}
+}
+
+void match_server::shard::send_update(match_room *room, unsigned player){
+	int fd = room->fds[player];
+
+	if (fd < 0) {
+		return;
+	}
+
+	auto& events = room->events[player];
+
+	while (true) {
+		match_update update = room->update_for(player);
+		struct iovec iov[2] = {
+			{ &update, sizeof(update) },
+			{ events.data(), update.num_events * sizeof(match_event) },
+		};
+
+		struct msghdr msg = {};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = 2;
+
+		ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+		if (n == (ssize_t)(iov[0].iov_len + iov[1].iov_len)) {
+			events.erase(events.begin(), events.begin() + update.num_events);
+
+			if (events.empty()) {
+				return;
+			}
+
+			continue;
+		}
+
+		// every update supersedes the last, so a full socket just skips
+		// one and its events go out with the next. A short write would
+		// desync the stream, so those clients are dropped, as are ones
+		// that stop reading altogether.
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)
+		    && events.size() <= match_room::max_backlog)
+		{
+			dropped_updates.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		break;
+	}
+
+	room->fds[player] = -1;
+	room->boards[player].topped_out = true;
+	drop_client(clients[fd]);
+}
+
+void match_server::shard::drop_client(handle *h){
+	if (h == waiting) {
+		waiting = nullptr;
+	}
+
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, h->fd, NULL);
+	close(h->fd);
+	clients.erase(h->fd);
+
+	// there may still be events for it in the current epoll batch
+	h->fd = -1;
+	h->room = nullptr;
+	dropped.push_back(h);
+
+	num_connections.store(clients.size(), std::memory_order_relaxed);
+}
+
+void match_server::shard::close_room(match_room *room){
+	for (unsigned p = 0; p < 2; p++) {
+		if (room->fds[p] >= 0) {
+			drop_client(clients[room->fds[p]]);
+		}
+	}
+
+	wheel.cancel(&room->timer);
+	rooms.erase(std::find(rooms.begin(), rooms.end(), room));
+	delete room;
+}
+
+void match_server::shard::finish(match_room *room){
+	send_update(room, 0);
+	send_update(room, 1);
+
+	if (!room->finished()) {
+		wheel.schedule(&room->timer, room->epoch + room->next_event());
+		return;
+	}
+
+	// simulated rooms are restarted so the load stays constant
+	if (room->simulated) {
+		wheel.cancel(&room->timer);
+		*room = match_room(xorshift32(rng));
+
+		room->simulated = true;
+		room->epoch = now;
+		room->timer.data = room;
+		wheel.schedule(&room->timer, now + room->next_event());
+
+	} else {
+		close_room(room);
+	}
+}
+
+void match_server::shard::do_tick(uint64_t expired){
+	unsigned long start = now_ns();
+	unsigned long ticked = 0;
+	timer_wheel::entry *e;
+
+	now += expired;
+	wheel.advance(now);
+
+	while ((e = wheel.pop_ready())) {
+		match_room *room = static_cast<match_room*>(e->data);
+		uint32_t before = room->ticks;
+
+		room->advance_to(now - room->epoch);
+		room->simulate_inputs();
+		ticked += room->ticks - before;
+
+		finish(room);
+	}
+
+	// walking every room is the expensive part, only do it once a second
+	if (now >= next_memory_check) {
+		unsigned long bytes = 0;
+
+		for (match_room *room : rooms) {
+			bytes += room->memory_used();
+		}
+
+		room_bytes.store(bytes, std::memory_order_relaxed);
+		next_memory_check = now + field_state::rules::tick_rate;
+	}
+
+	room_ticks.fetch_add(ticked, std::memory_order_relaxed);
+	tick_ns.fetch_add(now_ns() - start, std::memory_order_relaxed);
+	num_rooms.store(rooms.size(), std::memory_order_relaxed);
+}
+
+void match_server::shard::run(void){
+	struct epoll_event events[64];
+
+	while (true) {
+		int n = epoll_wait(epoll_fd, events, 64, -1);
+
+		if (n < 0 && errno == EINTR) {
+			continue;
+
+		} else if (n < 0) {
+			throw "epoll_wait()";
+		}
+
+		for (int i = 0; i < n; i++) {
+			handle *h = static_cast<handle*>(events[i].data.ptr);
+			uint64_t expired;
+
+			if (h->fd < 0) {
+				continue;
+			}
+
+			switch (h->kind) {
+				case handle::Stop:
+					return;
+
+				case handle::Listener:
+					accept_from(h);
+					break;
+
+				case handle::Client:
+					read_from(h);
+					break;
+
+				case handle::Timer:
+					if (read(timer.fd, &expired, sizeof(expired)) != sizeof(expired)) {
+						break;
+					}
+
+					// missed ticks are just skipped over
+					do_tick(expired);
+					break;
+			}
+		}
+
+		for (handle *h : dropped) {
+			delete h;
+		}
+
+		dropped.clear();
+	}
+}
+
+match_server::match_server(unsigned threads){
+	for (unsigned i = 0; i < std::max(threads, 1u); i++) {
+		shards.push_back(new shard(0x1234567 + i * 0x9e3779b9));
+	}
+}
+
+match_server::~match_server(){
+	stop();
+
+	for (shard *s : shards) {
+		delete s;
+	}
+
+	for (int fd : listen_fds) {
+		close(fd);
+	}
+
+	if (!unix_path.empty()) {
+		unlink(unix_path.c_str());
+	}
+}
+
+void match_server::listen_unix(const std::string& path){
+	struct sockaddr_un addr = {};
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+	if (fd < 0 || path.size() >= sizeof(addr.sun_path)) {
+		throw "socket()";
+	}
+
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	unlink(path.c_str());
+
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0
+	    || listen(fd, SOMAXCONN) < 0)
+	{
+		close(fd);
+		throw "bind()/listen()";
+	}
+
+	unix_path = path;
+	listen_fds.push_back(fd);
+
+	for (shard *s : shards) {
+		s->add_listener(fd);
+	}
+}
+
+void match_server::listen_tcp(uint16_t port){
+	struct sockaddr_in addr = {};
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	int one = 1;
+
+	if (fd < 0) {
+		throw "socket()";
+	}
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0
+	    || listen(fd, SOMAXCONN) < 0)
+	{
+		close(fd);
+		throw "bind()/listen()";
+	}
+
+	listen_fds.push_back(fd);
+
+	for (shard *s : shards) {
+		s->add_listener(fd);
+	}
+}
+
+void match_server::simulate_rooms(unsigned rooms){
+	for (size_t i = 0; i < shards.size(); i++) {
+		// spread the remainder over the first few shards
+		unsigned n = rooms / shards.size() + (i < rooms % shards.size());
+		shards[i]->add_simulated(n);
+	}
+}
+
+void match_server::start(void){
+	for (shard *s : shards) {
+		threads.emplace_back(&shard::run, s);
+	}
+}
+
+void match_server::stop(void){
+	if (threads.empty()) {
+		return;
+	}
+
+	for (shard *s : shards) {
+		s->stop();
+	}
+
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	threads.clear();
+}
+
+match_server::stats match_server::get_stats(void){
+	stats ret = {};
+
+	for (shard *s : shards) {
+		ret.rooms           += s->num_rooms.load(std::memory_order_relaxed);
+		ret.connections     += s->num_connections.load(std::memory_order_relaxed);
+		ret.room_ticks      += s->room_ticks.load(std::memory_order_relaxed);
+		ret.tick_ns         += s->tick_ns.load(std::memory_order_relaxed);
+		ret.room_bytes      += s->room_bytes.load(std::memory_order_relaxed);
+		ret.dropped_updates += s->dropped_updates.load(std::memory_order_relaxed);
+	}
+
+	return ret;
+}
+
+// namespace tetrode
+}
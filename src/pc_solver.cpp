@@ -0,0 +1,814 @@
+#include <tetrode/pc_solver.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+namespace tetrode {
+
+namespace {
+
+const unsigned no_hold = 7;
+
+// block offsets for every shape and rotation, taken from tetrimino so
+// they can't drift from the engine
+class shape_table {
+	public:
+		shape_table(void){
+			for (unsigned s = tetrimino::shape::I; s <= tetrimino::shape::L; s++) {
+				tetrimino tet(static_cast<enum tetrimino::shape>(s));
+
+				for (unsigned r = 0; r < 4; r++) {
+					for (unsigned b = 0; b < 4; b++) {
+						dx[s][r][b] = tet.blocks[b].second.x;
+						dy[s][r][b] = tet.blocks[b].second.y;
+					}
+
+					tet.rotate(movement::Right);
+				}
+			}
+		}
+
+		int dx[7][4][4];
+		int dy[7][4][4];
+};
+
+const shape_table& shapes(void){
+	static const shape_table table;
+	return table;
+}
+
+uint64_t shift_down(uint64_t bits, unsigned n){
+	return (n < 64)? bits >> n : 0;
+}
+
+// one piece moving around one board, following the engine's rules for
+// moves and rotations. Positions are (rotation, x, y) of the piece
+// origin, starting `spawn_y` rows up, where nothing's in the way.
+class mover {
+	public:
+		mover(uint64_t cells, int w, int h, unsigned s, int engine_spawn = 0)
+			: board(cells), width(w), height(h), shape(s), table(shapes())
+		{
+			// only matters for turning soft drops back into events
+			sky = (engine_spawn > height + 2)? engine_spawn - (height + 2) : 0;
+			xs = width + 4;
+			ys = height + 6;
+			spawn_x = width / 2 - 1;
+			spawn_y = height + 2;
+		}
+
+		bool filled(int x, int y) const {
+			return y < height && ((board >> (y * width + x)) & 1);
+		}
+
+		bool fits(unsigned r, int x, int y) const {
+			for (unsigned b = 0; b < 4; b++) {
+				int bx = x + table.dx[shape][r][b];
+				int by = y + table.dy[shape][r][b];
+
+				if (bx < 0 || bx >= width || by < 0 || filled(bx, by)) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		// basic_field_state::collides_lower()
+		bool grounded(unsigned r, int x, int y) const {
+			for (unsigned b = 0; b < 4; b++) {
+				int bx = x + table.dx[shape][r][b];
+				int by = y + table.dy[shape][r][b];
+
+				if (by <= 0 || filled(bx, by - 1)) {
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		// the blocks once locked at (r, x, y), false if any are above
+		// the rows being cleared
+		bool locked_cells(unsigned r, int x, int y, uint64_t& cells) const {
+			cells = 0;
+
+			for (unsigned b = 0; b < 4; b++) {
+				int bx = x + table.dx[shape][r][b];
+				int by = y + table.dy[shape][r][b];
+
+				if (by >= height) {
+					return false;
+				}
+
+				cells |= 1ull << (by * width + bx);
+			}
+
+			return true;
+		}
+
+		// basic_field_state::rotate_active(), the first SRS kick that fits
+		bool rotate(unsigned& r, int& x, int& y, bool right) const {
+			if (shape == tetrimino::shape::O) {
+				return false;
+			}
+
+			enum movement dir = right? movement::Right : movement::Left;
+			unsigned nr = (r + (right? 1 : 3)) & 3;
+
+			for (unsigned i = 0; i < tetrimino::kick_tests; i++) {
+				coord_2d kick = tetrimino::kick(static_cast<enum tetrimino::shape>(shape),
+				                                r, dir, i);
+
+				if (fits(nr, x + kick.x, y + kick.y)) {
+					r = nr;
+					x += kick.x;
+					y += kick.y;
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		// false if the key doesn't move the piece
+		bool apply(pc_solver::key k, unsigned& r, int& x, int& y) const {
+			switch (k) {
+				case pc_solver::KeyLeft:
+				case pc_solver::KeyRight: {
+					int dir = (k == pc_solver::KeyLeft)? -1 : 1;
+
+					if (!fits(r, x + dir, y)) {
+						return false;
+					}
+
+					x += dir;
+					return true;
+				}
+
+				case pc_solver::KeyDasLeft:
+				case pc_solver::KeyDasRight: {
+					int dir = (k == pc_solver::KeyDasLeft)? -1 : 1;
+
+					if (!fits(r, x + dir, y)) {
+						return false;
+					}
+
+					while (fits(r, x + dir, y)) {
+						x += dir;
+					}
+
+					return true;
+				}
+
+				case pc_solver::KeyRotateLeft:
+				case pc_solver::KeyRotateRight:
+					return rotate(r, x, y, k == pc_solver::KeyRotateRight);
+
+				case pc_solver::KeySoftDrop:
+					if (grounded(r, x, y)) {
+						return false;
+					}
+
+					while (!grounded(r, x, y)) {
+						y--;
+					}
+
+					return true;
+
+				default:
+					return false;
+			}
+		}
+
+		unsigned index(unsigned r, int x, int y) const {
+			return (r * xs + x + 2) * ys + y;
+		}
+
+		void decode(unsigned i, unsigned& r, int& x, int& y) const {
+			y = i % ys;
+			x = (i / ys) % xs - 2;
+			r = i / ys / xs;
+		}
+
+		// every distinct spot the piece can lock in, for the search. Only
+		// reachability matters here, so any rotation and column can start
+		// right above the stack and only single steps are needed.
+		void landings(std::vector<uint64_t>& out) const {
+			std::vector<uint8_t> seen(4 * xs * ys);
+			std::vector<unsigned> open;
+			unsigned rots = (shape == tetrimino::shape::O)? 1 : 4;
+
+			// everything above the stack is open, so start just clear of it
+			int top = height;
+
+			while (top > 0 && !((board >> ((top - 1) * width)) & ((1ull << width) - 1))) {
+				top--;
+			}
+
+			for (unsigned r = 0; r < rots; r++) {
+				int low = 0;
+
+				for (unsigned b = 0; b < 4; b++) {
+					low = (table.dy[shape][r][b] < low)? table.dy[shape][r][b] : low;
+				}
+
+				for (int x = -2; x < width + 2; x++) {
+					if (fits(r, x, top - low)) {
+						seen[index(r, x, top - low)] = 1;
+						open.push_back(index(r, x, top - low));
+					}
+				}
+			}
+
+			while (!open.empty()) {
+				unsigned r;
+				int x, y;
+				decode(open.back(), r, x, y);
+				open.pop_back();
+
+				bool ground = grounded(r, x, y);
+				uint64_t cells;
+
+				if (ground && locked_cells(r, x, y, cells)) {
+					bool dup = false;
+
+					for (uint64_t c : out) {
+						dup |= (c == cells);
+					}
+
+					if (!dup) {
+						out.push_back(cells);
+					}
+				}
+
+				auto visit = [&](unsigned nr, int nx, int ny){
+					unsigned i = index(nr, nx, ny);
+
+					if (!seen[i]) {
+						seen[i] = 1;
+						open.push_back(i);
+					}
+				};
+
+				if (fits(r, x - 1, y)) visit(r, x - 1, y);
+				if (fits(r, x + 1, y)) visit(r, x + 1, y);
+				if (!ground)           visit(r, x, y - 1);
+
+				for (unsigned right = 0; right < 2; right++) {
+					unsigned nr = r;
+					int nx = x, ny = y;
+
+					if (rotate(nr, nx, ny, right)) {
+						visit(nr, nx, ny);
+					}
+				}
+			}
+		}
+
+		// breadth first over keypresses from spawn, so the first position
+		// found that hard drops onto `target` has the fewest keys
+		bool path(uint64_t target, pc_solver::placement& out) const {
+			std::vector<int> prev(4 * xs * ys, -1);
+			std::vector<uint8_t> via(4 * xs * ys);
+			std::vector<unsigned> open;
+
+			unsigned start = index(0, spawn_x, spawn_y);
+			prev[start] = start;
+			open.push_back(start);
+
+			for (size_t head = 0; head < open.size(); head++) {
+				unsigned s = open[head];
+				unsigned r;
+				int x, y;
+				decode(s, r, x, y);
+
+				int land = y;
+				uint64_t cells;
+
+				while (!grounded(r, x, land)) {
+					land--;
+				}
+
+				if (locked_cells(r, x, land, cells) && cells == target) {
+					return reconstruct(s, prev, via, out);
+				}
+
+				for (unsigned k = pc_solver::KeyLeft; k < pc_solver::KeyHardDrop; k++) {
+					unsigned nr = r;
+					int nx = x, ny = y;
+
+					if (!apply(static_cast<pc_solver::key>(k), nr, nx, ny)) {
+						continue;
+					}
+
+					unsigned i = index(nr, nx, ny);
+
+					if (prev[i] < 0) {
+						prev[i] = s;
+						via[i] = k;
+						open.push_back(i);
+					}
+				}
+			}
+
+			return false;
+		}
+
+	private:
+		bool reconstruct(unsigned end, const std::vector<int>& prev,
+		                 const std::vector<uint8_t>& via, pc_solver::placement& out) const
+		{
+			std::vector<pc_solver::key> keys;
+
+			for (unsigned s = end; s != (unsigned)prev[s]; s = prev[s]) {
+				keys.insert(keys.begin(), static_cast<pc_solver::key>(via[s]));
+			}
+
+			// play the keys again for the events, DAS and soft drop are
+			// one event per cell moved. The engine spawns pieces higher up
+			// than here, the first soft drop has those rows to fall too.
+			unsigned r = 0;
+			int x = spawn_x, y = spawn_y;
+			int extra = sky;
+
+			out.keys = keys;
+			out.events.clear();
+
+			for (auto k : keys) {
+				int px = x, py = y;
+				apply(k, r, x, y);
+
+				switch (k) {
+					case pc_solver::KeyRotateLeft:  out.events.push_back(event::RotateLeft);  break;
+					case pc_solver::KeyRotateRight: out.events.push_back(event::RotateRight); break;
+					case pc_solver::KeySoftDrop:
+						out.events.insert(out.events.end(), py - y + extra, event::MoveDown);
+						extra = 0;
+						break;
+
+					default:
+						out.events.insert(out.events.end(), (x > px)? x - px : px - x,
+						                  (x > px)? event::MoveRight : event::MoveLeft);
+						break;
+				}
+			}
+
+			while (!grounded(r, x, y)) {
+				y--;
+			}
+
+			out.keys.push_back(pc_solver::KeyHardDrop);
+			out.events.push_back(event::Drop);
+			out.rotations = r;
+			out.x = x;
+			out.y = y;
+			return true;
+		}
+
+		uint64_t board;
+		int width, height;
+		unsigned shape;
+		const shape_table& table;
+
+		int xs, ys;
+		int spawn_x, spawn_y;
+		int sky;
+};
+
+class node {
+	public:
+		uint64_t board;
+		unsigned height;
+		// index into the queue of the piece in play
+		unsigned next;
+		unsigned hold;
+};
+
+class step {
+	public:
+		unsigned shape;
+		bool hold;
+		// the board it was placed on
+		uint64_t board;
+		unsigned height;
+		uint64_t cells;
+};
+
+class state_key {
+	public:
+		uint64_t board;
+		uint32_t rest;
+
+		bool operator == (const state_key& other) const {
+			return board == other.board && rest == other.rest;
+		}
+};
+
+class state_hash {
+	public:
+		size_t operator () (const state_key& k) const {
+			uint64_t h = (k.board ^ ((uint64_t)k.rest << 53)) * 0x9e3779b97f4a7c15ull;
+			return h ^ (h >> 29);
+		}
+};
+
+// boards already searched, shared by every thread
+class memo {
+	public:
+		// false if it was already there
+		bool insert(const node& n){
+			state_key key = { n.board, n.height | n.next << 8 | n.hold << 16 };
+			size_t h = state_hash()(key);
+			shard& s = shards[(h >> 32) % num_shards];
+
+			std::lock_guard<std::mutex> lock(s.lock);
+			return s.set.insert(key).second;
+		}
+
+	private:
+		enum { num_shards = 64 };
+
+		class shard {
+			public:
+				std::mutex lock;
+				std::unordered_set<state_key, state_hash> set;
+		};
+
+		shard shards[num_shards];
+};
+
+class search {
+	public:
+		search(unsigned w, unsigned lines, const std::vector<uint8_t>& q, bool hold)
+			: width(w), queue(q), allow_hold(hold)
+		{
+			full_row = (1ull << width) - 1;
+
+			// per column masks for every board height
+			for (unsigned h = 0; h <= lines; h++) {
+				col_mask[h].assign(width + 1, 0);
+
+				for (unsigned y = 0; y < h; y++) {
+					for (unsigned x = 0; x < width; x++) {
+						col_mask[h][x] |= 1ull << (y * width + x);
+					}
+				}
+
+				even_mask[h] = 0;
+				left_mask[h].assign(width + 1, 0);
+
+				for (unsigned x = 0; x < width; x++) {
+					even_mask[h] |= (x % 2 == 0)? col_mask[h][x] : 0;
+					left_mask[h][x + 1] = left_mask[h][x] | col_mask[h][x];
+				}
+			}
+		}
+
+		bool prune(const node& n) const {
+			uint64_t region = left_mask[n.height][width];
+			uint64_t empty = ~n.board & region;
+			unsigned cells = __builtin_popcountll(empty);
+			unsigned needed = cells / 4;
+			unsigned avail = queue.size() - n.next + (n.hold != no_hold);
+
+			if (cells % 4 != 0 || needed > avail) {
+				return true;
+			}
+
+			// what the pieces left can do about the column parity, in
+			// steps of two cells
+			unsigned counts[7] = {};
+
+			for (unsigned i = n.next; i < queue.size(); i++) {
+				counts[queue[i]]++;
+			}
+
+			if (n.hold != no_hold) {
+				counts[n.hold]++;
+			}
+
+			int even = __builtin_popcountll(empty & even_mask[n.height]);
+			int diff = even - (int)(cells - even);
+			unsigned uneven = ((diff < 0)? -diff : diff) / 2;
+			unsigned jl = counts[tetrimino::shape::J] + counts[tetrimino::shape::L];
+			unsigned t = counts[tetrimino::shape::T];
+
+			if (uneven > 2 * counts[tetrimino::shape::I] + t + jl) {
+				return true;
+			}
+
+			// every piece gets used, so an odd number of J and L with no T
+			// to even it out leaves the difference odd
+			if (needed == avail && t == 0 && (uneven - jl) % 2 != 0) {
+				return true;
+			}
+
+			// a boundary with no row open on both sides can't be crossed,
+			// and line clears only ever close rows or take them away. So
+			// each stretch of columns between them gets filled on its own,
+			// and one column wide stretches only by upright I pieces.
+			const std::vector<uint64_t>& left = left_mask[n.height];
+			uint64_t open = empty & (empty >> 1);
+			unsigned from = 0, wells = 0;
+
+			for (unsigned x = 0; x < width; x++) {
+				if (x + 1 < width && (open & col_mask[n.height][x])) {
+					continue;
+				}
+
+				unsigned part = __builtin_popcountll(empty & left[x + 1] & ~left[from]);
+
+				if (part % 4 != 0) {
+					return true;
+				}
+
+				wells += (x == from)? part / 4 : 0;
+				from = x + 1;
+			}
+
+			if (wells > counts[tetrimino::shape::I]) {
+				return true;
+			}
+
+			return false;
+		}
+
+		// lock `cells` and take out the full rows
+		node place(const node& n, uint64_t cells, unsigned next, unsigned hold) const {
+			node ret = { n.board | cells, n.height, next, hold };
+
+			for (unsigned y = 0; y < ret.height;) {
+				if (((ret.board >> (y * width)) & full_row) != full_row) {
+					y++;
+					continue;
+				}
+
+				uint64_t below = ret.board & ((1ull << (y * width)) - 1);
+				uint64_t above = shift_down(ret.board, (y + 1) * width);
+				ret.board = below | (above << (y * width));
+				ret.height--;
+			}
+
+			return ret;
+		}
+
+		void expand(const node& n, std::vector<std::pair<node, step>>& out) const {
+			std::vector<uint64_t> spots;
+
+			auto add = [&](unsigned shape, bool held, unsigned next, unsigned hold){
+				mover m(n.board, width, n.height, shape);
+				spots.clear();
+				m.landings(spots);
+
+				for (uint64_t cells : spots) {
+					step s = { shape, held, n.board, n.height, cells };
+					out.push_back({ place(n, cells, next, hold), s });
+				}
+			};
+
+			bool have_next = n.next < queue.size();
+
+			if (have_next) {
+				add(queue[n.next], false, n.next + 1, n.hold);
+			}
+
+			if (!allow_hold) {
+				return;
+			}
+
+			if (n.hold != no_hold) {
+				// swapping in the same shape changes nothing, and once the
+				// preview runs out the piece held is one we can't see
+				if (!have_next) {
+					add(n.hold, true, n.next, no_hold);
+
+				} else if (n.hold != queue[n.next]) {
+					add(n.hold, true, n.next + 1, queue[n.next]);
+				}
+
+			} else if (n.next + 1 < queue.size() && queue[n.next] != queue[n.next + 1]) {
+				add(queue[n.next + 1], true, n.next + 2, queue[n.next]);
+			}
+		}
+
+		bool dfs(const node& n, std::vector<step>& path, unsigned long& count){
+			if (n.height == 0) {
+				return true;
+			}
+
+			if (found.load(std::memory_order_relaxed) || prune(n) || !seen.insert(n)) {
+				return false;
+			}
+
+			count++;
+
+			std::vector<std::pair<node, step>> children;
+			expand(n, children);
+
+			// low placements first, they're the ones that keep the rest
+			// of the board open
+			std::sort(children.begin(), children.end(),
+			          [](const std::pair<node, step>& a, const std::pair<node, step>& b){
+				return 63 - __builtin_clzll(a.second.cells) < 63 - __builtin_clzll(b.second.cells);
+			});
+
+			for (auto& c : children) {
+				path.push_back(c.second);
+
+				if (dfs(c.first, path, count)) {
+					return true;
+				}
+
+				path.pop_back();
+			}
+
+			return false;
+		}
+
+		// hands the first placements out to `threads` workers
+		bool run(const node& root, unsigned threads, std::vector<step>& solution,
+		         unsigned long& nodes)
+		{
+			std::vector<std::pair<node, step>> tasks;
+
+			if (prune(root)) {
+				return false;
+			}
+
+			seen.insert(root);
+			expand(root, tasks);
+			nodes = 1;
+
+			std::atomic<size_t> next_task{0};
+			std::vector<std::thread> workers;
+			std::mutex done;
+
+			auto work = [&]{
+				std::vector<step> path;
+				unsigned long count = 0;
+				size_t i;
+
+				while ((i = next_task.fetch_add(1)) < tasks.size()) {
+					path.assign(1, tasks[i].second);
+
+					if (dfs(tasks[i].first, path, count) && !found.exchange(true)) {
+						solution = path;
+						break;
+					}
+				}
+
+				std::lock_guard<std::mutex> lock(done);
+				nodes += count;
+			};
+
+			for (unsigned t = 1; t < threads; t++) {
+				workers.emplace_back(work);
+			}
+
+			work();
+
+			for (auto& w : workers) {
+				w.join();
+			}
+
+			return found;
+		}
+
+	private:
+		unsigned width;
+		uint64_t full_row;
+		const std::vector<uint8_t>& queue;
+		bool allow_hold;
+
+		std::vector<uint64_t> col_mask[65];
+		std::vector<uint64_t> left_mask[65];
+		uint64_t even_mask[65];
+
+		std::atomic<bool> found{false};
+		memo seen;
+};
+
+// anonymous namespace
+}
+
+pc_solver::pc_solver(unsigned num_threads){
+	threads = num_threads? num_threads : std::thread::hardware_concurrency();
+	threads = threads? threads : 1;
+}
+
+pc_solver::result pc_solver::solve(const std::vector<uint16_t>& rows, unsigned width,
+                                   const std::vector<uint8_t>& queue, int hold_shape,
+                                   bool allow_hold, unsigned max_lines)
+{
+	if (width == 0 || width > 16) {
+		throw "pc_solver: boards have to be 1 to 16 wide";
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	result ret;
+
+	max_lines = (max_lines * width > 64)? 64 / width : max_lines;
+
+	// the stack has to fit under the clear
+	unsigned top = 0, filled = 0;
+	uint64_t board = 0;
+
+	for (unsigned y = 0; y < rows.size(); y++) {
+		uint16_t row = rows[y] & ((1 << width) - 1);
+
+		if (row == 0) {
+			continue;
+		}
+
+		if (y >= max_lines) {
+			return ret;
+		}
+
+		top = y + 1;
+		filled += __builtin_popcount(row);
+		board |= (uint64_t)row << (y * width);
+	}
+
+	unsigned hold = (hold_shape >= 0 && hold_shape < 7)? hold_shape : no_hold;
+	std::vector<step> solution;
+
+	for (unsigned h = (top? top : 1); h <= max_lines && !ret.found; h++) {
+		if ((h * width - filled) % 4 != 0) {
+			continue;
+		}
+
+		search s(width, max_lines, queue, allow_hold);
+		unsigned long nodes = 0;
+		node root = { board, h, 0, hold };
+
+		ret.found = s.run(root, threads, solution, nodes);
+		ret.lines = ret.found? h : 0;
+		ret.nodes += nodes;
+	}
+
+	if (ret.found) {
+		for (auto& st : solution) {
+			placement p;
+			p.shape = static_cast<enum tetrimino::shape>(st.shape);
+			p.hold = st.hold;
+			p.cells = st.cells;
+
+			finesse(st.board, width, st.height, p.shape, st.cells, p, spawn_height);
+
+			if (p.hold) {
+				p.events.insert(p.events.begin(), event::Hold);
+			}
+
+			ret.placements.push_back(p);
+		}
+	}
+
+	ret.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return ret;
+}
+
+template <class field_t>
+pc_solver::result pc_solver::solve(field_t& field, unsigned max_lines){
+	std::vector<uint16_t> rows(field.size.y, 0);
+	std::vector<uint8_t> queue;
+
+	for (int y = 0; y < field.size.y; y++) {
+		for (int x = 0; x < field.size.x && x < 16; x++) {
+			rows[y] |= (field.field[y][x].state != block::states::Empty) << x;
+		}
+	}
+
+	queue.push_back(field.active.first.shape);
+
+	for (auto& piece : field.next_pieces) {
+		queue.push_back(piece.shape);
+	}
+
+	spawn_height = field.size.y / 2 + 1;
+
+	return solve(rows, field.size.x, queue, field.have_held? field.hold.shape : -1,
+	             field_t::rules::allow_hold, max_lines);
+}
+
+bool pc_solver::finesse(uint64_t board, unsigned width, unsigned height,
+                        enum tetrimino::shape shape, uint64_t target,
+                        placement& out, unsigned spawn_height)
+{
+	mover m(board, width, height, shape, spawn_height);
+	out.shape = shape;
+	out.cells = target;
+	return m.path(target, out);
+}
+
+template pc_solver::result pc_solver::solve(field_state&, unsigned);
+template pc_solver::result pc_solver::solve(classic_field_state&, unsigned);
+template pc_solver::result pc_solver::solve(twenty_g_field_state&, unsigned);
+template pc_solver::result pc_solver::solve(fine_field_state&, unsigned);
+
+// namespace tetrode
+}
@@ -0,0 +1,444 @@
+#include <tetrode/placement_tables.hpp>
+
+#include <atomic>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <limits.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace tetrode {
+
+static const size_t header_len = 56;
+static const size_t land_len = 7 * 4 * placement_tables::skyline_keys;
+static const size_t book_offset = (header_len + land_len + 7) & ~(size_t)7;
+static const size_t entry_len = 16;
+
+static uint32_t get_u32(const uint8_t *p){
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_u64(const uint8_t *p){
+	return get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+static void put_u32(std::vector<uint8_t>& out, uint32_t n){
+	for (unsigned i = 0; i < 4; i++) {
+		out.push_back(n >> (8 * i));
+	}
+}
+
+static void put_u64(std::vector<uint8_t>& out, uint64_t n){
+	put_u32(out, n);
+	put_u32(out, n >> 32);
+}
+
+static uint64_t double_bits(double d){
+	uint64_t n;
+	memcpy(&n, &d, sizeof(n));
+	return n;
+}
+
+static double bits_double(uint64_t n){
+	double d;
+	memcpy(&d, &n, sizeof(d));
+	return d;
+}
+
+// every rotation of every piece, as rotate() leaves them
+static tetrimino piece_at(unsigned shape, unsigned rotations){
+	tetrimino tet((enum tetrimino::shape)shape);
+
+	for (unsigned r = 0; r < rotations; r++) {
+		tet.rotate(movement::Right);
+	}
+
+	return tet;
+}
+
+// FNV-1a over every block of every rotation, tables built for other
+// pieces are no use
+static uint32_t shapes_fingerprint(void){
+	uint32_t hash = 2166136261u;
+
+	for (unsigned s = 0; s < 7; s++) {
+		for (unsigned r = 0; r < 4; r++) {
+			for (auto& b : piece_at(s, r).blocks) {
+				hash = (hash ^ (uint8_t)b.second.x) * 16777619u;
+				hash = (hash ^ (uint8_t)b.second.y) * 16777619u;
+			}
+		}
+	}
+
+	return hash;
+}
+
+placement_tables::placement_tables(){
+	for (unsigned s = 0; s < 7; s++) {
+		for (unsigned r = 0; r < 4; r++) {
+			int min_x = INT_MAX, max_x = INT_MIN;
+
+			for (auto& b : piece_at(s, r).blocks) {
+				min_x = (b.second.x < min_x)? b.second.x : min_x;
+				max_x = (b.second.x > max_x)? b.second.x : max_x;
+			}
+
+			spans[s][r] = max_x - min_x + 1;
+		}
+	}
+}
+
+placement_tables::~placement_tables(){
+	if (map) {
+		munmap(map, map_len);
+	}
+}
+
+bool placement_tables::open(const std::string& path){
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat st;
+
+	if (fd < 0) {
+		return false;
+	}
+
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < book_offset) {
+		close(fd);
+		return false;
+	}
+
+	void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	close(fd);
+
+	if (ptr == MAP_FAILED) {
+		return false;
+	}
+
+	const uint8_t *p = static_cast<uint8_t*>(ptr);
+	uint32_t slots = get_u32(p + 20);
+
+	// slots have to be a power of two for the lookups
+	bool ok = memcmp(p, "TTBL", 4) == 0
+	       && get_u32(p + 4) == version
+	       && get_u32(p + 8) == shapes_fingerprint()
+	       && (slots & (slots - 1)) == 0
+	       && ((size_t)st.st_size - book_offset) / entry_len == slots;
+
+	if (!ok) {
+		munmap(ptr, st.st_size);
+		return false;
+	}
+
+	map = static_cast<uint8_t*>(ptr);
+	map_len = st.st_size;
+
+	book_width  = get_u32(p + 12);
+	book_height = get_u32(p + 16);
+	book_slots  = slots;
+
+	weights.height    = bits_double(get_u64(p + 24));
+	weights.lines     = bits_double(get_u64(p + 32));
+	weights.holes     = bits_double(get_u64(p + 40));
+	weights.bumpiness = bits_double(get_u64(p + 48));
+
+	land = reinterpret_cast<const int8_t*>(map + header_len);
+	book = map + book_offset;
+	book_entries = 0;
+
+	for (uint32_t i = 0; i < book_slots; i++) {
+		book_entries += get_u64(book + i * entry_len) != 0;
+	}
+
+	return true;
+}
+
+uint64_t placement_tables::board_key(const uint16_t *rows, unsigned width,
+                                     unsigned height, enum tetrimino::shape shape)
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	auto mix = [&](unsigned n){
+		hash = (hash ^ (n & 0xff)) * 1099511628211ull;
+		hash = (hash ^ (n >> 8)) * 1099511628211ull;
+	};
+
+	unsigned top = height;
+
+	while (top > 0 && rows[top - 1] == 0) {
+		top--;
+	}
+
+	mix(width);
+	mix(shape);
+
+	for (unsigned y = 0; y < top; y++) {
+		mix(rows[y]);
+	}
+
+	// 0 marks an empty slot
+	return hash? hash : 1;
+}
+
+bool placement_tables::book_matches(const bot_weights& w) const {
+	return book_slots
+	    && w.height == weights.height && w.lines == weights.lines
+	    && w.holes == weights.holes && w.bumpiness == weights.bumpiness;
+}
+
+bool placement_tables::book_move(const uint16_t *rows, unsigned width, unsigned height,
+                                 enum tetrimino::shape shape, unsigned& rotations,
+                                 int& left) const
+{
+	if (!book_slots || width != book_width || height != book_height) {
+		return false;
+	}
+
+	uint64_t key = board_key(rows, width, height, shape);
+	uint32_t i = key & (book_slots - 1);
+
+	// a full table has no empty slot to stop at, so give up after
+	// probing all of them
+	for (uint32_t n = 0; n < book_slots; n++, i = (i + 1) & (book_slots - 1)) {
+		const uint8_t *e = book + i * entry_len;
+		uint64_t k = get_u64(e);
+
+		if (k == 0) {
+			return false;
+		}
+
+		if (k == key) {
+			rotations = e[8];
+			left = (int8_t)e[9];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// drop a piece on a bitboard and clear lines, the same as the bot does
+static void drop_piece(uint16_t *rows, unsigned width, unsigned height, int spawn_y,
+                       enum tetrimino::shape shape, unsigned rotations, int left)
+{
+	tetrimino tet = piece_at(shape, rotations);
+	int min_x = INT_MAX;
+
+	for (auto& b : tet.blocks) {
+		min_x = (b.second.x < min_x)? b.second.x : min_x;
+	}
+
+	int x = left - min_x;
+	int y = spawn_y;
+
+	auto fits = [&](int y){
+		for (auto& b : tet.blocks) {
+			int by = b.second.y + y;
+
+			if (by < 0 || by >= (int)height || (rows[by] >> (b.second.x + x)) & 1) {
+				return false;
+			}
+		}
+
+		return true;
+	};
+
+	while (fits(y - 1)) {
+		y--;
+	}
+
+	for (auto& b : tet.blocks) {
+		rows[b.second.y + y] |= 1 << (b.second.x + x);
+	}
+
+	const uint16_t full = (1 << width) - 1;
+	unsigned cleared = 0;
+
+	for (unsigned src = 0; src < height; src++) {
+		if (rows[src] == full) {
+			cleared++;
+
+		} else {
+			rows[src - cleared] = rows[src];
+		}
+	}
+
+	for (unsigned k = height - cleared; k < height; k++) {
+		rows[k] = 0;
+	}
+}
+
+bool placement_tables::build(const std::string& path, unsigned book_pieces,
+                             unsigned threads, const bot_weights& w,
+                             unsigned width, unsigned height)
+{
+	if (width > 16 || height > 64) {
+		return false;
+	}
+
+	std::vector<uint8_t> out;
+
+	out.insert(out.end(), { 'T', 'T', 'B', 'L' });
+	put_u32(out, version);
+	put_u32(out, shapes_fingerprint());
+	put_u32(out, width);
+	put_u32(out, height);
+	size_t slots_at = out.size();
+	put_u32(out, 0);
+	put_u64(out, double_bits(w.height));
+	put_u64(out, double_bits(w.lines));
+	put_u64(out, double_bits(w.holes));
+	put_u64(out, double_bits(w.bumpiness));
+
+	// origin row for every skyline, where the lowest block in each
+	// column has to sit on top of it
+	for (unsigned s = 0; s < 7; s++) {
+		for (unsigned r = 0; r < 4; r++) {
+			tetrimino tet = piece_at(s, r);
+			int min_x = INT_MAX, low[4] = { INT_MAX, INT_MAX, INT_MAX, INT_MAX };
+
+			for (auto& b : tet.blocks) {
+				min_x = (b.second.x < min_x)? b.second.x : min_x;
+			}
+
+			for (auto& b : tet.blocks) {
+				int& l = low[b.second.x - min_x];
+				l = (b.second.y < l)? b.second.y : l;
+			}
+
+			for (unsigned key = 0; key < skyline_keys; key++) {
+				int rest = INT_MIN;
+
+				for (unsigned c = 0, k = key; c < 4; c++, k /= 5) {
+					if (low[c] != INT_MAX) {
+						int y = -(int)(k % 5) - low[c];
+						rest = (y > rest)? y : rest;
+					}
+				}
+
+				out.push_back((uint8_t)(int8_t)rest);
+			}
+		}
+	}
+
+	out.resize(book_offset, 0);
+
+	// the book, a breadth first walk over the boards it leads to
+	class entry {
+		public:
+			uint64_t key;
+			unsigned rotations;
+			int left;
+	};
+
+	const int spawn_y = height / 2 + 1;
+	heuristic_bot bot(w);
+	std::vector<entry> entries;
+	std::vector<std::vector<uint16_t>> level(1, std::vector<uint16_t>(height, 0));
+	std::unordered_set<uint64_t> seen;
+
+	seen.insert(board_key(level[0].data(), width, height, tetrimino::I));
+
+	threads = threads? threads : 1;
+
+	for (unsigned depth = 0; depth < book_pieces && !level.empty(); depth++) {
+		std::vector<entry> found(level.size() * 7);
+		std::atomic<size_t> next{0};
+		std::vector<std::thread> workers;
+
+		for (unsigned t = 0; t < threads; t++) {
+			workers.emplace_back([&]{
+				size_t i;
+
+				while ((i = next.fetch_add(1, std::memory_order_relaxed)) < found.size()) {
+					auto shape = (enum tetrimino::shape)(i % 7);
+					auto& rows = level[i / 7];
+					entry& e = found[i];
+
+					e.key = 0;
+					e.rotations = 0;
+					e.left = INT_MIN;
+
+					bot.best_placement(rows.data(), width, height, spawn_y, shape, 1,
+					                   e.rotations, e.left);
+
+					if (e.left != INT_MIN) {
+						e.key = board_key(rows.data(), width, height, shape);
+					}
+				}
+			});
+		}
+
+		for (auto& t : workers) {
+			t.join();
+		}
+
+		std::vector<std::vector<uint16_t>> children;
+
+		for (size_t i = 0; i < found.size(); i++) {
+			if (found[i].key == 0) {
+				continue;
+			}
+
+			entries.push_back(found[i]);
+
+			std::vector<uint16_t> child = level[i / 7];
+			drop_piece(child.data(), width, height, spawn_y,
+			           (enum tetrimino::shape)(i % 7), found[i].rotations, found[i].left);
+
+			// any shape will do, it's only telling boards apart
+			if (seen.insert(board_key(child.data(), width, height, tetrimino::I)).second) {
+				children.push_back(std::move(child));
+			}
+		}
+
+		level.swap(children);
+	}
+
+	// at most half full, so probes stay short
+	uint32_t slots = 1;
+
+	while (slots < 2 * entries.size()) {
+		slots *= 2;
+	}
+
+	slots = entries.empty()? 0 : slots;
+	out[slots_at]     = slots;
+	out[slots_at + 1] = slots >> 8;
+	out[slots_at + 2] = slots >> 16;
+	out[slots_at + 3] = slots >> 24;
+	out.resize(book_offset + (size_t)slots * entry_len, 0);
+
+	for (auto& e : entries) {
+		uint32_t i = e.key & (slots - 1);
+
+		while (get_u64(&out[book_offset + i * entry_len]) != 0) {
+			i = (i + 1) & (slots - 1);
+		}
+
+		uint8_t *p = &out[book_offset + i * entry_len];
+
+		for (unsigned b = 0; b < 8; b++) {
+			p[b] = e.key >> (8 * b);
+		}
+
+		p[8] = e.rotations;
+		p[9] = (uint8_t)(int8_t)e.left;
+	}
+
+	FILE *fp = fopen(path.c_str(), "wb");
+
+	if (!fp) {
+		return false;
+	}
+
+	bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+	return (fclose(fp) == 0) && ok;
+}
+
+// namespace tetrode
+}
@@ -0,0 +1,175 @@
+#include <tetrode/replay.hpp>
+#include <tetrode/wire.hpp>
+#include <tetrode/asset_pack.hpp>
+
+#include <string.h>
+#include <stdio.h>
+
+namespace tetrode {
+
+static uint32_t get_u32(const uint8_t *p){
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_u32(std::vector<uint8_t>& out, uint32_t n){
+	for (unsigned i = 0; i < 4; i++) {
+		out.push_back(n >> (8 * i));
+	}
+}
+
+template <class field_t>
+void replay::begin(field_t& field, const std::string& name){
+	rules = name;
+	field.save_state(start);
+
+	repeat    = field.handling.enabled;
+	das       = field.handling.das;
+	arr       = field.handling.arr;
+	soft_drop = field.handling.soft_drop;
+
+	length = 0;
+	inputs.clear();
+}
+
+template <class field_t>
+void replay::restore(field_t& field) const {
+	field.load_state(start);
+
+	field.handling.enabled   = repeat;
+	field.handling.das       = das;
+	field.handling.arr       = arr;
+	field.handling.soft_drop = soft_drop;
+}
+
+bool replay::save(const std::string& path) const {
+	std::vector<uint8_t> out, frame;
+
+	out.insert(out.end(), { 'T', 'R', 'P', 'L', version });
+	out.push_back(rules.size());
+	out.insert(out.end(), rules.begin(), rules.begin() + (rules.size() & 0xff));
+
+	out.push_back(repeat);
+	put_u32(out, das);
+	put_u32(out, arr);
+	put_u32(out, soft_drop);
+	put_u32(out, length);
+	put_u32(out, length >> 32);
+
+	wire::encode(start, frame);
+	put_u32(out, frame.size());
+	out.insert(out.end(), frame.begin(), frame.end());
+
+	put_u32(out, inputs.size());
+	uint64_t last = 0;
+
+	for (auto& in : inputs) {
+		uint64_t gap = in.tick - last;
+
+		while (gap >= 0x80) {
+			out.push_back(gap | 0x80);
+			gap >>= 7;
+		}
+
+		out.push_back(gap);
+		out.push_back(in.ev);
+		last = in.tick;
+	}
+
+	FILE *fp = fopen(path.c_str(), "wb");
+
+	if (!fp) {
+		return false;
+	}
+
+	bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+	return (fclose(fp) == 0) && ok;
+}
+
+bool replay::load(const std::string& path){
+	std::vector<uint8_t> data;
+
+	if (!asset_pack::read_file(path, data)) {
+		return false;
+	}
+
+	const uint8_t *p = data.data();
+	const uint8_t *end = p + data.size();
+
+	if (end - p < 6 || memcmp(p, "TRPL", 4) || p[4] != version) {
+		return false;
+	}
+
+	unsigned name_len = p[5];
+	p += 6;
+
+	if ((size_t)(end - p) < name_len + 1 + 3 * 4 + 8 + 4) {
+		return false;
+	}
+
+	rules.assign((const char*)p, name_len);
+	p += name_len;
+
+	repeat    = *p++;
+	das       = get_u32(p);
+	arr       = get_u32(p + 4);
+	soft_drop = get_u32(p + 8);
+	length    = get_u32(p + 12) | (uint64_t)get_u32(p + 16) << 32;
+	p += 20;
+
+	uint32_t frame_len = get_u32(p);
+	p += 4;
+
+	if ((size_t)(end - p) < frame_len
+	    || wire::decode(p, frame_len, start) != frame_len
+	    || (size_t)(end - p) - frame_len < 4)
+	{
+		return false;
+	}
+
+	p += frame_len;
+	uint32_t count = get_u32(p);
+	p += 4;
+
+	inputs.clear();
+	uint64_t tick = 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint64_t gap = 0;
+
+		for (unsigned shift = 0;; shift += 7) {
+			if (p == end || shift > 63) {
+				return false;
+			}
+
+			gap |= (uint64_t)(*p & 0x7f) << shift;
+
+			if (!(*p++ & 0x80)) {
+				break;
+			}
+		}
+
+		if (p == end || *p > event::ReleaseDown) {
+			return false;
+		}
+
+		tick += gap;
+		inputs.push_back(input{tick, (enum event)*p++});
+	}
+
+	return true;
+}
+
+template void replay::begin(field_state&, const std::string&);
+template void replay::begin(classic_field_state&, const std::string&);
+template void replay::begin(twenty_g_field_state&, const std::string&);
+template void replay::begin(fine_field_state&, const std::string&);
+template void replay::begin(zero_delay_field_state&, const std::string&);
+
+template void replay::restore(field_state&) const;
+template void replay::restore(classic_field_state&) const;
+template void replay::restore(twenty_g_field_state&) const;
+template void replay::restore(fine_field_state&) const;
+template void replay::restore(zero_delay_field_state&) const;
+
+// namespace tetrode
+}
@@ -0,0 +1,256 @@
+#include <tetrode/rewind_history.hpp>
+
+#include <string.h>
+
+namespace tetrode {
+
+// take out the rows set in `mask`, shifting everything above down
+static void remove_rows(uint8_t *cells, unsigned width, unsigned height, uint64_t mask){
+	unsigned dst = 0;
+
+	for (unsigned y = 0; y < height; y++) {
+		if (y < 64 && ((mask >> y) & 1)) {
+			continue;
+		}
+
+		if (dst != y) {
+			memmove(cells + dst * width, cells + y * width, width);
+		}
+
+		dst++;
+	}
+
+	memset(cells + dst * width, block::states::Empty, (height - dst) * width);
+}
+
+rewind_history::rewind_history(unsigned capacity, unsigned every){
+	keyframe_every = every? every : 1;
+
+	// room for at least two keyframes' worth, so making space never
+	// throws out the placements still being added to
+	capacity = (capacity < 2 * keyframe_every)? 2 * keyframe_every : capacity;
+
+	deltas.resize(capacity);
+	keys.resize(capacity / keyframe_every + 2);
+	key_ids.resize(keys.size());
+}
+
+void rewind_history::clear(void){
+	first_id = next_id = 0;
+	first_key = next_key = 0;
+}
+
+template <class field_t>
+void rewind_history::record(field_t& field){
+	field.save_state(scratch);
+
+	delta d;
+	bool key = empty()
+	        || next_id - key_ids[(next_key - 1) % keys.size()] >= keyframe_every
+	        || !make_delta(latest, scratch, field.cleared_rows, d);
+
+	if (key) {
+		// nothing in it is used, but keep it tidy
+		memset(&d, 0, sizeof(d));
+	}
+
+	append(d, key);
+	std::swap(latest, scratch);
+}
+
+bool rewind_history::make_delta(const field_snapshot& from, const field_snapshot& to,
+                                uint64_t cleared_rows, delta& out)
+{
+	if (from.size_x != to.size_x || from.size_y != to.size_y) {
+		return false;
+	}
+
+	// the engine's cleared rows are only for the last piece, so they're
+	// no use if more than one locked since
+	if ((unsigned)__builtin_popcountll(cleared_rows) != to.lines_cleared - from.lines_cleared) {
+		cleared_rows = 0;
+	}
+
+	work = from.cells;
+	remove_rows(work.data(), from.size_x, from.size_y, cleared_rows);
+
+	out.cleared_rows = cleared_rows;
+	out.num_changes = 0;
+
+	for (size_t i = 0; i < work.size(); i++) {
+		if (work[i] == to.cells[i]) {
+			continue;
+		}
+
+		if (out.num_changes == max_changes) {
+			return false;
+		}
+
+		out.change_at[out.num_changes] = i;
+		out.change_to[out.num_changes] = to.cells[i];
+		out.num_changes++;
+	}
+
+	// the queue moves on by popping from the front and pushing new bags
+	// onto the end, find the fewest pops that line the two up
+	unsigned pops = 0;
+
+	for (; pops <= from.queue_len; pops++) {
+		unsigned kept = from.queue_len - pops;
+
+		if (kept <= to.queue_len && !memcmp(from.queue + pops, to.queue, kept)) {
+			break;
+		}
+	}
+
+	if (pops > from.queue_len
+	    || to.queue_len - (from.queue_len - pops) > max_pushes
+	    || to.queue_len > field_snapshot::max_queue)
+	{
+		return false;
+	}
+
+	out.queue_pops = pops;
+	out.queue_pushes = to.queue_len - (from.queue_len - pops);
+	out.pushed = 0;
+
+	for (unsigned i = 0; i < out.queue_pushes; i++) {
+		out.pushed |= (uint32_t)to.queue[from.queue_len - pops + i] << (3 * i);
+	}
+
+	out.active_shape    = to.active_shape;
+	out.active_rotations = to.active_rotations;
+	memcpy(out.active_blocks, to.active_blocks, sizeof(to.active_blocks));
+	out.active_x        = to.active_x;
+	out.active_y        = to.active_y;
+	out.spin            = to.spin;
+	out.hold_shape      = to.hold_shape;
+	out.have_held       = to.have_held;
+	out.already_held    = to.already_held;
+	out.topped_out      = to.topped_out;
+	out.held            = to.held;
+	out.random_seed     = to.random_seed;
+	out.movement_ticks  = to.movement_ticks;
+	out.clear_ticks     = to.clear_ticks;
+	out.drop_ticks      = to.drop_ticks;
+	out.shift_ticks     = to.shift_ticks;
+	out.soft_drop_ticks = to.soft_drop_ticks;
+	out.level           = to.level;
+	out.score           = to.score;
+	out.lines_cleared   = to.lines_cleared;
+
+	return true;
+}
+
+void rewind_history::apply(const delta& d, field_snapshot& snap){
+	if (d.cleared_rows) {
+		remove_rows(snap.cells.data(), snap.size_x, snap.size_y, d.cleared_rows);
+	}
+
+	for (unsigned i = 0; i < d.num_changes; i++) {
+		snap.cells[d.change_at[i]] = d.change_to[i];
+	}
+
+	snap.queue_len -= d.queue_pops;
+	memmove(snap.queue, snap.queue + d.queue_pops, snap.queue_len);
+
+	for (unsigned i = 0; i < d.queue_pushes; i++) {
+		snap.queue[snap.queue_len++] = (d.pushed >> (3 * i)) & 7;
+	}
+
+	snap.active_shape    = d.active_shape;
+	snap.active_rotations = d.active_rotations;
+	memcpy(snap.active_blocks, d.active_blocks, sizeof(d.active_blocks));
+	snap.active_x        = d.active_x;
+	snap.active_y        = d.active_y;
+	snap.spin            = d.spin;
+	snap.hold_shape      = d.hold_shape;
+	snap.have_held       = d.have_held;
+	snap.already_held    = d.already_held;
+	snap.topped_out      = d.topped_out;
+	snap.held            = d.held;
+	snap.random_seed     = d.random_seed;
+	snap.movement_ticks  = d.movement_ticks;
+	snap.clear_ticks     = d.clear_ticks;
+	snap.drop_ticks      = d.drop_ticks;
+	snap.shift_ticks     = d.shift_ticks;
+	snap.soft_drop_ticks = d.soft_drop_ticks;
+	snap.level           = d.level;
+	snap.score           = d.score;
+	snap.lines_cleared   = d.lines_cleared;
+}
+
+void rewind_history::append(const delta& d, bool key){
+	if (next_id - first_id == deltas.size()) {
+		drop_oldest();
+	}
+
+	if (key) {
+		if (next_key - first_key == keys.size()) {
+			drop_oldest();
+		}
+
+		// copying over an old keyframe reuses its cells
+		keys[next_key % keys.size()] = scratch;
+		key_ids[next_key % keys.size()] = next_id;
+		next_key++;
+	}
+
+	delta& e = entry(next_id);
+	e = d;
+	e.keyframe = next_key - 1;
+	next_id++;
+}
+
+void rewind_history::drop_oldest(void){
+	while (first_id < next_id && entry(first_id).keyframe == first_key) {
+		first_id++;
+	}
+
+	first_key++;
+}
+
+bool rewind_history::seek(unsigned long id, field_snapshot& out){
+	if (id < first_id || id >= next_id) {
+		return false;
+	}
+
+	unsigned long key = entry(id).keyframe;
+	out = keys[key % keys.size()];
+
+	for (unsigned long i = key_ids[key % keys.size()] + 1; i <= id; i++) {
+		apply(entry(i), out);
+	}
+
+	return true;
+}
+
+void rewind_history::truncate(unsigned long id){
+	if (id < first_id || id >= next_id) {
+		return;
+	}
+
+	seek(id, latest);
+	next_key = entry(id).keyframe + 1;
+	next_id = id + 1;
+}
+
+size_t rewind_history::memory_used(void) const {
+	size_t total = deltas.capacity() * sizeof(delta)
+	             + key_ids.capacity() * sizeof(unsigned long)
+	             + keys.capacity() * sizeof(field_snapshot);
+
+	for (auto& k : keys) {
+		total += k.cells.capacity();
+	}
+
+	return total + latest.cells.capacity() + scratch.cells.capacity() + work.capacity();
+}
+
+template void rewind_history::record(field_state&);
+template void rewind_history::record(classic_field_state&);
+template void rewind_history::record(twenty_g_field_state&);
+template void rewind_history::record(fine_field_state&);
+
+// namespace tetrode
+}
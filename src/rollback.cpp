@@ -0,0 +1,208 @@
+#include <tetrode/rollback.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+namespace tetrode {
+
+loopback_link::loopback_link(unsigned lat, unsigned jit, unsigned loss, uint32_t seed){
+	latency = lat;
+	jitter = jit;
+	loss_percent = loss;
+	rng = seed? seed : 1;
+
+	for (unsigned i = 0; i < 2; i++) {
+		ends[i].link = this;
+		ends[i].side = i;
+	}
+}
+
+uint32_t loopback_link::random(void){
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+rollback_transport& loopback_link::endpoint(unsigned side){
+	return ends[side & 1];
+}
+
+void loopback_link::tick(void){
+	now++;
+}
+
+void loopback_link::end::send(const rollback_packet& packet){
+	if (link->random() % 100 < link->loss_percent) {
+		return;
+	}
+
+	unsigned delay = link->latency;
+	if (link->jitter) {
+		delay += link->random() % (link->jitter + 1);
+	}
+
+	// packets go to the other side's queue, which is kept sorted by
+	// arrival so jitter can reorder them
+	auto& queue = link->queues[!side];
+	in_flight pkt = { link->now + delay, packet };
+
+	auto it = queue.end();
+	while (it != queue.begin() && std::prev(it)->arrival > pkt.arrival) {
+		it--;
+	}
+
+	queue.insert(it, pkt);
+}
+
+bool loopback_link::end::receive(rollback_packet& packet){
+	auto& queue = link->queues[side];
+
+	if (queue.empty() || queue.front().arrival > link->now) {
+		return false;
+	}
+
+	packet = queue.front().packet;
+	queue.pop_front();
+	return true;
+}
+
+rollback_session::rollback_session(unsigned local, uint32_t seed,
+                                   rollback_transport& trans)
+	: room(seed), local_player(local & 1), transport(trans)
+{
+	rollback_from = UINT32_MAX;
+	std::fill(local_inputs, local_inputs + history, event::NullEvent);
+	std::fill(remote_inputs, remote_inputs + history, event::NullEvent);
+}
+
+void rollback_session::receive(void){
+	rollback_packet packet;
+
+	while (transport.receive(packet)) {
+		remote_ack = std::max(remote_ack, packet.ack);
+
+		for (unsigned i = 0; i < packet.count; i++) {
+			uint32_t tick = packet.first_tick + i;
+
+			// already known, or a gap from a reordered packet that a later
+			// resend will fill
+			if (tick != confirmed) {
+				continue;
+			}
+
+			// don't accept inputs so far ahead they'd overwrite history
+			if (tick >= current_tick + max_rollback) {
+				break;
+			}
+
+			// ticks already simulated were run with the predicted input,
+			// see simulate()
+			if (tick < current_tick && packet.inputs[i] != event::NullEvent) {
+				rollback_from = std::min(rollback_from, tick);
+			}
+
+			remote_inputs[tick % history] = packet.inputs[i];
+			confirmed++;
+		}
+	}
+}
+
+void rollback_session::simulate(uint32_t tick){
+	unsigned remote = !local_player;
+
+	room.save_state(states[tick % history]);
+
+	// predicted inputs are stored as NullEvent: with discrete key presses
+	// "nothing new happened" is by far the most likely input on any tick
+	uint8_t inputs[2];
+	inputs[local_player] = local_inputs[tick % history];
+	inputs[remote] = (tick < confirmed)? remote_inputs[tick % history]
+	                                   : (uint8_t)event::NullEvent;
+
+	for (unsigned p = 0; p < 2; p++) {
+		room.num_inputs[p] = 0;
+
+		if (inputs[p] != event::NullEvent) {
+			room.inputs[p][room.num_inputs[p]++] = inputs[p];
+		}
+	}
+
+	room.tick();
+}
+
+void rollback_session::rollback(uint32_t tick){
+	auto start = std::chrono::steady_clock::now();
+	unsigned depth = current_tick - tick;
+
+	room.load_state(states[tick % history]);
+
+	for (uint32_t t = tick; t < current_tick; t++) {
+		simulate(t);
+	}
+
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	unsigned long us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+
+	stats.rollbacks++;
+	stats.resimulated_ticks += depth;
+	stats.max_depth = std::max(stats.max_depth, depth);
+	stats.max_resim_us = std::max(stats.max_resim_us, us);
+}
+
+void rollback_session::send(void){
+	rollback_packet packet;
+
+	packet.ack = confirmed;
+	packet.first_tick = remote_ack;
+	packet.count = current_tick - remote_ack;
+
+	for (unsigned i = 0; i < packet.count; i++) {
+		packet.inputs[i] = local_inputs[(remote_ack + i) % history];
+	}
+
+	transport.send(packet);
+}
+
+void rollback_session::catch_up(void){
+	receive();
+
+	if (rollback_from < current_tick) {
+		rollback(rollback_from);
+	}
+
+	rollback_from = UINT32_MAX;
+}
+
+void rollback_session::poll(void){
+	catch_up();
+	send();
+}
+
+bool rollback_session::advance(event local){
+	catch_up();
+
+	// stall when we'd have to predict further than the saved history
+	// goes, or resend more than fits in a packet
+	if (confirmed + max_rollback <= current_tick
+	    || remote_ack + max_rollback <= current_tick)
+	{
+		stats.stalls++;
+		send();
+		return false;
+	}
+
+	local_inputs[current_tick % history] = local;
+	simulate(current_tick);
+	current_tick++;
+
+	send();
+	return true;
+}
+
+bool rollback_session::synchronized(void){
+	return confirmed == current_tick && remote_ack == current_tick;
+}
+
+// namespace tetrode
+}
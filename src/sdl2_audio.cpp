@@ -0,0 +1,107 @@
+#include <tetrode/sdl2_audio.hpp>
+
+#include <string.h>
+
+namespace tetrode {
+
+sdl2_audio::sdl2_audio(unsigned buffer){
+	if (Mix_OpenAudio(48000, AUDIO_S16SYS, 2, buffer) == -1) {
+		throw "Mix_OpenAudio()";
+	}
+
+	int freq, channels;
+	Uint16 format;
+	Mix_QuerySpec(&freq, &format, &channels);
+
+	// mix() assumes this, chunks are converted to whatever was opened
+	if (format != AUDIO_S16SYS) {
+		Mix_CloseAudio();
+		throw "sdl2_audio: device isn't 16 bit";
+	}
+
+	frames = buffer;
+	rate = freq;
+
+	// the music hook runs first in SDL_mixer's callback and nothing else
+	// is playing, so the effects get the whole stream
+	Mix_HookMusic(mix, this);
+}
+
+sdl2_audio::~sdl2_audio(){
+	// takes the audio lock, so the callback's finished once this returns
+	Mix_HookMusic(NULL, NULL);
+	Mix_CloseAudio();
+}
+
+void sdl2_audio::set_sound(unsigned id, Mix_Chunk *chunk){
+	if (id < max_sounds) {
+		// pairs with the acquire in mix(), so the chunk's samples are
+		// visible along with the pointer
+		sounds[id].store(chunk, std::memory_order_release);
+	}
+}
+
+void sdl2_audio::play(unsigned id, uint8_t volume){
+	command cmd;
+	cmd.sound = id;
+	cmd.volume = volume;
+	cmd.stamp = SDL_GetPerformanceCounter();
+
+	if (id >= max_sounds || !commands.push(cmd)) {
+		latency.dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void sdl2_audio::mix(void *data, Uint8 *stream, int len){
+	sdl2_audio *audio = static_cast<sdl2_audio*>(data);
+	int16_t *out = reinterpret_cast<int16_t*>(stream);
+	size_t samples = len / sizeof(int16_t);
+	uint64_t now = SDL_GetPerformanceCounter();
+	command cmd;
+
+	memset(stream, 0, len);
+
+	while (audio->commands.pop(cmd)) {
+		Mix_Chunk *chunk = audio->sounds[cmd.sound].load(std::memory_order_acquire);
+
+		if (!chunk) {
+			continue;
+		}
+
+		// take a free voice, or cut short whichever is closest to done
+		voice *slot = &audio->voices[0];
+
+		for (auto& v : audio->voices) {
+			if (v.left < slot->left) {
+				slot = &v;
+			}
+		}
+
+		slot->pcm = reinterpret_cast<const int16_t*>(chunk->abuf);
+		slot->left = chunk->alen / sizeof(int16_t);
+		slot->volume = cmd.volume;
+
+		uint64_t taken = now - cmd.stamp;
+		audio->latency.total.fetch_add(taken, std::memory_order_relaxed);
+		audio->latency.played.fetch_add(1, std::memory_order_relaxed);
+
+		if (taken > audio->latency.worst.load(std::memory_order_relaxed)) {
+			audio->latency.worst.store(taken, std::memory_order_relaxed);
+		}
+	}
+
+	for (auto& v : audio->voices) {
+		size_t n = (v.left < samples)? v.left : samples;
+
+		for (size_t i = 0; i < n; i++) {
+			int s = out[i] + (v.pcm[i] * v.volume / MIX_MAX_VOLUME);
+			out[i] = (s > 32767)? 32767 : (s < -32768)? -32768 : s;
+		}
+
+		v.pcm += n;
+		v.left -= n;
+	}
+}
+
+// namespace tetrode
+}
@@ -6,9 +6,10 @@
 #include <SDL2/SDL_ttf.h>
 #include <SDL2/SDL_mixer.h>
 
-#include <map>
-#include <tuple>
+#include <chrono>
+#include <future>
 #include <stdio.h>
+#include <stdlib.h>
 
 namespace tetrode {
 
@@ -17,24 +18,31 @@ namespace tetrode {
 #define BLOCK_FULL_SIZE 24
 */
 
-std::map<block::states, std::tuple<unsigned, unsigned, unsigned>> block_colors = {
-	{ block::states::Empty,    {0x11, 0x11, 0x11} },
-	{ block::states::Reserved, {0x22, 0x11, 0x11} },
-	{ block::states::Ghost,    {0x88, 0xaa, 0xdd} },
-	{ block::states::Cleared,  {0xf0, 0xdd, 0xf0} },
-
-	{ block::states::Garbage,  {0x22, 0x22, 0x22} },
-	{ block::states::Cyan,     {0x44, 0x88, 0xaa} },
-	{ block::states::Yellow,   {0xaa, 0xaa, 0x44} },
-	{ block::states::Purple,   {0xaa, 0x44, 0xaa} },
-	{ block::states::Green,    {0x44, 0xaa, 0x44} },
-	{ block::states::Red,      {0xaa, 0x44, 0x44} },
-	{ block::states::Blue,     {0x44, 0x44, 0xaa} },
-	{ block::states::Orange,   {0xaa, 0x66, 0x44} },
+static const char *font_name = "fonts/LiberationSans-Regular.ttf";
+// what tetrode-render knows fine_field_state as
+static const char *replay_rules = "guideline-1000";
+
+// indexed by block::states
+const SDL_Color block_palette[block::states::Orange + 1] = {
+	{0x11, 0x11, 0x11, 0xff}, // Empty
+	{0x22, 0x11, 0x11, 0xff}, // Reserved
+	{0x88, 0xaa, 0xdd, 0xff}, // Ghost
+	{0xf0, 0xdd, 0xf0, 0xff}, // Cleared
+
+	{0x22, 0x22, 0x22, 0xff}, // Garbage
+	{0x44, 0x88, 0xaa, 0xff}, // Cyan
+	{0xaa, 0xaa, 0x44, 0xff}, // Yellow
+	{0xaa, 0x44, 0xaa, 0xff}, // Purple
+	{0x44, 0xaa, 0x44, 0xff}, // Green
+	{0xaa, 0x44, 0x44, 0xff}, // Red
+	{0x44, 0x44, 0xaa, 0xff}, // Blue
+	{0xaa, 0x66, 0x44, 0xff}, // Orange
 };
 
-sdl2_frontend::sdl2_frontend() {
+sdl2_frontend::sdl2_frontend(unsigned audio_buffer) {
+	startup = std::chrono::steady_clock::now();
 	menus.push_front(main_menu());
+	field.stats = &stats;
 
 	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0){
 		throw "SDL_Init()";
@@ -44,12 +52,22 @@ sdl2_frontend::sdl2_frontend() {
 		throw "TTF_Init()";
 	}
 
+	// the mixer has to be open before loading, chunks are converted to
+	// the device format as they're decoded
+	int mix_flags = MIX_INIT_OGG;
+	if (Mix_Init(mix_flags) != mix_flags) {
+		throw "Mix_Init()";
+	}
+
+	audio.reset(new sdl2_audio(audio_buffer));
+	load_assets();
+
 	window = SDL_CreateWindow("Tetrode SDL",
 	                          SDL_WINDOWPOS_UNDEFINED,
 	                          SDL_WINDOWPOS_UNDEFINED,
 	                          480,
 	                          640,
-	                          SDL_WINDOW_SHOWN);
+	                          SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
 
 	if (!window) {
 		throw "SDL_CreateWindow()";
@@ -61,97 +79,283 @@ sdl2_frontend::sdl2_frontend() {
 		throw "SDL_CreateRenderer()";
 	}
 
-	font = TTF_OpenFont("assets/fonts/LiberationSans-Regular.ttf",
-	                    get_block_filled_size());
-
-	if (!font) {
-		throw "TTF_OpenFont()";
-	}
+	font = NULL;
+	update_layout();
+}
 
-	int mix_flags = MIX_INIT_OGG;
-	if (Mix_Init(mix_flags) != mix_flags) {
-		throw "Mix_Init()";
+sdl2_frontend::~sdl2_frontend(){
+	// anything still loading has to finish before it can be freed
+	if (font_load.valid()) {
+		font_load.wait();
 	}
 
-	if (Mix_OpenAudio(48000, MIX_DEFAULT_FORMAT, 2, 1024) == -1) {
-		throw "Mix_OpenAudio()";
+	for (auto& load : sfx_loads) {
+		if (load.valid()) {
+			Mix_FreeChunk(load.get());
+		}
 	}
 
-	sfx.locked   = Mix_LoadWAV("assets/sfx/locked.ogg");
-	sfx.rotation = Mix_LoadWAV("assets/sfx/rotation.ogg");
-	sfx.tspin    = Mix_LoadWAV("assets/sfx/tspin.ogg");
-	sfx.wallhit  = Mix_LoadWAV("assets/sfx/wallhit.ogg");
-
-	if (!sfx.locked || !sfx.rotation || !sfx.tspin || !sfx.wallhit) {
-		throw "Mix_LoadWAV()";
+	// Close fonts
+	if (font) {
+		TTF_CloseFont(font);
 	}
 
-	Mix_AllocateChannels(32);
-}
-
-sdl2_frontend::~sdl2_frontend(){
-	// Close fonts
-	TTF_CloseFont(font);
 	font = NULL;
 	TTF_Quit();
 
-	// Close audio
-	for (auto& x : {sfx.locked, sfx.rotation, sfx.tspin, sfx.wallhit}) {
+	// Close audio, the mixer has to stop before the chunks go
+	audio.reset();
+
+	for (auto& x : sfx) {
 		Mix_FreeChunk(x);
 	}
 
-	Mix_CloseAudio();
 	Mix_Quit();
 
 	SDL_Quit();
 }
 
-event sdl2_frontend::get_event(void){
+// assets are looked for next to the binary first, then in the current
+// directory, and in a pack before loose files
+void sdl2_frontend::load_assets(void){
+	char *base = SDL_GetBasePath();
+	std::string base_path = base? base : "";
+	SDL_free(base);
+
+	for (const std::string& dir : { base_path, std::string() }) {
+		if (pack.open(dir + "assets.pak")) {
+			break;
+		}
+
+		FILE *fp = fopen((dir + "assets/" + font_name).c_str(), "rb");
+		if (fp) {
+			fclose(fp);
+			asset_dir = dir + "assets/";
+			break;
+		}
+	}
+
+	// fonts are opened from memory so resizing never touches the disk
+	font_load = std::async(std::launch::async, [this]{
+		return asset_data(font_name, font_data, &font_ptr, &font_len);
+	});
+
+	static const char *sfx_names[SfxCount] = {
+		"sfx/locked.ogg", "sfx/rotation.ogg", "sfx/tspin.ogg", "sfx/wallhit.ogg",
+	};
+
+	for (unsigned i = 0; i < SfxCount; i++) {
+		const char *name = sfx_names[i];
+
+		// decoding the oggs is most of the startup time, so each one gets
+		// its own thread
+		sfx_loads[i] = std::async(std::launch::async, [this, name]{
+			std::vector<uint8_t> storage;
+			const uint8_t *data;
+			size_t len;
+
+			if (!asset_data(name, storage, &data, &len)) {
+				return (Mix_Chunk*)NULL;
+			}
+
+			return Mix_LoadWAV_RW(SDL_RWFromConstMem(data, len), 1);
+		});
+	}
+}
+
+bool sdl2_frontend::asset_data(const std::string& name, std::vector<uint8_t>& storage,
+                               const uint8_t **data, size_t *len)
+{
+	if (pack.is_open()) {
+		return pack.find(name, data, len);
+	}
+
+	if (!asset_pack::read_file(asset_dir + name, storage)) {
+		return false;
+	}
+
+	*data = storage.data();
+	*len = storage.size();
+	return true;
+}
+
+template <class T>
+static bool is_ready(std::future<T>& f){
+	return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void sdl2_frontend::poll_assets(void){
+	if (assets_ready) {
+		return;
+	}
+
+	bool loading = false;
+
+	if (font_load.valid()) {
+		if (!is_ready(font_load)) {
+			loading = true;
+
+		} else if (!font_load.get()) {
+			throw "sdl2_frontend: couldn't load font";
+
+		} else {
+			open_font();
+			needs_redraw = true;
+		}
+	}
+
+	for (unsigned i = 0; i < SfxCount; i++) {
+		if (!sfx_loads[i].valid()) {
+			continue;
+		}
+
+		if (!is_ready(sfx_loads[i])) {
+			loading = true;
+
+		} else if (!(sfx[i] = sfx_loads[i].get())) {
+			throw "Mix_LoadWAV()";
+
+		} else {
+			audio->set_sound(i, sfx[i]);
+		}
+	}
+
+	if (!loading) {
+		assets_ready = true;
+
+		auto taken = std::chrono::steady_clock::now() - startup;
+		printf("startup: assets loaded from %s after %.1f ms\n",
+		       pack.is_open()? "pack" : "files",
+		       std::chrono::duration<double, std::milli>(taken).count());
+	}
+}
+
+static event translate_key(SDL_Keycode key){
+	switch (key) {
+		case SDLK_q:      return event::Quit;
+		case SDLK_LEFT:
+		case SDLK_h:      return event::MoveLeft;
+		case SDLK_RIGHT:
+		case SDLK_l:      return event::MoveRight;
+		case SDLK_LCTRL:
+		case SDLK_RCTRL:
+		case SDLK_z:
+		case SDLK_j:      return event::RotateLeft;
+		case SDLK_x:
+		case SDLK_UP:
+		case SDLK_k:      return event::RotateRight;
+		case SDLK_SPACE:  return event::Drop;
+		case SDLK_DOWN:   return event::MoveDown;
+		case SDLK_F1:
+		case SDLK_ESCAPE: return event::Pause;
+		case SDLK_c:
+		case SDLK_RSHIFT:
+		case SDLK_LSHIFT: return event::Hold;
+		default:          return event::NullEvent;
+	}
+}
+
+// the time SDL gave the event, moved onto the performance counter. SDL
+// stamps events in whole milliseconds of SDL_GetTicks(), so a key pressed
+// during a long frame keeps the time it was pressed rather than the time
+// the queue was pumped. Falls back to now for events with no usable stamp.
+static uint64_t event_stamp(uint32_t timestamp){
+	uint64_t now = SDL_GetPerformanceCounter();
+	uint32_t ticks = SDL_GetTicks();
+	uint32_t age = ticks - timestamp;
+
+	// no stamp at all, or one from the future or stale enough to be junk
+	if (timestamp == 0 || age > 1000) {
+		return now;
+	}
+
+	return now - (uint64_t)age * SDL_GetPerformanceFrequency() / 1000;
+}
+
+// called by SDL as each event is queued, which stamps keys as early as
+// we can see them instead of whenever the main loop gets around to them
+int sdl2_frontend::input_watch(void *data, SDL_Event *e){
+	sdl2_frontend *front = static_cast<sdl2_frontend*>(data);
+
+	if (e->type == SDL_KEYDOWN || e->type == SDL_KEYUP) {
+		timed_event in;
+		in.ev = translate_key(e->key.keysym.sym);
+		in.stamp = event_stamp(e->key.timestamp);
+
+		bool shift = in.ev == event::MoveLeft || in.ev == event::MoveRight
+		          || in.ev == event::MoveDown;
+
+		// the engine repeats held movement keys itself, so OS key repeat
+		// is only passed on for everything else
+		if (e->type == SDL_KEYUP) {
+			in.ev = !shift?                       event::NullEvent
+			      : (in.ev == event::MoveLeft)?   event::ReleaseLeft
+			      : (in.ev == event::MoveRight)?  event::ReleaseRight
+			      :                               event::ReleaseDown;
+
+		} else if (shift && e->key.repeat) {
+			in.ev = event::NullEvent;
+		}
+
+		if (in.ev != event::NullEvent && !front->input.push(in)) {
+			front->latency.dropped++;
+		}
+	}
+
+	return 0;
+}
+
+bool sdl2_frontend::pump_events(unsigned timeout){
 	SDL_Event e;
+	bool rewound = false;
+
+	// sleep until the next tick is due or something shows up, keys have
+	// already been queued by input_watch() by the time this returns
+	if (!SDL_WaitEventTimeout(&e, timeout)) {
+		return true;
+	}
 
-	if (SDL_PollEvent(&e) != 0) {
+	do {
 		if (e.type == SDL_QUIT){
-			return event::Quit;
+			return false;
 		}
 
-		else if (e.type == SDL_KEYDOWN) {
-			switch (e.key.keysym.sym) {
-				case SDLK_q:      return event::Quit;
-				case SDLK_LEFT:
-				case SDLK_h:      return event::MoveLeft;
-				case SDLK_RIGHT:
-				case SDLK_l:      return event::MoveRight;
-				case SDLK_LCTRL:
-				case SDLK_RCTRL:
-				case SDLK_z:
-				case SDLK_j:      return event::RotateLeft;
-				case SDLK_x:
-				case SDLK_UP:
-				case SDLK_k:      return event::RotateRight;
-				case SDLK_SPACE:  return event::Drop;
-				case SDLK_DOWN:   return event::MoveDown;
-				case SDLK_F1:
-				case SDLK_ESCAPE: return event::Pause;
-				case SDLK_c:
-				case SDLK_RSHIFT:
-				case SDLK_LSHIFT: return event::Hold;
-				default:          break;
-			}
+		else if (e.type == SDL_WINDOWEVENT
+		         && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+		{
+			update_layout();
+			needs_redraw = true;
+		}
+
+		else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F2 && !e.key.repeat) {
+			find_perfect_clear();
 		}
+
+		// back and forward through a practice game's placements
+		else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_BACKSPACE) {
+			rewound |= rewind(-1);
+		}
+
+		else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_TAB) {
+			rewound |= rewind(1);
+		}
+	} while (SDL_PollEvent(&e));
+
+	// the replay carries on from the board that was rewound to
+	if (rewound) {
+		recording.begin(field, replay_rules);
+		needs_redraw = true;
 	}
 
-	return event::NullEvent;
+	return true;
 }
 
 void sdl2_frontend::draw_tetrimino(tetrimino& tet, coord_2d coord){
-	unsigned filled_size = get_block_filled_size();
-	unsigned full_size = get_block_full_size();
-
 	SDL_Rect rect;
 	rect.w = rect.h = filled_size;
 
 	for (const auto &block : tet.blocks) {
-		auto color = block_colors[block.first.state];
+		const SDL_Color& color = block_palette[block.first.state];
 
 		int x = (block.second.x + coord.x);
 		int y = (block.second.y + coord.y);
@@ -159,10 +363,7 @@ void sdl2_frontend::draw_tetrimino(tetrimino& tet, coord_2d coord){
 		rect.x = x       * full_size;
 		rect.y = ((field.size.y / 2) - y) * full_size;
 
-		SDL_SetRenderDrawColor(renderer,
-				std::get<0>(color),
-				std::get<1>(color),
-				std::get<2>(color), 0);
+		SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 0);
 		SDL_RenderFillRect(renderer, &rect);
 	}
 }
@@ -171,7 +372,10 @@ void sdl2_frontend::draw_text(std::string& str, coord_2d coord) {
 	SDL_Color color = {0xff, 0xff, 0xff};
 	SDL_Surface *text_surface;
 
-	unsigned full_size = get_block_full_size();
+	// nothing to draw with until the font's loaded
+	if (!font) {
+		return;
+	}
 
 	if (!(text_surface = TTF_RenderText_Blended(font, str.c_str(), color))){
 		throw "TTF_RenderText_Blended()";
@@ -193,48 +397,86 @@ void sdl2_frontend::draw_text(std::string& str, coord_2d coord) {
 	}
 }
 
-unsigned sdl2_frontend::get_block_full_size(void){
-	int w, h;
-	SDL_GetWindowSize(window, &w, &h);
+void sdl2_frontend::update_layout(void){
+	SDL_GetWindowSize(window, &window_w, &window_h);
+
+	if (window_w <= field.size.x || window_h <= (field.size.y / 2)) {
+		full_size = 0;
+
+	} else {
+		unsigned x = window_w / (field.size.x + 5);
+		unsigned y = window_h / ((field.size.y / 2) + 1);
 
-	if (w <= field.size.x || h <= (field.size.y / 2)) {
-		return 0;
+		full_size = (x < y)? x : y;
 	}
 
-	unsigned x = w / (field.size.x + 5);
-	unsigned y = h / ((field.size.y / 2) + 1);
+	unsigned old_filled = filled_size;
+	filled_size = (full_size > 10)? full_size - 3 : full_size;
 
-	return (x < y)? x : y;
+	// reopening the font is slow, only do it when the text size changed
+	if (!font || filled_size != old_filled) {
+		open_font();
+	}
 }
 
-unsigned sdl2_frontend::get_block_filled_size(void){
-	unsigned n = get_block_full_size();
+void sdl2_frontend::open_font(void){
+	// still loading, poll_assets() calls back here once it's done. Don't
+	// look at font_ptr before then, the loader thread is writing it.
+	if (font_load.valid()) {
+		return;
+	}
 
-	return (n > 10)? n - 3 : n;
-}
+	// TTF_OpenFont() won't take a zero point size
+	TTF_Font *new_font = TTF_OpenFontRW(SDL_RWFromConstMem(font_ptr, font_len), 1,
+	                                    filled_size? filled_size : 1);
 
-void sdl2_frontend::draw_field(field_state& n_field){
-	unsigned filled_size = get_block_filled_size();
-	unsigned full_size = get_block_full_size();
+	if (!new_font) {
+		throw "TTF_OpenFont()";
+	}
+
+	if (font) {
+		TTF_CloseFont(font);
+	}
 
+	font = new_font;
+}
+
+void sdl2_frontend::draw_field(fine_field_state& n_field){
 	SDL_Rect rect;
 	rect.w = rect.h = filled_size;
 
 	for (int y = n_field.size.y / 2; y >= 0; y--) {
 		for (int x = 0; x < n_field.size.x; x++) {
-			auto color = block_colors[n_field.field[y][x].state];
+			const SDL_Color& color = block_palette[n_field.field[y][x].state];
 
 			rect.x = x       * full_size;
 			rect.y = ((n_field.size.y / 2) - y) * full_size;
 
-			SDL_SetRenderDrawColor(renderer,
-			                       std::get<0>(color),
-			                       std::get<1>(color),
-			                       std::get<2>(color), 0);
+			SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 0);
 			SDL_RenderFillRect(renderer, &rect);
 		}
 	}
 
+	// rows that just cleared close up over whatever fell into them
+	double now = seconds_now();
+	clears.update(n_field, now);
+
+	for (int y = n_field.size.y / 2; clears.running(now) && y >= 0; y--) {
+		const SDL_Color& color = block_palette[block::states::Cleared];
+		int h = clears.left(y, now) * filled_size;
+
+		if (h > 0) {
+			SDL_Rect bar;
+			bar.x = 0;
+			bar.y = ((n_field.size.y / 2) - y) * full_size + (filled_size - h) / 2;
+			bar.w = n_field.size.x * full_size - (full_size - filled_size);
+			bar.h = h;
+
+			SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 0);
+			SDL_RenderFillRect(renderer, &bar);
+		}
+	}
+
 	coord_2d ghost_coord = n_field.lower_collide_coord(n_field.active.first, n_field.active.second);
 	tetrimino ghost_block = n_field.active.first;
 
@@ -263,13 +505,10 @@ void sdl2_frontend::draw_field(field_state& n_field){
 
 void sdl2_frontend::draw_menus(void){
 	unsigned k = 0;
-	int w, h;
-
-	SDL_GetWindowSize(window, &w, &h);
 
 	for (auto& x : menus) {
 		SDL_Rect rect;
-		rect.h = h;
+		rect.h = window_h;
 		rect.w = 150;
 
 		rect.x = k * (rect.w - 100);
@@ -297,6 +536,42 @@ void sdl2_frontend::draw_menus(void){
 	}
 }
 
+void sdl2_frontend::find_perfect_clear(void){
+	pc_hint = solver.solve(field);
+	show_pc_hint = true;
+	needs_redraw = true;
+
+	printf("perfect clear: %s after %lu boards in %.1f ms\n",
+	       pc_hint.found? "found" : "none", pc_hint.nodes, pc_hint.ms);
+}
+
+void sdl2_frontend::draw_perfect_clear(void){
+	std::string str = "no perfect clear";
+
+	if (pc_hint.found && !pc_hint.placements.empty()) {
+		auto& next = pc_hint.placements.front();
+		const SDL_Color& color = block_palette[block::states::Cyan + next.shape];
+
+		str = "pc: " + std::to_string(pc_hint.placements.size()) + " pieces, "
+		    + std::to_string(next.keys.size()) + " keys";
+
+		// where the piece in play (or hold) goes, as small blocks
+		SDL_Rect rect;
+		rect.w = rect.h = filled_size / 2;
+		SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 0);
+
+		for (int i = 0; i < 64; i++) {
+			if ((next.cells >> i) & 1) {
+				rect.x = (i % field.size.x) * full_size + filled_size / 4;
+				rect.y = (field.size.y / 2 - i / field.size.x) * full_size + filled_size / 4;
+				SDL_RenderFillRect(renderer, &rect);
+			}
+		}
+	}
+
+	draw_text(str, coord_2d(field.size.x + 2, 6));
+}
+
 void sdl2_frontend::clear(void){
 	SDL_RenderClear(renderer);
 	SDL_SetRenderDrawColor(renderer, 0x8, 0x8, 0x8, 0);
@@ -311,6 +586,36 @@ void sdl2_frontend::redraw(void){
 	clear();
 	draw_field(field);
 
+	if (latency.count) {
+		char buf[32];
+		snprintf(buf, sizeof(buf), "input: %.2f ms",
+		         1000.0 * latency.total / latency.count / SDL_GetPerformanceFrequency());
+
+		std::string latency_str = buf;
+		draw_text(latency_str, coord_2d(field.size.x + 2, 5));
+	}
+
+	if (show_pc_hint) {
+		draw_perfect_clear();
+	}
+
+	if (practice && !history.empty()) {
+		std::string history_str = "placement " + std::to_string(history_at) + "/"
+		                        + std::to_string(history.last()) + ", "
+		                        + std::to_string(history.memory_used() / 1024) + " KiB";
+		draw_text(history_str, coord_2d(field.size.x + 2, 7));
+	}
+
+	if (stats.pieces) {
+		char buf[64];
+		snprintf(buf, sizeof(buf), "pps %.2f, %.1f inputs/piece, %u faults",
+		         stats.pieces_per_second(), stats.inputs_per_piece(),
+		         stats.finesse_faults);
+
+		std::string stats_str = buf;
+		draw_text(stats_str, coord_2d(field.size.x + 2, 8));
+	}
+
 	if (!menus.empty()){
 		draw_menus();
 	}
@@ -319,63 +624,349 @@ void sdl2_frontend::redraw(void){
 }
 
 void sdl2_frontend::play_sfx(void){
-	if (field.updates & changes::Locked) {
-		Mix_PlayChannel(-1, sfx.locked, 0);
+	static const unsigned sounds[][2] = {
+		{ changes::Locked,  SfxLocked },
+		{ changes::Tspin,   SfxTspin },
+		{ changes::Rotated, SfxRotation },
+		{ changes::WallHit, SfxWallhit },
+	};
+
+	// everything that happened gets its sound, they're mixed together
+	for (auto& sound : sounds) {
+		if (field.updates & sound[0]) {
+			audio->play(sound[1]);
+		}
+	}
+}
+
+bool sdl2_frontend::handle_input(event ev, uint64_t stamp){
+	if (ev == event::Quit) {
+		return false;
 	}
 
-	else if (field.updates & changes::Tspin) {
-		Mix_PlayChannel(-1, sfx.tspin, 0);
+	if (ev == event::Pause) {
+		// TODO: pop up game menu when playing, and don't actually pause in
+		//       multiplayer games
+		menus.push_back(main_menu());
+		paused = !paused;
 	}
 
-	else if (field.updates & changes::Rotated) {
-		Mix_PlayChannel(-1, sfx.rotation, 0);
+	// releases go through to the board even when it's not being played,
+	// or a key let go of in a menu would stay held once the game resumes
+	if ((!menus.empty() || paused) && ev >= event::ReleaseLeft) {
+		field.handle_event(ev);
+		recording.add(ev);
 	}
 
-	else if (field.updates & changes::WallHit) {
-		Mix_PlayChannel(-1, sfx.wallhit, 0);
+	if (!menus.empty()) {
+		menus.back().handle_event(this, ev);
+		needs_redraw = true;
+	}
+
+	else if (!paused) {
+		field.handle_event(ev);
+		recording.add(ev);
+
+		uint64_t taken = SDL_GetPerformanceCounter() - stamp;
+		latency.total += taken;
+		latency.worst = (taken > latency.worst)? taken : latency.worst;
+		latency.count++;
 	}
+
+	return true;
 }
 
 int sdl2_frontend::run(void){
-	event ev;
+	typedef fine_field_state::rules rules;
+
+	const uint64_t freq = SDL_GetPerformanceFrequency();
+	const uint64_t period = freq / rules::tick_rate;
+	// when the next tick that hasn't been run yet is due
+	uint64_t next_tick = SDL_GetPerformanceCounter() + period;
+	bool running = true;
+
+	field.handling.enabled = true;
+	recording.begin(field, replay_rules);
+	SDL_AddEventWatch(input_watch, this);
+	poll_assets();
 	redraw();
 
-	while ((ev = get_event()) != event::Quit) {
-		if (ev == event::Pause) {
-			// TODO: pop up game menu when playing, and don't actually pause in
-			//       multiplayer games
-			menus.push_back(main_menu());
-			paused = !paused;
+	auto taken = std::chrono::steady_clock::now() - startup;
+	printf("startup: first frame after %.1f ms\n",
+	       std::chrono::duration<double, std::milli>(taken).count());
+
+	while (running) {
+		uint64_t now = SDL_GetPerformanceCounter();
+		bool playing = menus.empty() && !paused;
+
+		// sleep until the board can next change, nothing needs drawing
+		// before then. Being woken a little late doesn't matter, ticks
+		// and inputs are ordered by when they were due, not when they run.
+		unsigned ahead = playing? field.next_event() : fine_field_state::no_event;
+		ahead = (ahead < rules::tick_rate / 10)? ahead : rules::tick_rate / 10;
+
+		uint64_t wake = next_tick + (ahead - 1) * period;
+		unsigned wait = (wake > now)? ((wake - now) * 1000 + freq - 1) / freq : 0;
+
+		// keep checking on assets until they've all arrived
+		if (!assets_ready && wait > 5) {
+			wait = 5;
 		}
 
-		if (!menus.empty() && ev != event::NullEvent) {
-			menus.back().handle_event(this, ev);
-			redraw();
+		// a line clear animating wants frames, nothing else will ask
+		if (clears.running(seconds_now())) {
+			wait = (wait > 16)? 16 : wait;
+			needs_redraw = true;
+		}
+
+		running = pump_events(wait);
+		poll_assets();
+		now = SDL_GetPerformanceCounter();
+
+		// don't try to catch up after being stalled, eg. by a window drag
+		if (now > next_tick + rules::tick_rate / 4 * period) {
+			next_tick = now;
 		}
 
-		else if (!paused) {
-			field.handle_event(event::Tick);
-			field.handle_event(ev);
+		while (running) {
+			timed_event *in = input.front();
+			uint64_t until = in? in->stamp : now;
 
-			play_sfx();
+			// run every tick that was due before the input was pressed, so
+			// it lands on the same tick however frames line up
+			if (until >= next_tick) {
+				uint64_t ticks = (until - next_tick) / period + 1;
 
-			if (field.updates & changes::Updated) {
-				redraw();
+				if (menus.empty() && !paused) {
+					field.advance(ticks);
+					recording.advance(ticks);
+				}
+
+				next_tick += ticks * period;
 			}
+
+			if (!in) {
+				break;
+			}
+
+			timed_event cur = *in;
+			input.pop_front();
+			running = handle_input(cur.ev, cur.stamp);
+		}
+
+		play_sfx();
+
+		if (field.updates & changes::Locked) {
+			show_pc_hint = false;
+		}
+
+		track_history();
+
+		if ((field.updates & changes::Updated) || needs_redraw) {
+			redraw();
+			needs_redraw = false;
 		}
 
 		field.updates = 0;
-		SDL_Delay(10);
+	}
+
+	SDL_DelEventWatch(input_watch, this);
+
+	if (latency.count) {
+		printf("input latency: avg %.3f ms, worst %.3f ms over %lu inputs, %lu dropped\n",
+		       1000.0 * latency.total / latency.count / freq,
+		       1000.0 * latency.worst / freq,
+		       latency.count, latency.dropped);
+	}
+
+	unsigned long played = audio->latency.played;
+
+	if (played) {
+		// the time from trigger to being mixed, the device buffer adds at
+		// most another buffer's worth on top
+		printf("sfx latency: avg %.3f ms, worst %.3f ms over %lu effects, %lu dropped, "
+		       "plus %.3f ms buffer\n",
+		       1000.0 * audio->latency.total / played / freq,
+		       1000.0 * audio->latency.worst / freq,
+		       played, audio->latency.dropped.load(),
+		       1000.0 * audio->buffer_frames() / audio->sample_rate());
+	}
+
+	if (!history.empty()) {
+		printf("rewind history: placements %lu-%lu kept, %lu keyframes, %.1f KiB\n",
+		       history.first(), history.last(), history.keyframes(),
+		       history.memory_used() / 1024.0);
+	}
+
+	if (!record_path.empty()) {
+		if (recording.save(record_path)) {
+			printf("replay: %lu inputs over %.1f s saved to %s\n",
+			       (unsigned long)recording.inputs.size(),
+			       (double)recording.length / rules::tick_rate, record_path.c_str());
+
+		} else {
+			fprintf(stderr, "couldn't save replay to %s\n", record_path.c_str());
+		}
+	}
+
+	if (stats.pieces) {
+		printf("game: %u pieces in %.1f s, %.2f pps, %.2f inputs/piece, "
+		       "%u/%u finesse faults, %.1f s in line clears\n",
+		       stats.pieces, stats.seconds(), stats.pieces_per_second(),
+		       stats.inputs_per_piece(), stats.finesse_faults,
+		       stats.finesse_checked, (double)stats.clear_ticks / stats.tick_rate);
 	}
 
 	return 0;
 }
 
+int sdl2_frontend::run_grid(unsigned n){
+	static const event moves[] = {
+		event::MoveLeft, event::MoveRight, event::RotateLeft,
+		event::RotateRight, event::MoveDown, event::Drop,
+	};
+
+	uint32_t rng = 0x2545f491;
+	bool dirty = true;
+
+	grid.reset(new sdl2_grid_renderer(renderer));
+
+	for (unsigned i = 0; i < n || i == 0; i++) {
+		grid_boards.push_back(field_state(10, 40, i + 1));
+	}
+
+	while (true) {
+		SDL_Event e;
+
+		while (SDL_PollEvent(&e)) {
+			if (e.type == SDL_QUIT
+			    || (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_q))
+			{
+				return 0;
+			}
+
+			if (e.type == SDL_WINDOWEVENT
+			    && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+			{
+				update_layout();
+				dirty = true;
+			}
+		}
+
+		if (dirty || grid->needs_layout(grid_boards.size())) {
+			grid->layout(window_w, window_h, grid_boards.size(), grid_boards[0].size);
+			dirty = false;
+		}
+
+		for (unsigned i = 0; i < grid_boards.size(); i++) {
+			field_state& board = grid_boards[i];
+
+			if (board.topped_out) {
+				board = field_state(10, 40, rng);
+			}
+
+			// mash a key every so often so there's something to watch
+			rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+
+			board.handle_event(event::Tick);
+			if (rng % 16 == 0) {
+				board.handle_event(moves[(rng >> 4) % 6]);
+			}
+
+			board.updates = 0;
+		}
+
+		clear();
+		grid->draw(grid_boards);
+		present();
+
+		SDL_Delay(10);
+	}
+}
+
 // namespace tetrode
 }
 
+static void usage(const char *name){
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"    --grid N         watch N bot games side by side instead of playing\n"
+		"    --das MS         delay before a held direction repeats\n"
+		"    --arr MS         time between repeats, 0 slides to the wall\n"
+		"    --soft-drop MS   time between steps while down is held\n"
+		"    --audio-buffer N audio buffer in sample frames (default: 256)\n"
+		"    --stats PATH     append a line of JSON per game\n"
+		"    --record PATH    save a replay of the game, for tetrode-render\n",
+		name);
+}
+
 int main(int argc, char *argv[]){
-	tetrode::sdl2_frontend foo;
+	const unsigned rate = tetrode::fine_field_state::rules::tick_rate;
+	auto handling = tetrode::fine_field_state().handling;
+	unsigned audio_buffer = 256;
+	unsigned grid = 0;
+	const char *stats_path = NULL;
+	const char *record_path = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+
+		// every option takes a value
+		if (i + 1 >= argc) {
+			usage(argv[0]);
+			return 1;
+
+		} else if (arg == "--grid") {
+			grid = atoi(argv[++i]);
+
+		// handling settings are given in milliseconds
+		} else if (arg == "--das") {
+			handling.das = atoi(argv[++i]) * rate / 1000;
+
+		} else if (arg == "--arr") {
+			handling.arr = atoi(argv[++i]) * rate / 1000;
+
+		} else if (arg == "--soft-drop") {
+			handling.soft_drop = atoi(argv[++i]) * rate / 1000;
+
+		// in sample frames, smaller is lower latency but risks underruns
+		} else if (arg == "--audio-buffer") {
+			audio_buffer = atoi(argv[++i]);
+
+		// appends a line of JSON per game
+		} else if (arg == "--stats") {
+			stats_path = argv[++i];
+
+		} else if (arg == "--record") {
+			record_path = argv[++i];
+
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	tetrode::sdl2_frontend foo(audio_buffer);
+
+	if (grid) {
+		return foo.run_grid(grid);
+	}
+
+	foo.field.handling = handling;
+	foo.record_path = record_path? record_path : "";
 	foo.run();
+
+	if (stats_path) {
+		FILE *out = fopen(stats_path, "a");
+
+		if (!out) {
+			fprintf(stderr, "couldn't open %s\n", stats_path);
+			return 1;
+		}
+
+		foo.stats.write_json(out);
+		fclose(out);
+	}
+
 	return 0;
 }
@@ -0,0 +1,114 @@
+#include <tetrode/sdl2_grid_renderer.hpp>
+#include <tetrode/sdl2_frontend.hpp>
+
+#include <math.h>
+
+namespace tetrode {
+
+sdl2_grid_renderer::sdl2_grid_renderer(SDL_Renderer *rend){
+	renderer = rend;
+}
+
+void sdl2_grid_renderer::layout(int w, int h, unsigned boards, coord_2d size){
+	laid_out = boards;
+	visible_rows = size.y / 2 + 1;
+	origins.clear();
+
+	if (boards == 0 || w <= 0 || h <= 0) {
+		return;
+	}
+
+	// one cell of padding around each board, try every column count and
+	// keep whichever gives the biggest cells
+	unsigned best_cols = 1;
+	float best = 0;
+
+	for (unsigned cols = 1; cols <= boards; cols++) {
+		unsigned rows = (boards + cols - 1) / cols;
+		float cell = fminf((float)w / (cols * (size.x + 1)),
+		                   (float)h / (rows * (visible_rows + 1)));
+
+		if (cell > best) {
+			best = cell;
+			best_cols = cols;
+		}
+	}
+
+	full_size = floorf(best);
+	filled_size = (full_size > 4)? full_size - 1 : full_size;
+
+	for (unsigned i = 0; i < boards; i++) {
+		SDL_FPoint p;
+		p.x = (i % best_cols) * (size.x + 1) * full_size + full_size / 2;
+		p.y = (i / best_cols) * (visible_rows + 1) * full_size + full_size / 2;
+		origins.push_back(p);
+	}
+
+	// the index pattern is the same for every quad, so it only has to be
+	// built when the lobby gets bigger
+	size_t quads = boards * (size.x * visible_rows + 4);
+
+	for (size_t q = indices.size() / 6; q < quads; q++) {
+		int base = q * 4;
+
+		for (int k : { 0, 1, 2, 2, 1, 3 }) {
+			indices.push_back(base + k);
+		}
+	}
+
+	vertices.reserve(quads * 4);
+}
+
+void sdl2_grid_renderer::push_quad(float x, float y, float size, const SDL_Color& color){
+	SDL_Vertex v;
+	v.color = color;
+	v.tex_coord.x = v.tex_coord.y = 0;
+
+	v.position.x = x;        v.position.y = y;        vertices.push_back(v);
+	v.position.x = x + size; v.position.y = y;        vertices.push_back(v);
+	v.position.x = x;        v.position.y = y + size; vertices.push_back(v);
+	v.position.x = x + size; v.position.y = y + size; vertices.push_back(v);
+}
+
+void sdl2_grid_renderer::push_board(field_state& board, float ox, float oy){
+	const int top = visible_rows - 1;
+
+	for (int y = top; y >= 0; y--) {
+		float sy = oy + (top - y) * full_size;
+		auto& row = board.field[y];
+
+		for (int x = 0; x < board.size.x; x++) {
+			push_quad(ox + x * full_size, sy, filled_size, block_palette[row[x].state]);
+		}
+	}
+
+	auto& active = board.active;
+
+	for (auto& block : active.first.blocks) {
+		int x = block.second.x + active.second.x;
+		int y = block.second.y + active.second.y;
+
+		if (y <= top) {
+			push_quad(ox + x * full_size, oy + (top - y) * full_size,
+			          filled_size, block_palette[block.first.state]);
+		}
+	}
+}
+
+void sdl2_grid_renderer::draw(std::vector<field_state>& boards){
+	vertices.clear();
+
+	for (size_t i = 0; i < boards.size() && i < origins.size(); i++) {
+		push_board(boards[i], origins[i].x, origins[i].y);
+	}
+
+	if (vertices.empty()) {
+		return;
+	}
+
+	SDL_RenderGeometry(renderer, NULL, vertices.data(), vertices.size(),
+	                   indices.data(), vertices.size() / 4 * 6);
+}
+
+// namespace tetrode
+}
@@ -0,0 +1,182 @@
+#include <tetrode/shm_bot.hpp>
+
+#include <new>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+namespace tetrode {
+
+// not FUTEX_PRIVATE_FLAG, the waiter is in another process
+static void futex_wait(std::atomic<uint32_t> *word, uint32_t val, unsigned timeout_us){
+	struct timespec ts;
+	ts.tv_sec = timeout_us / 1000000;
+	ts.tv_nsec = (timeout_us % 1000000) * 1000;
+
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, val,
+	        timeout_us? &ts : NULL, NULL, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t> *word){
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static shm_bot_layout *map_layout(const std::string& name, bool create){
+	int fd = shm_open(name.c_str(), create? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0600);
+
+	if (fd < 0) {
+		throw "shm_open()";
+	}
+
+	if (create && ftruncate(fd, sizeof(shm_bot_layout)) < 0) {
+		close(fd);
+		throw "ftruncate()";
+	}
+
+	void *ptr = mmap(NULL, sizeof(shm_bot_layout), PROT_READ | PROT_WRITE,
+	                 MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (ptr == MAP_FAILED) {
+		throw "mmap()";
+	}
+
+	return static_cast<shm_bot_layout*>(ptr);
+}
+
+shm_bot_host::shm_bot_host(const std::string& shm_name){
+	name = shm_name;
+	shm = new (map_layout(name, true)) shm_bot_layout();
+
+	shm->version = shm_bot_layout::version_value;
+	// written last, clients check it to know the layout's ready
+	__atomic_store_n(&shm->magic, (uint32_t)shm_bot_layout::magic_value, __ATOMIC_RELEASE);
+}
+
+shm_bot_host::~shm_bot_host(){
+	munmap(shm, sizeof(shm_bot_layout));
+	shm_unlink(name.c_str());
+}
+
+template <class field_t>
+void shm_bot_host::publish(field_t& field, uint32_t tick){
+	uint32_t seq = shm->obs_seq.load(std::memory_order_relaxed) + 1;
+	shm_observation& obs = shm->obs[seq & 1];
+
+	// the last publish has to be visible before this buffer starts
+	// changing, that's what tells readers of it to retry
+	std::atomic_thread_fence(std::memory_order_release);
+
+	field.save_state(snap);
+
+	unsigned width = (snap.size_x < shm_observation::max_width)? snap.size_x : shm_observation::max_width;
+	unsigned height = (snap.size_y < shm_observation::max_height)? snap.size_y : shm_observation::max_height;
+
+	obs.tick = tick;
+	obs.size_x = width;
+	obs.size_y = height;
+	obs.topped_out = snap.topped_out;
+	obs.clearing = snap.clear_ticks > 0;
+
+	for (unsigned y = 0; y < height; y++) {
+		memcpy(obs.cells[y], snap.cells.data() + y * snap.size_x, width);
+	}
+
+	obs.active_shape = snap.active_shape;
+	memcpy(obs.active_blocks, snap.active_blocks, sizeof(obs.active_blocks));
+	obs.active_x = snap.active_x;
+	obs.active_y = snap.active_y;
+
+	obs.queue_len = snap.queue_len;
+	memcpy(obs.queue, snap.queue, sizeof(obs.queue));
+	obs.hold_shape = snap.hold_shape;
+	obs.have_held = snap.have_held;
+
+	obs.score = snap.score;
+	obs.lines_cleared = snap.lines_cleared;
+	obs.level = snap.level;
+
+	shm->obs_seq.store(seq, std::memory_order_release);
+	futex_wake(&shm->obs_seq);
+}
+
+bool shm_bot_host::poll_input(shm_bot_input& input){
+	uint32_t head = shm->input_head.load(std::memory_order_relaxed);
+
+	if (head == shm->input_tail.load(std::memory_order_acquire)) {
+		return false;
+	}
+
+	input = shm->inputs[head % shm_bot_layout::ring_size];
+	shm->input_head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+void shm_bot_host::wait_input(unsigned timeout_us){
+	uint32_t tail = shm->input_tail.load(std::memory_order_acquire);
+
+	if (tail == shm->input_head.load(std::memory_order_relaxed)) {
+		futex_wait(&shm->input_tail, tail, timeout_us);
+	}
+}
+
+shm_bot_client::shm_bot_client(const std::string& name){
+	shm = map_layout(name, false);
+
+	if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != shm_bot_layout::magic_value
+	    || shm->version != shm_bot_layout::version_value)
+	{
+		munmap(shm, sizeof(shm_bot_layout));
+		throw "shm_bot_client: not a bot channel, or a different version";
+	}
+}
+
+shm_bot_client::~shm_bot_client(){
+	munmap(shm, sizeof(shm_bot_layout));
+}
+
+uint32_t shm_bot_client::wait_observation(uint32_t seen, shm_observation& out){
+	while (true) {
+		uint32_t seq = shm->obs_seq.load(std::memory_order_acquire);
+
+		if (seq == seen) {
+			futex_wait(&shm->obs_seq, seq, 0);
+			continue;
+		}
+
+		memcpy(&out, &shm->obs[seq & 1], sizeof(out));
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		// anything published since means the game may have moved on to
+		// overwriting this buffer while we copied it, go again
+		if (shm->obs_seq.load(std::memory_order_relaxed) == seq) {
+			return seq;
+		}
+	}
+}
+
+bool shm_bot_client::send(uint32_t tick, event ev){
+	uint32_t tail = shm->input_tail.load(std::memory_order_relaxed);
+
+	if (tail - shm->input_head.load(std::memory_order_acquire) >= shm_bot_layout::ring_size) {
+		return false;
+	}
+
+	shm->inputs[tail % shm_bot_layout::ring_size].tick = tick;
+	shm->inputs[tail % shm_bot_layout::ring_size].ev = ev;
+	shm->input_tail.store(tail + 1, std::memory_order_release);
+	futex_wake(&shm->input_tail);
+	return true;
+}
+
+template void shm_bot_host::publish(field_state&, uint32_t);
+template void shm_bot_host::publish(classic_field_state&, uint32_t);
+template void shm_bot_host::publish(twenty_g_field_state&, uint32_t);
+template void shm_bot_host::publish(fine_field_state&, uint32_t);
+
+// namespace tetrode
+}
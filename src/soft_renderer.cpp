@@ -0,0 +1,479 @@
+#include <tetrode/soft_renderer.hpp>
+
+#include <string.h>
+#include <stdio.h>
+
+namespace tetrode {
+
+// 5x7 bitmap font for ' ' to '~', a byte per column with bit 0 at the top
+static const uint8_t font[95][5] = {
+	{ 0x00, 0x00, 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x5f, 0x00, 0x00 },
+	{ 0x00, 0x07, 0x00, 0x07, 0x00 }, { 0x14, 0x7f, 0x14, 0x7f, 0x14 },
+	{ 0x24, 0x2a, 0x7f, 0x2a, 0x12 }, { 0x23, 0x13, 0x08, 0x64, 0x62 },
+	{ 0x36, 0x49, 0x55, 0x22, 0x50 }, { 0x00, 0x05, 0x03, 0x00, 0x00 },
+	{ 0x00, 0x1c, 0x22, 0x41, 0x00 }, { 0x00, 0x41, 0x22, 0x1c, 0x00 },
+	{ 0x08, 0x2a, 0x1c, 0x2a, 0x08 }, { 0x08, 0x08, 0x3e, 0x08, 0x08 },
+	{ 0x00, 0x50, 0x30, 0x00, 0x00 }, { 0x08, 0x08, 0x08, 0x08, 0x08 },
+	{ 0x00, 0x60, 0x60, 0x00, 0x00 }, { 0x20, 0x10, 0x08, 0x04, 0x02 },
+	{ 0x3e, 0x51, 0x49, 0x45, 0x3e }, { 0x00, 0x42, 0x7f, 0x40, 0x00 },
+	{ 0x42, 0x61, 0x51, 0x49, 0x46 }, { 0x21, 0x41, 0x45, 0x4b, 0x31 },
+	{ 0x18, 0x14, 0x12, 0x7f, 0x10 }, { 0x27, 0x45, 0x45, 0x45, 0x39 },
+	{ 0x3c, 0x4a, 0x49, 0x49, 0x30 }, { 0x01, 0x71, 0x09, 0x05, 0x03 },
+	{ 0x36, 0x49, 0x49, 0x49, 0x36 }, { 0x06, 0x49, 0x49, 0x29, 0x1e },
+	{ 0x00, 0x36, 0x36, 0x00, 0x00 }, { 0x00, 0x56, 0x36, 0x00, 0x00 },
+	{ 0x08, 0x14, 0x22, 0x41, 0x00 }, { 0x14, 0x14, 0x14, 0x14, 0x14 },
+	{ 0x00, 0x41, 0x22, 0x14, 0x08 }, { 0x02, 0x01, 0x51, 0x09, 0x06 },
+	{ 0x32, 0x49, 0x79, 0x41, 0x3e }, { 0x7e, 0x11, 0x11, 0x11, 0x7e },
+	{ 0x7f, 0x49, 0x49, 0x49, 0x36 }, { 0x3e, 0x41, 0x41, 0x41, 0x22 },
+	{ 0x7f, 0x41, 0x41, 0x22, 0x1c }, { 0x7f, 0x49, 0x49, 0x49, 0x41 },
+	{ 0x7f, 0x09, 0x09, 0x09, 0x01 }, { 0x3e, 0x41, 0x49, 0x49, 0x7a },
+	{ 0x7f, 0x08, 0x08, 0x08, 0x7f }, { 0x00, 0x41, 0x7f, 0x41, 0x00 },
+	{ 0x20, 0x40, 0x41, 0x3f, 0x01 }, { 0x7f, 0x08, 0x14, 0x22, 0x41 },
+	{ 0x7f, 0x40, 0x40, 0x40, 0x40 }, { 0x7f, 0x02, 0x0c, 0x02, 0x7f },
+	{ 0x7f, 0x04, 0x08, 0x10, 0x7f }, { 0x3e, 0x41, 0x41, 0x41, 0x3e },
+	{ 0x7f, 0x09, 0x09, 0x09, 0x06 }, { 0x3e, 0x41, 0x51, 0x21, 0x5e },
+	{ 0x7f, 0x09, 0x19, 0x29, 0x46 }, { 0x46, 0x49, 0x49, 0x49, 0x31 },
+	{ 0x01, 0x01, 0x7f, 0x01, 0x01 }, { 0x3f, 0x40, 0x40, 0x40, 0x3f },
+	{ 0x1f, 0x20, 0x40, 0x20, 0x1f }, { 0x3f, 0x40, 0x38, 0x40, 0x3f },
+	{ 0x63, 0x14, 0x08, 0x14, 0x63 }, { 0x07, 0x08, 0x70, 0x08, 0x07 },
+	{ 0x61, 0x51, 0x49, 0x45, 0x43 }, { 0x00, 0x7f, 0x41, 0x41, 0x00 },
+	{ 0x02, 0x04, 0x08, 0x10, 0x20 }, { 0x00, 0x41, 0x41, 0x7f, 0x00 },
+	{ 0x04, 0x02, 0x01, 0x02, 0x04 }, { 0x40, 0x40, 0x40, 0x40, 0x40 },
+	{ 0x00, 0x01, 0x02, 0x04, 0x00 }, { 0x20, 0x54, 0x54, 0x54, 0x78 },
+	{ 0x7f, 0x48, 0x44, 0x44, 0x38 }, { 0x38, 0x44, 0x44, 0x44, 0x20 },
+	{ 0x38, 0x44, 0x44, 0x48, 0x7f }, { 0x38, 0x54, 0x54, 0x54, 0x18 },
+	{ 0x08, 0x7e, 0x09, 0x01, 0x02 }, { 0x0c, 0x52, 0x52, 0x52, 0x3e },
+	{ 0x7f, 0x08, 0x04, 0x04, 0x78 }, { 0x00, 0x44, 0x7d, 0x40, 0x00 },
+	{ 0x20, 0x40, 0x44, 0x3d, 0x00 }, { 0x7f, 0x10, 0x28, 0x44, 0x00 },
+	{ 0x00, 0x41, 0x7f, 0x40, 0x00 }, { 0x7c, 0x04, 0x18, 0x04, 0x78 },
+	{ 0x7c, 0x08, 0x04, 0x04, 0x78 }, { 0x38, 0x44, 0x44, 0x44, 0x38 },
+	{ 0x7c, 0x14, 0x14, 0x14, 0x08 }, { 0x08, 0x14, 0x14, 0x18, 0x7c },
+	{ 0x7c, 0x08, 0x04, 0x04, 0x08 }, { 0x48, 0x54, 0x54, 0x54, 0x20 },
+	{ 0x04, 0x3f, 0x44, 0x40, 0x20 }, { 0x3c, 0x40, 0x40, 0x20, 0x7c },
+	{ 0x1c, 0x20, 0x40, 0x20, 0x1c }, { 0x3c, 0x40, 0x30, 0x40, 0x3c },
+	{ 0x44, 0x28, 0x10, 0x28, 0x44 }, { 0x0c, 0x50, 0x50, 0x50, 0x3c },
+	{ 0x44, 0x64, 0x54, 0x4c, 0x44 }, { 0x00, 0x08, 0x36, 0x41, 0x00 },
+	{ 0x00, 0x00, 0x7f, 0x00, 0x00 }, { 0x00, 0x41, 0x36, 0x08, 0x00 },
+	{ 0x08, 0x04, 0x08, 0x10, 0x08 },
+};
+
+// pixels are R, G, B, A in memory whatever the byte order
+static uint32_t pack(uint8_t r, uint8_t g, uint8_t b){
+	const uint8_t bytes[4] = { r, g, b, 0xff };
+	uint32_t px;
+
+	memcpy(&px, bytes, sizeof(px));
+	return px;
+}
+
+// the same colors as block_palette in sdl2_frontend.cpp
+static const uint32_t palette[block::states::Orange + 1] = {
+	pack(0x11, 0x11, 0x11), // Empty
+	pack(0x22, 0x11, 0x11), // Reserved
+	pack(0x88, 0xaa, 0xdd), // Ghost
+	pack(0xf0, 0xdd, 0xf0), // Cleared
+
+	pack(0x22, 0x22, 0x22), // Garbage
+	pack(0x44, 0x88, 0xaa), // Cyan
+	pack(0xaa, 0xaa, 0x44), // Yellow
+	pack(0xaa, 0x44, 0xaa), // Purple
+	pack(0x44, 0xaa, 0x44), // Green
+	pack(0xaa, 0x44, 0x44), // Red
+	pack(0x44, 0x44, 0xaa), // Blue
+	pack(0xaa, 0x66, 0x44), // Orange
+};
+
+static const uint32_t background = pack(0x00, 0x00, 0x00);
+static const uint32_t text_color = pack(0xff, 0xff, 0xff);
+static const uint32_t label_color = pack(0x88, 0x88, 0x99);
+
+// cells either side of the board for the hold, queue and score
+static const unsigned panel_cells = 7;
+
+soft_renderer::soft_renderer(unsigned block, coord_2d size, unsigned threads){
+	block_full = block? block : 1;
+	block_filled = (block_full > 10)? block_full - 3 : block_full;
+	text_scale = (block_full >= 16)? block_full / 8 : 1;
+
+	// one extra row for the margin above and below the board
+	width  = (2 * panel_cells + size.x) * block_full;
+	height = (size.y / 2 + 2) * block_full;
+	width  += width & 1;
+	height += height & 1;
+
+	rgba.resize(width * height);
+	yuv.resize(width * height * 3 / 2);
+
+	tiles_x = (width + tile_size - 1) / tile_size;
+	tiles_y = (height + tile_size - 1) / tile_size;
+	rect_bins.resize(tiles_x * tiles_y);
+	glyph_bins.resize(tiles_x * tiles_y);
+
+	threads = threads? threads : std::thread::hardware_concurrency();
+
+	// the thread calling rasterize() fills tiles too
+	for (unsigned i = 1; i < threads; i++) {
+		pool.emplace_back(&soft_renderer::worker, this);
+	}
+}
+
+soft_renderer::~soft_renderer(){
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+	}
+
+	wake.notify_all();
+
+	for (auto& t : pool) {
+		t.join();
+	}
+}
+
+void soft_renderer::push_rect(int x, int y, int w, int h, uint32_t color){
+	rects.push_back(rect{x, y, x + w, y + h, color});
+}
+
+void soft_renderer::push_cell(int x, int y, enum block::states state){
+	push_rect(x, y, block_filled, block_filled, palette[state]);
+}
+
+void soft_renderer::push_piece(const tetrimino& tet, int x, int y){
+	for (auto& b : tet.blocks) {
+		push_cell(x + b.second.x * (int)block_full, y - b.second.y * (int)block_full,
+		          b.first.state);
+	}
+}
+
+void soft_renderer::push_text(int x, int y, const std::string& text, uint32_t color){
+	for (char c : text) {
+		if (c > ' ' && c <= '~') {
+			glyphs.push_back(glyph{x, y, (uint8_t)(c - ' '), color});
+		}
+
+		x += 6 * text_scale;
+	}
+}
+
+template <class field_t>
+void soft_renderer::draw(field_t& field, double seconds){
+	const int full = block_full;
+	const int rows = field.size.y / 2 + 1;
+	const int board_x = panel_cells * full;
+	const int board_y = full / 2;
+	const int line = 10 * text_scale;
+
+	rects.clear();
+	glyphs.clear();
+	push_rect(0, 0, width, height, background);
+
+	// field row y is drawn at screen row (rows - 1 - y), anything above
+	// the top row isn't shown
+	auto cell_at = [&](int x, int y, enum block::states state){
+		if (y < rows && x >= 0 && x < field.size.x) {
+			push_cell(board_x + x * full, board_y + (rows - 1 - y) * full, state);
+		}
+	};
+
+	for (int y = rows - 1; y >= 0; y--) {
+		for (int x = 0; x < field.size.x; x++) {
+			cell_at(x, y, field.field[y][x].state);
+		}
+	}
+
+	// rows that just cleared close up over whatever fell into them
+	clears.update(field, seconds);
+
+	for (int y = 0; clears.running(seconds) && y < rows; y++) {
+		int h = clears.left(y, seconds) * block_filled;
+
+		if (h > 0) {
+			push_rect(board_x, board_y + (rows - 1 - y) * full + (block_filled - h) / 2,
+			          field.size.x * full - (full - block_filled), h,
+			          palette[block::states::Cleared]);
+		}
+	}
+
+	if (!field.topped_out && field.clear_ticks == 0) {
+		auto& active = field.active;
+		coord_2d ghost = field.lower_collide_coord(active.first, active.second);
+
+		for (auto& b : active.first.blocks) {
+			cell_at(ghost.x + b.second.x, ghost.y + b.second.y, block::states::Ghost);
+		}
+
+		for (auto& b : active.first.blocks) {
+			cell_at(active.second.x + b.second.x, active.second.y + b.second.y,
+			        b.first.state);
+		}
+	}
+
+	// pieces in the side panels are drawn with their origin one cell in
+	// from the left and their top row just under the label
+	const int hold_x = full / 2;
+	const int queue_x = board_x + field.size.x * full + full / 2;
+	const int piece_top = board_y + line + full / 4 + full;
+
+	push_text(hold_x, board_y, "HOLD", label_color);
+
+	if (field.have_held) {
+		push_piece(field.hold, hold_x + full, piece_top);
+	}
+
+	push_text(queue_x, board_y, "NEXT", label_color);
+
+	unsigned shown = 0;
+
+	for (auto& next : field.next_pieces) {
+		if (shown == 5) {
+			break;
+		}
+
+		push_piece(next, queue_x + full, piece_top + shown++ * 3 * full);
+	}
+
+	char clock[32];
+	unsigned cs = seconds * 100;
+	snprintf(clock, sizeof(clock), "%u:%02u.%02u", cs / 6000, cs / 100 % 60, cs % 100);
+
+	const std::pair<const char*, std::string> hud[] = {
+		{ "SCORE", std::to_string(field.score) },
+		{ "LEVEL", std::to_string(field.level) },
+		{ "LINES", std::to_string(field.lines_cleared) },
+		{ "TIME",  clock },
+	};
+
+	int hud_y = piece_top + 2 * full;
+
+	for (auto& entry : hud) {
+		push_text(hold_x, hud_y, entry.first, label_color);
+		push_text(hold_x, hud_y + line, entry.second, text_color);
+		hud_y += 2 * line + line / 2;
+	}
+
+	if (field.topped_out) {
+		int text_w = 9 * 6 * text_scale;
+		push_text(board_x + (field.size.x * full - text_w) / 2,
+		          board_y + rows * full / 2, "GAME OVER", text_color);
+	}
+}
+
+void soft_renderer::bin(void){
+	for (auto& b : rect_bins) {
+		b.clear();
+	}
+
+	for (auto& b : glyph_bins) {
+		b.clear();
+	}
+
+	auto add = [&](std::vector<std::vector<uint32_t>>& bins, uint32_t index,
+	               int x0, int y0, int x1, int y1)
+	{
+		x0 = (x0 > 0)? x0 : 0;
+		y0 = (y0 > 0)? y0 : 0;
+		x1 = (x1 < (int)width)? x1 : width;
+		y1 = (y1 < (int)height)? y1 : height;
+
+		for (int ty = y0 / tile_size; ty * tile_size < y1; ty++) {
+			for (int tx = x0 / tile_size; tx * tile_size < x1; tx++) {
+				bins[ty * tiles_x + tx].push_back(index);
+			}
+		}
+	};
+
+	for (uint32_t i = 0; i < rects.size(); i++) {
+		auto& r = rects[i];
+		add(rect_bins, i, r.x0, r.y0, r.x1, r.y1);
+	}
+
+	for (uint32_t i = 0; i < glyphs.size(); i++) {
+		auto& g = glyphs[i];
+		add(glyph_bins, i, g.x, g.y, g.x + 5 * text_scale, g.y + 7 * text_scale);
+	}
+}
+
+void soft_renderer::rasterize(bool to_yuv){
+	bin();
+	want_yuv = to_yuv;
+
+	{
+		// tiles_done has to be reset before any tile can be taken
+		std::lock_guard<std::mutex> guard(lock);
+		tiles_done = 0;
+		next_tile = 0;
+		generation++;
+	}
+
+	wake.notify_all();
+	work();
+
+	std::unique_lock<std::mutex> guard(lock);
+	finished.wait(guard, [&]{ return tiles_done == tiles_x * tiles_y; });
+}
+
+void soft_renderer::work(void){
+	const unsigned tiles = tiles_x * tiles_y;
+	unsigned tile, drawn = 0;
+
+	while ((tile = next_tile.fetch_add(1, std::memory_order_relaxed)) < tiles) {
+		draw_tile(tile);
+		drawn++;
+	}
+
+	if (drawn) {
+		std::lock_guard<std::mutex> guard(lock);
+		tiles_done += drawn;
+
+		if (tiles_done == tiles) {
+			finished.notify_one();
+		}
+	}
+}
+
+void soft_renderer::worker(void){
+	unsigned long seen = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [&]{ return quit || generation != seen; });
+
+			if (quit) {
+				return;
+			}
+
+			seen = generation;
+		}
+
+		work();
+	}
+}
+
+void soft_renderer::draw_tile(unsigned tile){
+	// locals, stores through the pixel pointers could otherwise alias
+	// the members and force them to be reloaded every pixel
+	const int w = width, h = height;
+	uint32_t *pixels = rgba.data();
+
+	const int tx0 = tile % tiles_x * tile_size;
+	const int ty0 = tile / tiles_x * tile_size;
+	const int tx1 = (tx0 + tile_size < w)? tx0 + tile_size : w;
+	const int ty1 = (ty0 + tile_size < h)? ty0 + tile_size : h;
+
+	auto fill = [&](int x0, int y0, int x1, int y1, uint32_t color){
+		x0 = (x0 > tx0)? x0 : tx0;
+		y0 = (y0 > ty0)? y0 : ty0;
+		x1 = (x1 < tx1)? x1 : tx1;
+		y1 = (y1 < ty1)? y1 : ty1;
+
+		for (int y = y0; y < y1; y++) {
+			uint32_t *row = pixels + y * w;
+
+			for (int x = x0; x < x1; x++) {
+				row[x] = color;
+			}
+		}
+	};
+
+	for (uint32_t i : rect_bins[tile]) {
+		auto& r = rects[i];
+		fill(r.x0, r.y0, r.x1, r.y1, r.color);
+	}
+
+	const int s = text_scale;
+
+	for (uint32_t i : glyph_bins[tile]) {
+		auto& g = glyphs[i];
+
+		for (int col = 0; col < 5; col++) {
+			for (int row = 0; row < 7; row++) {
+				if ((font[g.ch][col] >> row) & 1) {
+					int x = g.x + col * s, y = g.y + row * s;
+					fill(x, y, x + s, y + s, g.color);
+				}
+			}
+		}
+	}
+
+	if (!want_yuv) {
+		return;
+	}
+
+	// tiles start on even pixels and the frame is even sized, so every
+	// 2x2 chroma block is inside one tile. Frames are mostly flat runs of
+	// a few colors, so a block of one color reuses the last conversion.
+	uint8_t *y_plane = yuv.data();
+	uint8_t *u_plane = y_plane + w * h;
+	uint8_t *v_plane = u_plane + (w / 2) * (h / 2);
+
+	uint32_t last = 0;
+	uint8_t last_y = 16, last_u = 128, last_v = 128;
+	bool have_last = false;
+
+	auto convert = [&](uint32_t px, int& r, int& g, int& b){
+		uint8_t c[4];
+		memcpy(c, &px, sizeof(c));
+
+		r = c[0];
+		g = c[1];
+		b = c[2];
+		return (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+	};
+
+	for (int y = ty0; y < ty1; y += 2) {
+		const uint32_t *top = pixels + y * w;
+		const uint32_t *bottom = top + w;
+		uint8_t *luma = y_plane + y * w;
+		uint8_t *u = u_plane + (y / 2) * (w / 2);
+		uint8_t *v = v_plane + (y / 2) * (w / 2);
+
+		for (int x = tx0; x < tx1; x += 2) {
+			const uint32_t quad[4] = { top[x], top[x + 1], bottom[x], bottom[x + 1] };
+
+			if (quad[0] == quad[1] && quad[0] == quad[2] && quad[0] == quad[3]) {
+				if (!have_last || quad[0] != last) {
+					int r, g, b;
+
+					last = quad[0];
+					last_y = convert(last, r, g, b);
+					last_u = (-38 * r - 74 * g + 112 * b + 128 + (128 << 8)) >> 8;
+					last_v = (112 * r - 94 * g - 18 * b + 128 + (128 << 8)) >> 8;
+					have_last = true;
+				}
+
+				luma[x] = luma[x + 1] = luma[w + x] = luma[w + x + 1] = last_y;
+				u[x / 2] = last_u;
+				v[x / 2] = last_v;
+				continue;
+			}
+
+			int r = 0, g = 0, b = 0;
+
+			for (int k = 0; k < 4; k++) {
+				int pr, pg, pb;
+
+				luma[(k / 2) * w + x + k % 2] = convert(quad[k], pr, pg, pb);
+				r += pr;
+				g += pg;
+				b += pb;
+			}
+
+			r /= 4;
+			g /= 4;
+			b /= 4;
+
+			u[x / 2] = (-38 * r - 74 * g + 112 * b + 128 + (128 << 8)) >> 8;
+			v[x / 2] = (112 * r - 94 * g - 18 * b + 128 + (128 << 8)) >> 8;
+		}
+	}
+}
+
+template void soft_renderer::draw(field_state&, double);
+template void soft_renderer::draw(classic_field_state&, double);
+template void soft_renderer::draw(twenty_g_field_state&, double);
+template void soft_renderer::draw(fine_field_state&, double);
+template void soft_renderer::draw(zero_delay_field_state&, double);
+
+// namespace tetrode
+}
@@ -0,0 +1,172 @@
+#include <tetrode/spectator.hpp>
+#include <tetrode/wire.hpp>
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+namespace tetrode {
+
+spectator_service::spectator_service(unsigned interval, unsigned queue){
+	keyframe_interval = interval? interval : 1;
+	max_queue = queue? queue : 1;
+}
+
+spectator_service::~spectator_service(){
+	for (auto& sub : subs) {
+		close(sub.fd);
+	}
+}
+
+void spectator_service::add_subscriber(int fd){
+	int flags = fcntl(fd, F_GETFL);
+	fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+	subscriber sub;
+	sub.fd = fd;
+	subs.push_back(sub);
+}
+
+void spectator_service::accept_from(int listen_fd){
+	int fd;
+
+	while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		add_subscriber(fd);
+	}
+}
+
+spectator_frame_ptr spectator_service::make_frame(uint32_t tick, bool keyframe){
+	std::shared_ptr<spectator_frame> frame = std::make_shared<spectator_frame>();
+
+	frame->tick = tick;
+	frame->keyframe = keyframe;
+	frame->data.resize(4);
+
+	size_t len = keyframe? wire::encode(cur, frame->data)
+	                     : wire::encode_delta(prev, cur, frame->data);
+
+	for (unsigned i = 0; i < 4; i++) {
+		frame->data[i] = len >> (8 * i);
+	}
+
+	stats.frames++;
+	stats.keyframes += keyframe;
+	stats.bytes_encoded += frame->data.size();
+
+	return frame;
+}
+
+void spectator_service::drop_queue(subscriber& sub){
+	size_t keep = (sub.offset > 0)? 1 : 0;
+	sub.queue.resize(std::min(keep, sub.queue.size()));
+}
+
+void spectator_service::publish(field_state& field, uint32_t tick){
+	field.save_state(cur);
+
+	bool want_key = !have_prev || tick - last_keyframe >= keyframe_interval;
+	for (auto& sub : subs) {
+		want_key |= sub.needs_keyframe;
+	}
+
+	spectator_frame_ptr key, delta;
+
+	if (want_key) {
+		key = make_frame(tick, true);
+		last_keyframe = tick;
+	}
+
+	// viewers that are in sync always get deltas, even on keyframe ticks,
+	// so their bandwidth stays flat
+	if (have_prev) {
+		delta = make_frame(tick, false);
+	}
+
+	for (auto& sub : subs) {
+		if (sub.needs_keyframe) {
+			drop_queue(sub);
+			sub.queue.push_back(key);
+			sub.needs_keyframe = false;
+
+		} else if (sub.queue.size() >= max_queue) {
+			// too far behind, skip ahead to the next keyframe
+			drop_queue(sub);
+			sub.needs_keyframe = true;
+			stats.resyncs++;
+
+		} else {
+			sub.queue.push_back(delta? delta : key);
+		}
+	}
+
+	// the old snapshot's buffers get reused for the next save_state()
+	std::swap(prev, cur);
+	have_prev = true;
+}
+
+void spectator_service::flush(void){
+	for (size_t i = 0; i < subs.size();) {
+		subscriber& sub = subs[i];
+		bool failed = false;
+
+		while (!sub.queue.empty()) {
+			struct iovec iov[64];
+			struct msghdr msg = {};
+			size_t total = 0;
+			unsigned n = 0;
+
+			for (auto& frame : sub.queue) {
+				if (n == 64) {
+					break;
+				}
+
+				size_t skip = n? 0 : sub.offset;
+				iov[n].iov_base = const_cast<uint8_t*>(frame->data.data()) + skip;
+				iov[n].iov_len  = frame->data.size() - skip;
+				total += iov[n].iov_len;
+				n++;
+			}
+
+			// sendmsg() rather than writev() to get MSG_NOSIGNAL
+			msg.msg_iov = iov;
+			msg.msg_iovlen = n;
+			ssize_t sent = sendmsg(sub.fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+			if (sent < 0) {
+				failed = errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+				break;
+			}
+
+			stats.bytes_sent += sent;
+
+			// retire whole frames, remember how far into the next we got
+			size_t left = sent + sub.offset;
+			while (!sub.queue.empty() && left >= sub.queue.front()->data.size()) {
+				left -= sub.queue.front()->data.size();
+				sub.queue.pop_front();
+			}
+
+			sub.offset = left;
+
+			// socket buffer's full, try again next flush
+			if ((size_t)sent < total) {
+				break;
+			}
+		}
+
+		if (failed) {
+			close(sub.fd);
+			subs.erase(subs.begin() + i);
+			stats.disconnects++;
+			continue;
+		}
+
+		i++;
+	}
+}
+
+// namespace tetrode
+}
@@ -0,0 +1,32 @@
+#include <tetrode/asset_pack.hpp>
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+// Bundles asset files into a single pack for tetrode-sdl to map at
+// startup, eg. tetrode-pack assets.pak assets fonts/x.ttf sfx/y.ogg
+
+int main(int argc, char *argv[]){
+	if (argc < 4) {
+		fprintf(stderr, "usage: %s output.pak root file...\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<std::string> names(argv + 3, argv + argc);
+
+	if (!tetrode::asset_pack::build(argv[1], argv[2], names)) {
+		fprintf(stderr, "%s: couldn't build %s\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	tetrode::asset_pack pack;
+
+	if (!pack.open(argv[1])) {
+		fprintf(stderr, "%s: %s doesn't read back\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	printf("packed %zu files into %s\n", names.size(), argv[1]);
+	return 0;
+}
@@ -0,0 +1,208 @@
+#include <tetrode/field_state.hpp>
+#include <tetrode/replay.hpp>
+#include <tetrode/soft_renderer.hpp>
+
+#include <chrono>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Plays a replay back and writes every frame of it as Y4M or raw RGBA,
+// eg. tetrode-render game.trpl | ffmpeg -i - clip.mp4
+// Nothing touches a window or a GPU, so it runs on any box.
+
+namespace {
+
+class options {
+	public:
+		unsigned fps = 60;
+		unsigned block = 24;
+		unsigned threads = 0;
+		bool raw = false;
+		// seconds of the final board after the last tick
+		double tail = 2;
+		const char *out = "-";
+};
+
+template <class field_t>
+int render(const tetrode::replay& rep, const options& opt){
+	const unsigned rate = field_t::rules::tick_rate;
+
+	field_t field(rep.start.size_x, rep.start.size_y);
+	rep.restore(field);
+
+	tetrode::soft_renderer renderer(opt.block, field.size, opt.threads);
+	FILE *out = (std::string(opt.out) == "-")? stdout : fopen(opt.out, "wb");
+
+	if (!out) {
+		fprintf(stderr, "couldn't open %s\n", opt.out);
+		return 1;
+	}
+
+	if (!opt.raw) {
+		fprintf(out, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n",
+		        renderer.width, renderer.height, opt.fps);
+	}
+
+	const uint64_t end = rep.length + (uint64_t)(opt.tail * rate);
+	size_t next = 0;
+	uint64_t tick = 0, frames = 0;
+	double sim_secs = 0, raster_secs = 0;
+	bool ok = true;
+
+	auto start = std::chrono::steady_clock::now();
+
+	// an event stamped with tick t went in after t ticks had run, so it
+	// shows up on a frame at t
+	auto run_to = [&](uint64_t until){
+		while (true) {
+			while (next < rep.inputs.size() && rep.inputs[next].tick == tick) {
+				field.handle_event(rep.inputs[next++].ev);
+			}
+
+			if (tick == until) {
+				break;
+			}
+
+			uint64_t stop = until;
+
+			if (next < rep.inputs.size() && rep.inputs[next].tick < until) {
+				stop = rep.inputs[next].tick;
+			}
+
+			field.advance(stop - tick);
+			tick = stop;
+		}
+	};
+
+	for (uint64_t f = 0; ok; f++) {
+		uint64_t at = f * rate / opt.fps;
+
+		if (at > end) {
+			break;
+		}
+
+		auto t0 = std::chrono::steady_clock::now();
+		run_to(at);
+
+		auto t1 = std::chrono::steady_clock::now();
+		renderer.draw(field, (double)((at < rep.length)? at : rep.length) / rate);
+		renderer.rasterize(!opt.raw);
+
+		auto t2 = std::chrono::steady_clock::now();
+		sim_secs += std::chrono::duration<double>(t1 - t0).count();
+		raster_secs += std::chrono::duration<double>(t2 - t1).count();
+
+		if (opt.raw) {
+			auto& px = renderer.rgba;
+			ok = fwrite(px.data(), sizeof(px[0]), px.size(), out) == px.size();
+
+		} else {
+			auto& px = renderer.yuv;
+			ok = fputs("FRAME\n", out) >= 0
+			  && fwrite(px.data(), 1, px.size(), out) == px.size();
+		}
+
+		frames++;
+	}
+
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	double length = (double)end / rate;
+
+	ok = (out == stdout)? fflush(out) == 0 && ok : fclose(out) == 0 && ok;
+
+	fprintf(stderr, "%lu frames (%ux%u) of %.1f s of play in %.2f s, %.1f fps, %.1fx "
+	        "real time (simulating %.2f s, drawing %.2f s)\n",
+	        (unsigned long)frames, renderer.width, renderer.height, length, secs,
+	        frames / secs, length / secs, sim_secs, raster_secs);
+
+	if (!ok) {
+		fprintf(stderr, "couldn't write all the frames\n");
+	}
+
+	return ok? 0 : 1;
+}
+
+typedef int (*render_fn)(const tetrode::replay&, const options&);
+
+class config {
+	public:
+		const char *name;
+		render_fn render;
+};
+
+// names replays are recorded under
+const config configs[] = {
+	{ "guideline",      render<tetrode::field_state> },
+	{ "classic",        render<tetrode::classic_field_state> },
+	{ "20g",            render<tetrode::twenty_g_field_state> },
+	{ "guideline-1000", render<tetrode::fine_field_state> },
+	{ "zero-delay",     render<tetrode::zero_delay_field_state> },
+};
+
+void usage(const char *name){
+	fprintf(stderr,
+		"usage: %s [options] replay\n"
+		"    --out FILE       where the video goes, - for stdout (default: -)\n"
+		"    --fps N          frames per second (default: 60)\n"
+		"    --block N        pixels per cell (default: 24)\n"
+		"    --threads N      raster threads (default: cores)\n"
+		"    --tail SECS      how long to hold the last frame (default: 2)\n"
+		"    --raw            raw RGBA frames instead of Y4M\n",
+		name);
+}
+
+// anonymous namespace
+}
+
+int main(int argc, char *argv[]){
+	options opt;
+
+	if (argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (int i = 1; i < argc - 1; i++) {
+		std::string arg = argv[i];
+
+		if (arg == "--raw") {
+			opt.raw = true;
+			continue;
+		}
+
+		if (i + 2 >= argc) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		if      (arg == "--out")     opt.out     = argv[++i];
+		else if (arg == "--fps")     opt.fps     = atoi(argv[++i]);
+		else if (arg == "--block")   opt.block   = atoi(argv[++i]);
+		else if (arg == "--threads") opt.threads = atoi(argv[++i]);
+		else if (arg == "--tail")    opt.tail    = atof(argv[++i]);
+
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	opt.fps = opt.fps? opt.fps : 1;
+
+	tetrode::replay rep;
+
+	if (!rep.load(argv[argc - 1])) {
+		fprintf(stderr, "%s: couldn't read replay %s\n", argv[0], argv[argc - 1]);
+		return 1;
+	}
+
+	for (auto& c : configs) {
+		if (rep.rules == c.name) {
+			return c.render(rep, opt);
+		}
+	}
+
+	fprintf(stderr, "%s: no rules called \"%s\"\n", argv[0], rep.rules.c_str());
+	return 1;
+}
@@ -0,0 +1,215 @@
+#include <tetrode/rollback.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Plays random versus games between two rollback sessions over a lossy
+// loopback link, checking both ends agree on every tick they confirm.
+
+static uint32_t xorshift32(uint32_t& state){
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static tetrode::event random_input(uint32_t& rng){
+	static const tetrode::event choices[] = {
+		tetrode::event::MoveLeft, tetrode::event::MoveRight,
+		tetrode::event::RotateLeft, tetrode::event::RotateRight,
+		tetrode::event::MoveDown, tetrode::event::Drop,
+	};
+
+	if (xorshift32(rng) % 6) {
+		return tetrode::event::NullEvent;
+	}
+
+	return choices[xorshift32(rng) % 6];
+}
+
+// checksum of a whole room, boards and garbage state
+static uint32_t checksum(const tetrode::match_room::snapshot& snap){
+	uint32_t ret = snap.ticks;
+
+	for (unsigned p = 0; p < 2; p++) {
+		ret = ret * 31 + snap.boards[p].checksum();
+		ret = ret * 31 + snap.pending_garbage[p];
+		ret = ret * 31 + snap.prev_lines[p];
+	}
+
+	return ret * 31 + snap.rng;
+}
+
+// checksums of every tick `s` has confirmed since the last call, while
+// they're still in its history
+static void collect(tetrode::rollback_session& s, std::vector<uint32_t>& sums){
+	while (sums.size() < s.current_tick && sums.size() <= s.confirmed) {
+		sums.push_back(checksum(s.saved_state(sums.size())));
+	}
+}
+
+struct totals {
+	unsigned long ticks;
+	unsigned long rollbacks;
+	unsigned long resimulated_ticks;
+	unsigned long stalls;
+	unsigned max_depth;
+	unsigned long max_resim_us;
+};
+
+static void add_stats(totals& t, tetrode::rollback_session& s){
+	t.ticks             += s.current_tick;
+	t.rollbacks         += s.stats.rollbacks;
+	t.resimulated_ticks += s.stats.resimulated_ticks;
+	t.stalls            += s.stats.stalls;
+	t.max_depth    = std::max(t.max_depth, s.stats.max_depth);
+	t.max_resim_us = std::max(t.max_resim_us, s.stats.max_resim_us);
+}
+
+static void print_stats(const char *name, const totals& t){
+	printf("%s: %lu ticks, rollbacks %lu, resimulated %lu ticks (max depth %u), "
+	       "stalls %lu, slowest resimulation %luus\n",
+	       name, t.ticks, t.rollbacks, t.resimulated_ticks,
+	       t.max_depth, t.stalls, t.max_resim_us);
+}
+
+struct link_options {
+	unsigned latency;
+	unsigned jitter;
+	unsigned loss;
+};
+
+// Plays one game until it's over or `ticks` run out, comparing the ends
+// on every confirmed tick. Returns the ticks played, 0 if the ends never
+// synchronized, and sets `desync` to the first tick they disagree on.
+static unsigned play(uint32_t seed, unsigned ticks, const link_options& opt,
+                     totals stats[2], uint32_t& desync)
+{
+	tetrode::loopback_link link(opt.latency, opt.jitter, opt.loss, seed);
+	tetrode::rollback_session a(0, seed, link.endpoint(0));
+	tetrode::rollback_session b(1, seed, link.endpoint(1));
+	std::vector<uint32_t> sums_a, sums_b;
+
+	uint32_t rng_a = seed * 3 + 1;
+	uint32_t rng_b = seed * 7 + 1;
+	tetrode::event in_a = random_input(rng_a);
+	tetrode::event in_b = random_input(rng_b);
+
+	// each "frame" both ends try to advance, stalled ends keep their input.
+	// Stops as soon as either end is done, the game over may only be
+	// predicted and the sync below settles it
+	while (a.current_tick < ticks && b.current_tick < ticks
+	       && !a.room.finished() && !b.room.finished())
+	{
+		if (a.advance(in_a)) {
+			in_a = random_input(rng_a);
+		}
+
+		if (b.advance(in_b)) {
+			in_b = random_input(rng_b);
+		}
+
+		link.tick();
+		collect(a, sums_a);
+		collect(b, sums_b);
+	}
+
+	// bring the ends to the same tick, then stop advancing and let them
+	// exchange packets until every input is confirmed on both sides
+	unsigned polls = 0;
+	while (!(a.synchronized() && b.synchronized()
+	         && a.current_tick == b.current_tick))
+	{
+		if (a.current_tick < b.current_tick) a.advance(tetrode::event::NullEvent);
+		else                                 a.poll();
+
+		if (b.current_tick < a.current_tick) b.advance(tetrode::event::NullEvent);
+		else                                 b.poll();
+
+		link.tick();
+		collect(a, sums_a);
+		collect(b, sums_b);
+
+		if (++polls > 100000) {
+			return 0;
+		}
+	}
+
+	add_stats(stats[0], a);
+	add_stats(stats[1], b);
+
+	desync = UINT32_MAX;
+	for (size_t t = 0; t < std::min(sums_a.size(), sums_b.size()); t++) {
+		if (sums_a[t] != sums_b[t]) {
+			desync = t;
+			return a.current_tick;
+		}
+	}
+
+	// and where they ended up
+	tetrode::match_room::snapshot end_a, end_b;
+	a.room.save_state(end_a);
+	b.room.save_state(end_b);
+
+	if (checksum(end_a) != checksum(end_b)) {
+		desync = a.current_tick;
+	}
+
+	return a.current_tick;
+}
+
+int main(int argc, char *argv[]){
+	unsigned ticks = 6000;
+	link_options opt = { 8, 4, 10 };
+	uint32_t seed = 1234;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string arg = argv[i];
+		unsigned value = atoi(argv[i + 1]);
+
+		if      (arg == "--ticks")   ticks       = value;
+		else if (arg == "--latency") opt.latency = value;
+		else if (arg == "--jitter")  opt.jitter  = value;
+		else if (arg == "--loss")    opt.loss    = value;
+		else if (arg == "--seed")    seed        = value;
+		else {
+			fprintf(stderr, "usage: %s [--ticks N] [--latency TICKS] "
+			                "[--jitter TICKS] [--loss PERCENT] [--seed N]\n",
+			                argv[0]);
+			return 1;
+		}
+	}
+
+	totals stats[2] = {};
+	unsigned played = 0;
+	unsigned games = 0;
+
+	// a topped out game stops changing and would check nothing, so keep
+	// starting new ones until the ticks are used up
+	for (uint32_t game_seed = seed; played < ticks; games++) {
+		uint32_t desync;
+		unsigned n = play(game_seed, ticks - played, opt, stats, desync);
+
+		if (n == 0) {
+			fprintf(stderr, "sessions never synchronized\n");
+			return 1;
+		}
+
+		if (desync != UINT32_MAX) {
+			printf("game %u (seed %u): DESYNC at tick %u\n", games + 1, game_seed, desync);
+			return 1;
+		}
+
+		played += n;
+		game_seed = xorshift32(game_seed);
+	}
+
+	print_stats("player 0", stats[0]);
+	print_stats("player 1", stats[1]);
+	printf("%u games, %u ticks, every confirmed tick in sync\n", games, played);
+
+	return 0;
+}
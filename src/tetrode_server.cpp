@@ -0,0 +1,101 @@
+#include <tetrode/match_server.hpp>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+static volatile sig_atomic_t running = 1;
+
+static void handle_signal(int sig){
+	running = 0;
+}
+
+static void usage(const char *name){
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"    --unix PATH      listen on a unix socket\n"
+		"    --port PORT      listen on 127.0.0.1:PORT\n"
+		"    --threads N      number of shard threads (default: cores, max 8)\n"
+		"    --simulate N     host N socketless rooms with random inputs\n"
+		"    --seconds N      exit after N seconds\n",
+		name);
+}
+
+int main(int argc, char *argv[]){
+	std::string unix_path;
+	unsigned port = 0;
+	unsigned threads = std::min(std::thread::hardware_concurrency(), 8u);
+	unsigned simulate = 0;
+	unsigned seconds = 0;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+
+		if (i + 1 >= argc) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		if      (arg == "--unix")     unix_path = argv[++i];
+		else if (arg == "--port")     port      = atoi(argv[++i]);
+		else if (arg == "--threads")  threads   = atoi(argv[++i]);
+		else if (arg == "--simulate") simulate  = atoi(argv[++i]);
+		else if (arg == "--seconds")  seconds   = atoi(argv[++i]);
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (unix_path.empty() && port == 0 && simulate == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+
+	try {
+		tetrode::match_server server(threads);
+
+		if (!unix_path.empty()) server.listen_unix(unix_path);
+		if (port)               server.listen_tcp(port);
+		if (simulate)           server.simulate_rooms(simulate);
+
+		server.start();
+
+		auto last = server.get_stats();
+
+		for (unsigned elapsed = 0; running && (!seconds || elapsed < seconds); elapsed++) {
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+
+			auto cur = server.get_stats();
+			unsigned long ticks = cur.room_ticks - last.room_ticks;
+			unsigned long ns    = cur.tick_ns - last.tick_ns;
+
+			printf("rooms: %lu, clients: %lu, room ticks/s: %lu, "
+			       "ns/room tick: %.1f, bytes/room: %lu, dropped updates: %lu\n",
+			       cur.rooms, cur.connections, ticks,
+			       ticks? (double)ns / ticks : 0.0,
+			       cur.rooms? cur.room_bytes / cur.rooms : 0,
+			       cur.dropped_updates);
+			fflush(stdout);
+
+			last = cur;
+		}
+
+		server.stop();
+
+	} catch (const char *err) {
+		fprintf(stderr, "error: %s: %s\n", err, strerror(errno));
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,211 @@
+#include <tetrode/shm_bot.hpp>
+#include <tetrode/field_state.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Hosts a game for an external bot over shared memory, or benchmarks the
+// channel's round trip against a forked C++ bot.
+
+typedef std::chrono::steady_clock steady;
+
+static volatile sig_atomic_t running = 1;
+
+static void handle_signal(int sig){
+	running = 0;
+}
+
+static void usage(const char *name){
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"    --name NAME      shared memory object (default: /tetrode-bot)\n"
+		"    --serve          play a real time game for an external bot\n"
+		"    --seconds N      with --serve, stop after N seconds\n"
+		"    --bench N        time N observation/input round trips\n",
+		name);
+}
+
+// only what a player could press, same as match_server takes from
+// clients. Anything else, eg. Tick, would let the bot run the game.
+static bool gameplay_input(uint32_t ev){
+	return ev >= tetrode::event::RotateLeft && ev <= tetrode::event::Hold;
+}
+
+// the forked bot, answers every observation straight away
+static int bench_client(const std::string& name, unsigned rounds){
+	static const tetrode::event moves[] = {
+		tetrode::event::MoveLeft, tetrode::event::RotateRight,
+		tetrode::event::MoveRight, tetrode::event::Drop,
+	};
+
+	tetrode::shm_bot_client client(name);
+	tetrode::shm_observation obs;
+	uint32_t seq = 0;
+
+	for (unsigned i = 0; i < rounds; i++) {
+		seq = client.wait_observation(seq, obs);
+		client.send(obs.tick, moves[obs.tick % 4]);
+	}
+
+	return 0;
+}
+
+static int bench(const std::string& name, unsigned rounds){
+	tetrode::shm_bot_host host(name);
+	pid_t pid = fork();
+
+	if (pid < 0) {
+		perror("fork()");
+		return 1;
+
+	} else if (pid == 0) {
+		_exit(bench_client(name, rounds));
+	}
+
+	tetrode::field_state field(10, 40, 1);
+	tetrode::shm_bot_input input;
+	std::vector<double> times;
+	unsigned rejected = 0;
+	times.reserve(rounds);
+
+	for (uint32_t tick = 1; tick <= rounds; tick++) {
+		auto start = steady::now();
+		host.publish(field, tick);
+
+		// skip anything left over from an earlier tick
+		do {
+			while (!host.poll_input(input)) {
+				host.wait_input(100000);
+			}
+		} while (input.tick != tick);
+
+		if (gameplay_input(input.ev)) {
+			field.handle_event(static_cast<tetrode::event>(input.ev));
+
+		} else {
+			rejected++;
+		}
+
+		field.handle_event(tetrode::event::Tick);
+		times.push_back(std::chrono::duration<double, std::micro>(steady::now() - start).count());
+
+		if (field.topped_out) {
+			field = tetrode::field_state(10, 40, tick);
+		}
+	}
+
+	waitpid(pid, NULL, 0);
+	std::sort(times.begin(), times.end());
+
+	double total = 0;
+	for (double t : times) {
+		total += t;
+	}
+
+	printf("%u round trips: avg %.2f us, p50 %.2f us, p99 %.2f us, max %.2f us, "
+	       "%u inputs rejected\n",
+	       rounds, total / rounds, times[rounds / 2], times[rounds * 99 / 100],
+	       times.back(), rejected);
+
+	return 0;
+}
+
+static int serve(const std::string& name, unsigned seconds){
+	typedef tetrode::field_state::rules rules;
+
+	tetrode::shm_bot_host host(name);
+	tetrode::field_state field(10, 40, time(NULL));
+	tetrode::shm_bot_input input;
+
+	const auto period = std::chrono::microseconds(1000000 / rules::tick_rate);
+	const uint32_t last_tick = seconds? seconds * rules::tick_rate : ~0u;
+	auto next = steady::now();
+	uint32_t tick = 0;
+	unsigned rejected = 0;
+
+	printf("serving on %s, waiting for a bot\n", name.c_str());
+	host.publish(field, tick);
+
+	while (running && !field.topped_out && tick < last_tick) {
+		// sleep in the futex so inputs are picked up as they arrive
+		for (auto now = steady::now(); now < next; now = steady::now()) {
+			auto left = std::chrono::duration_cast<std::chrono::microseconds>(next - now);
+			host.wait_input(left.count() + 1);
+
+			while (host.poll_input(input)) {
+				if (gameplay_input(input.ev)) {
+					field.handle_event(static_cast<tetrode::event>(input.ev));
+
+				} else {
+					rejected++;
+				}
+			}
+		}
+
+		field.handle_event(tetrode::event::Tick);
+		field.updates = 0;
+		host.publish(field, ++tick);
+		next += period;
+	}
+
+	printf("game over after %u ticks: score %u, lines %u, level %u, %u inputs rejected\n",
+	       tick, field.score, field.lines_cleared, field.level, rejected);
+
+	return 0;
+}
+
+int main(int argc, char *argv[]){
+	std::string name = "/tetrode-bot";
+	unsigned rounds = 0;
+	unsigned seconds = 0;
+	bool serving = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+
+		if (arg == "--serve") {
+			serving = true;
+			continue;
+		}
+
+		if (i + 1 >= argc) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		if      (arg == "--name")    name    = argv[++i];
+		else if (arg == "--bench")   rounds  = atoi(argv[++i]);
+		else if (arg == "--seconds") seconds = atoi(argv[++i]);
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+
+	try {
+		if (rounds) {
+			return bench(name, rounds);
+
+		} else if (serving) {
+			return serve(name, seconds);
+		}
+
+	} catch (const char *err) {
+		fprintf(stderr, "%s: %s\n", argv[0], err);
+		return 1;
+	}
+
+	usage(argv[0]);
+	return 1;
+}
@@ -0,0 +1,232 @@
+#include <tetrode/pc_solver.hpp>
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Looks for a perfect clear from a board and queue given on the command
+// line and prints the placements with their finesse, or times the solver
+// over the opening bags of seeded games.
+
+static const char shape_names[] = "IOTSZJL";
+
+static const char *key_names[] = {
+	"left", "right", "das-left", "das-right",
+	"rotate-left", "rotate-right", "soft-drop", "hard-drop",
+};
+
+static void usage(const char *name){
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"    --board ROWS     top row first, rows split by '/', 'x' for a block,\n"
+		"                     eg. xxxx....xx/xxxx...xxx\n"
+		"    --queue PIECES   pieces from the one in play, eg. TIJLOSZ\n"
+		"    --hold PIECE     piece already in hold\n"
+		"    --no-hold        play without hold\n"
+		"    --lines N        tallest clear to look for (default: 4)\n"
+		"    --threads N      worker threads (default: cores)\n"
+		"    --bench N        time N seeded games' first bags on an empty board\n",
+		name);
+}
+
+static int shape_index(char c){
+	for (unsigned i = 0; shape_names[i]; i++) {
+		if (shape_names[i] == c) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static bool parse_board(const std::string& text, unsigned& width, std::vector<uint16_t>& rows){
+	std::vector<std::string> lines;
+	size_t start = 0;
+
+	while (start <= text.size()) {
+		size_t end = text.find('/', start);
+		end = (end == std::string::npos)? text.size() : end;
+		lines.push_back(text.substr(start, end - start));
+		start = end + 1;
+	}
+
+	width = lines[0].size();
+	rows.assign(lines.size(), 0);
+
+	for (unsigned i = 0; i < lines.size(); i++) {
+		if (lines[i].size() != width || width > 16) {
+			return false;
+		}
+
+		for (unsigned x = 0; x < width; x++) {
+			rows[lines.size() - 1 - i] |= (lines[i][x] != '.' && lines[i][x] != ' ') << x;
+		}
+	}
+
+	return true;
+}
+
+static void print_board(uint64_t cells, uint64_t piece, unsigned width, unsigned height){
+	for (int y = height - 1; y >= 0; y--) {
+		printf("    ");
+
+		for (unsigned x = 0; x < width; x++) {
+			uint64_t bit = 1ull << (y * width + x);
+			putchar((piece & bit)? '#' : (cells & bit)? 'x' : '.');
+		}
+
+		putchar('\n');
+	}
+}
+
+static void print_result(const tetrode::pc_solver::result& res, unsigned width,
+                         const std::vector<uint16_t>& rows)
+{
+	if (!res.found) {
+		printf("no perfect clear (%lu boards, %.1f ms)\n", res.nodes, res.ms);
+		return;
+	}
+
+	printf("%u line perfect clear in %zu pieces (%lu boards, %.1f ms)\n",
+	       res.lines, res.placements.size(), res.nodes, res.ms);
+
+	uint64_t cells = 0;
+	unsigned height = res.lines;
+
+	for (unsigned y = 0; y < rows.size() && y < height; y++) {
+		cells |= (uint64_t)rows[y] << (y * width);
+	}
+
+	const uint64_t full = (1ull << width) - 1;
+
+	for (auto& p : res.placements) {
+		printf("\n%c%s:", shape_names[p.shape], p.hold? " (from hold)" : "");
+
+		for (auto k : p.keys) {
+			printf(" %s", key_names[k]);
+		}
+
+		printf("\n");
+		print_board(cells, p.cells, width, height);
+
+		// same line clearing as the solver, so the next board lines up
+		// with the next placement's cells
+		cells |= p.cells;
+
+		for (unsigned y = 0; y < height;) {
+			if (((cells >> (y * width)) & full) != full) {
+				y++;
+				continue;
+			}
+
+			uint64_t below = cells & ((1ull << (y * width)) - 1);
+			uint64_t above = ((y + 1) * width < 64)? cells >> ((y + 1) * width) : 0;
+			cells = below | (above << (y * width));
+			height--;
+		}
+	}
+}
+
+static int bench(unsigned games, unsigned lines, unsigned threads){
+	tetrode::pc_solver solver(threads);
+	std::vector<uint16_t> rows;
+	unsigned found = 0;
+	double total = 0, worst = 0;
+
+	for (unsigned seed = 1; seed <= games; seed++) {
+		tetrode::field_state field(10, 40, seed);
+
+		// the preview only goes one bag ahead and an opening clear needs
+		// ten pieces and a spare for hold, so drop pieces to see more,
+		// emptying the board each time
+		std::vector<uint8_t> queue;
+
+		while (queue.size() < 11 && !field.topped_out) {
+			queue.push_back(field.active.first.shape);
+			field.handle_event(tetrode::event::Drop);
+
+			for (auto& row : field.field) {
+				row.assign(row.size(), tetrode::block());
+			}
+
+			field.advance(100);
+		}
+
+		auto res = solver.solve(rows, 10, queue, -1, true, lines);
+		found += res.found;
+		total += res.ms;
+		worst = (res.ms > worst)? res.ms : worst;
+	}
+
+	printf("%u boards: %u cleared, avg %.1f ms, worst %.1f ms\n",
+	       games, found, total / games, worst);
+
+	return 0;
+}
+
+int main(int argc, char *argv[]){
+	std::string board, queue_text, hold_text;
+	unsigned lines = 4, threads = 0, games = 0;
+	bool allow_hold = true;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+
+		if (arg == "--no-hold") {
+			allow_hold = false;
+			continue;
+		}
+
+		if (i + 1 >= argc) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		if      (arg == "--board")   board      = argv[++i];
+		else if (arg == "--queue")   queue_text = argv[++i];
+		else if (arg == "--hold")    hold_text  = argv[++i];
+		else if (arg == "--lines")   lines      = atoi(argv[++i]);
+		else if (arg == "--threads") threads    = atoi(argv[++i]);
+		else if (arg == "--bench")   games      = atoi(argv[++i]);
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	try {
+		if (games) {
+			return bench(games, lines, threads);
+		}
+
+		unsigned width = 10;
+		std::vector<uint16_t> rows;
+		std::vector<uint8_t> queue;
+
+		if (queue_text.empty() || (!board.empty() && !parse_board(board, width, rows))) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		for (char c : queue_text) {
+			if (shape_index(c) < 0) {
+				usage(argv[0]);
+				return 1;
+			}
+
+			queue.push_back(shape_index(c));
+		}
+
+		int hold = hold_text.empty()? -1 : shape_index(hold_text[0]);
+		tetrode::pc_solver solver(threads);
+
+		print_result(solver.solve(rows, width, queue, hold, allow_hold, lines), width, rows);
+
+	} catch (const char *err) {
+		fprintf(stderr, "%s: %s\n", argv[0], err);
+		return 1;
+	}
+
+	return 0;
+}
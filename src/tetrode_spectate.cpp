@@ -0,0 +1,218 @@
+#include <tetrode/spectator.hpp>
+#include <tetrode/wire.hpp>
+#include <tetrode/field_state.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Broadcasts a random game to local viewers over socketpairs, some of
+// which never read, and reports what the producer spent per tick. With
+// --unix it also serves real viewers, at the game's normal tick rate.
+
+static uint32_t xorshift32(uint32_t& state){
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+class viewer {
+	public:
+		int fd;
+		std::vector<uint8_t> buf;
+		tetrode::field_snapshot snap;
+		unsigned long frames = 0;
+		unsigned long errors = 0;
+
+		// decode every complete frame in the buffer
+		void consume(void){
+			size_t pos = 0;
+
+			while (buf.size() - pos >= 4) {
+				uint32_t len = buf[pos] | buf[pos + 1] << 8
+				             | buf[pos + 2] << 16 | (uint32_t)buf[pos + 3] << 24;
+
+				if (buf.size() - pos - 4 < len) {
+					break;
+				}
+
+				if (!tetrode::wire::decode(buf.data() + pos + 4, len, snap)) {
+					errors++;
+				}
+
+				frames++;
+				pos += 4 + len;
+			}
+
+			buf.erase(buf.begin(), buf.begin() + pos);
+		}
+};
+
+static void read_viewers(std::vector<viewer> *viewers, std::atomic<bool> *running){
+	std::vector<struct pollfd> fds;
+
+	for (auto& v : *viewers) {
+		fds.push_back({ v.fd, POLLIN, 0 });
+	}
+
+	while (running->load()) {
+		if (poll(fds.data(), fds.size(), 10) <= 0) {
+			continue;
+		}
+
+		for (size_t i = 0; i < fds.size(); i++) {
+			uint8_t tmp[65536];
+			ssize_t n;
+
+			while ((n = recv(fds[i].fd, tmp, sizeof(tmp), MSG_DONTWAIT)) > 0) {
+				auto& v = (*viewers)[i];
+				v.buf.insert(v.buf.end(), tmp, tmp + n);
+				v.consume();
+			}
+		}
+	}
+}
+
+int main(int argc, char *argv[]){
+	unsigned ticks = 20000;
+	unsigned num_fast = 200;
+	unsigned num_slow = 20;
+	std::string unix_path;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string arg = argv[i];
+
+		if      (arg == "--ticks")   ticks     = atoi(argv[i + 1]);
+		else if (arg == "--viewers") num_fast  = atoi(argv[i + 1]);
+		else if (arg == "--slow")    num_slow  = atoi(argv[i + 1]);
+		else if (arg == "--unix")    unix_path = argv[i + 1];
+		else {
+			fprintf(stderr, "usage: %s [--ticks N] [--viewers N] [--slow N] [--unix PATH]\n",
+			        argv[0]);
+			return 1;
+		}
+	}
+
+	tetrode::spectator_service service;
+	std::vector<viewer> fast;
+	std::vector<int> slow;
+	int listen_fd = -1;
+
+	for (unsigned i = 0; i < num_fast + num_slow; i++) {
+		int sv[2];
+
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+			perror("socketpair");
+			return 1;
+		}
+
+		service.add_subscriber(sv[0]);
+
+		if (i < num_fast) {
+			fast.emplace_back();
+			fast.back().fd = sv[1];
+
+		} else {
+			slow.push_back(sv[1]);
+		}
+	}
+
+	if (!unix_path.empty()) {
+		struct sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, unix_path.c_str(), sizeof(addr.sun_path) - 1);
+		unlink(unix_path.c_str());
+
+		listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+		if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0
+		    || listen(listen_fd, SOMAXCONN) < 0)
+		{
+			perror("listen");
+			return 1;
+		}
+	}
+
+	std::atomic<bool> running(true);
+	std::thread reader(read_viewers, &fast, &running);
+
+	tetrode::field_state field(10, 40, 1);
+	uint32_t rng = 1;
+	double slowest_us = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	const auto tick_period = std::chrono::microseconds(1000000 / tetrode::field_state::rules::tick_rate);
+
+	for (unsigned t = 0; t < ticks; t++) {
+		field.handle_event(tetrode::event::Tick);
+
+		if (xorshift32(rng) % 8 == 0) {
+			unsigned ev = tetrode::event::RotateLeft + xorshift32(rng) % 6;
+			field.handle_event(static_cast<tetrode::event>(ev));
+		}
+
+		if (field.topped_out) {
+			field = tetrode::field_state(10, 40, xorshift32(rng));
+		}
+
+		auto tick_start = std::chrono::steady_clock::now();
+
+		if (listen_fd >= 0) {
+			service.accept_from(listen_fd);
+		}
+
+		service.publish(field, t);
+		service.flush();
+
+		auto d = std::chrono::steady_clock::now() - tick_start;
+		slowest_us = std::max(slowest_us, std::chrono::duration<double, std::micro>(d).count());
+
+		if (listen_fd >= 0) {
+			std::this_thread::sleep_for(tick_period);
+		}
+	}
+
+	double total_ms = std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+
+	// give the readers a moment to drain their sockets
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	running = false;
+	reader.join();
+
+	unsigned long frames = 0, errors = 0;
+	for (auto& v : fast) {
+		frames += v.frames;
+		errors += v.errors;
+		close(v.fd);
+	}
+
+	for (int fd : slow) {
+		close(fd);
+	}
+
+	auto& s = service.stats;
+	printf("%u ticks to %zu subscribers in %.1fms, %.2fus/tick avg, %.1fus slowest\n",
+	       ticks, service.subscribers(), total_ms, total_ms * 1000 / ticks, slowest_us);
+	printf("encoded %lu frames (%lu keyframes, %lu bytes), sent %lu bytes, "
+	       "%lu resyncs\n",
+	       s.frames, s.keyframes, s.bytes_encoded, s.bytes_sent, s.resyncs);
+	printf("fast viewers decoded %lu frames, %lu errors\n", frames, errors);
+
+	if (listen_fd >= 0) {
+		close(listen_fd);
+		unlink(unix_path.c_str());
+	}
+
+	return errors != 0;
+}
@@ -0,0 +1,88 @@
+#include <tetrode/placement_tables.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Generates the landing tables and opening book heuristic_bot maps in
+// with --tables, eg. tetrode-tables --book 5 tables.bin
+
+static void usage(const char *name){
+	fprintf(stderr,
+		"usage: %s [options] output.bin\n"
+		"    --book N         placements covered by the opening book (default: 4)\n"
+		"    --threads N      worker threads (default: cores)\n"
+		"    --weights H,L,O,B  bot weights the book is searched with\n",
+		name);
+}
+
+int main(int argc, char *argv[]){
+	unsigned book = 4;
+	unsigned threads = std::thread::hardware_concurrency();
+	tetrode::bot_weights weights;
+
+	if (argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (int i = 1; i < argc - 1; i++) {
+		std::string arg = argv[i];
+
+		if (i + 2 >= argc) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		if      (arg == "--book")    book    = atoi(argv[++i]);
+		else if (arg == "--threads") threads = atoi(argv[++i]);
+		else if (arg == "--weights") {
+			auto& w = weights;
+
+			if (sscanf(argv[++i], "%lf,%lf,%lf,%lf",
+			           &w.height, &w.lines, &w.holes, &w.bumpiness) != 4)
+			{
+				usage(argv[0]);
+				return 1;
+			}
+		}
+
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	const char *path = argv[argc - 1];
+
+	// a stray option, eg. --help, isn't somewhere to write the tables
+	if (path[0] == '-') {
+		usage(argv[0]);
+		return 1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	if (!tetrode::placement_tables::build(path, book, threads, weights)) {
+		fprintf(stderr, "%s: couldn't build %s\n", argv[0], path);
+		return 1;
+	}
+
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	start = std::chrono::steady_clock::now();
+
+	tetrode::placement_tables tables;
+
+	if (!tables.open(path)) {
+		fprintf(stderr, "%s: %s doesn't read back\n", argv[0], path);
+		return 1;
+	}
+
+	double open_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	printf("built %s in %.2f s: %lu book positions, opens in %.3f ms\n",
+	       path, secs, tables.book_size(), open_ms);
+	return 0;
+}
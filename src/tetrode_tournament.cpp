@@ -0,0 +1,285 @@
+#include <tetrode/field_state.hpp>
+#include <tetrode/game_stats.hpp>
+#include <tetrode/placement_tables.hpp>
+#include <tetrode/replay.hpp>
+#include <tetrode/bot.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Plays seeded bot games for every rule set across all cores, to tune
+// bots and rules. Each thread has its own engines and bot and keeps its
+// own totals, the only thing shared is the counter handing out games.
+
+namespace {
+
+class options {
+	public:
+		unsigned games = 100;
+		unsigned threads = std::thread::hardware_concurrency();
+		unsigned long max_ticks = 60000;
+		// ticks between bot inputs
+		unsigned think = 5;
+		tetrode::bot_weights weights;
+		// per game stats go here when set, one JSON line each
+		FILE *stats = NULL;
+		// shared by every thread's bots, only ever read
+		const tetrode::placement_tables *tables = NULL;
+		// directory to save a replay of every game in
+		const char *record = NULL;
+};
+
+// Welford's running mean/variance, mergeable across threads
+class running_stats {
+	public:
+		void add(double x){
+			n++;
+			double d = x - mean;
+			mean += d / n;
+			m2 += d * (x - mean);
+		}
+
+		void merge(const running_stats& o){
+			if (o.n == 0) {
+				return;
+			}
+
+			double d = o.mean - mean;
+			unsigned long total = n + o.n;
+
+			mean += d * o.n / total;
+			m2 += o.m2 + d * d * n * o.n / total;
+			n = total;
+		}
+
+		// half width of the 95% confidence interval of the mean
+		double ci95(void) const {
+			return (n > 1)? 1.96 * sqrt(m2 / (n - 1) / n) : 0;
+		}
+
+		unsigned long n = 0;
+		double mean = 0;
+		double m2 = 0;
+};
+
+class results {
+	public:
+		running_stats score, lines, level, pps;
+		unsigned long ticks = 0;
+
+		void merge(const results& o){
+			score.merge(o.score);
+			lines.merge(o.lines);
+			level.merge(o.level);
+			pps.merge(o.pps);
+			ticks += o.ticks;
+		}
+};
+
+template <class field_t>
+void play_game(const char *name, uint32_t seed, const options& opt, results& out){
+	field_t field(10, 40, seed);
+	tetrode::heuristic_bot bot(opt.weights, opt.tables);
+	tetrode::game_stats stats(field_t::rules::tick_rate);
+	tetrode::replay rec;
+	unsigned long ticks = 0, pieces = 0;
+
+	if (opt.stats) {
+		field.stats = &stats;
+	}
+
+	if (opt.record) {
+		rec.begin(field, name);
+	}
+
+	while (!field.topped_out && ticks < opt.max_ticks) {
+		// the bot looks at updates to notice pieces locking under it
+		tetrode::event ev = bot.next_move(field);
+		field.updates = 0;
+
+		field.handle_event(ev);
+		pieces += (field.updates & tetrode::changes::Locked) != 0;
+		field.updates &= ~tetrode::changes::Locked;
+
+		if (opt.record && ev != tetrode::event::NullEvent) {
+			rec.add(ev);
+		}
+
+		field.advance(opt.think);
+		rec.advance(opt.think);
+		pieces += (field.updates & tetrode::changes::Locked) != 0;
+		ticks += opt.think;
+	}
+
+	out.score.add(field.score);
+	out.lines.add(field.lines_cleared);
+	out.level.add(field.level);
+	out.pps.add(pieces * (double)field_t::rules::tick_rate / ticks);
+	out.ticks += ticks;
+
+	if (opt.stats) {
+		std::string game = std::string(name) + "/" + std::to_string(seed);
+
+		// keeps lines from different threads whole
+		flockfile(opt.stats);
+		stats.write_json(opt.stats, game.c_str());
+		funlockfile(opt.stats);
+	}
+
+	if (opt.record) {
+		std::string path = std::string(opt.record) + "/" + name + "-"
+		                 + std::to_string(seed) + ".trpl";
+
+		if (!rec.save(path)) {
+			fprintf(stderr, "couldn't save %s\n", path.c_str());
+		}
+	}
+}
+
+typedef void (*game_fn)(const char*, uint32_t, const options&, results&);
+
+class config {
+	public:
+		const char *name;
+		game_fn play;
+};
+
+const config configs[] = {
+	{ "guideline",  play_game<tetrode::field_state> },
+	{ "classic",    play_game<tetrode::classic_field_state> },
+	{ "20g",        play_game<tetrode::twenty_g_field_state> },
+	{ "zero-delay", play_game<tetrode::zero_delay_field_state> },
+};
+
+const unsigned num_configs = sizeof(configs) / sizeof(configs[0]);
+
+void usage(const char *name){
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"    --games N        games per rule set (default: 100)\n"
+		"    --threads N      worker threads (default: cores)\n"
+		"    --ticks N        end games after N ticks (default: 60000)\n"
+		"    --think N        ticks between bot inputs (default: 5)\n"
+		"    --weights H,L,O,B  bot weights for height, lines, holes, bumpiness\n"
+		"    --stats FILE     append each game's stats to FILE as JSON lines\n"
+		"    --tables FILE    bot lookup tables from tetrode-tables\n"
+		"    --record DIR     save a replay of every game to DIR\n",
+		name);
+}
+
+// anonymous namespace
+}
+
+int main(int argc, char *argv[]){
+	options opt;
+	tetrode::placement_tables tables;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+
+		if (i + 1 >= argc) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		if      (arg == "--games")   opt.games     = atoi(argv[++i]);
+		else if (arg == "--threads") opt.threads   = atoi(argv[++i]);
+		else if (arg == "--ticks")   opt.max_ticks = atol(argv[++i]);
+		else if (arg == "--think")   opt.think     = atoi(argv[++i]);
+		else if (arg == "--record")  opt.record    = argv[++i];
+		else if (arg == "--stats") {
+			if (!(opt.stats = fopen(argv[++i], "a"))) {
+				fprintf(stderr, "couldn't open %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (arg == "--tables") {
+			if (!tables.open(argv[++i])) {
+				fprintf(stderr, "couldn't open tables %s\n", argv[i]);
+				return 1;
+			}
+
+			opt.tables = &tables;
+		}
+		else if (arg == "--weights") {
+			auto& w = opt.weights;
+
+			if (sscanf(argv[++i], "%lf,%lf,%lf,%lf",
+			           &w.height, &w.lines, &w.holes, &w.bumpiness) != 4)
+			{
+				usage(argv[0]);
+				return 1;
+			}
+		}
+
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	opt.threads = opt.threads? opt.threads : 1;
+	opt.think = opt.think? opt.think : 1;
+
+	const unsigned long total = (unsigned long)opt.games * num_configs;
+	std::atomic<unsigned long> next_game{0};
+	std::vector<std::vector<results>> per_thread(opt.threads,
+	                                             std::vector<results>(num_configs));
+	std::vector<std::thread> workers;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (unsigned t = 0; t < opt.threads; t++) {
+		workers.emplace_back([&, t]{
+			unsigned long game;
+
+			while ((game = next_game.fetch_add(1, std::memory_order_relaxed)) < total) {
+				unsigned c = game / opt.games;
+				configs[c].play(configs[c].name, game % opt.games + 1, opt,
+				                per_thread[t][c]);
+			}
+		});
+	}
+
+	for (auto& w : workers) {
+		w.join();
+	}
+
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	unsigned long ticks = 0;
+
+	printf("%-10s %6s  %20s  %16s  %12s  %12s\n",
+	       "rules", "games", "score", "lines", "level", "pieces/s");
+
+	for (unsigned c = 0; c < num_configs; c++) {
+		results r;
+
+		for (auto& t : per_thread) {
+			r.merge(t[c]);
+		}
+
+		ticks += r.ticks;
+
+		printf("%-10s %6lu  %10.0f ± %-7.0f  %8.1f ± %-5.1f  %5.2f ± %-4.2f  %5.2f ± %-4.2f\n",
+		       configs[c].name, r.score.n,
+		       r.score.mean, r.score.ci95(),
+		       r.lines.mean, r.lines.ci95(),
+		       r.level.mean, r.level.ci95(),
+		       r.pps.mean, r.pps.ci95());
+	}
+
+	printf("%lu games in %.2f s on %u threads: %.1f games/s, %.3g ticks/s\n",
+	       total, secs, opt.threads, total / secs, ticks / secs);
+
+	if (opt.stats) {
+		fclose(opt.stats);
+	}
+
+	return 0;
+}
@@ -0,0 +1,139 @@
+#include <tetrode/wire.hpp>
+#include <tetrode/field_state.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Round-trips snapshots from random games through the wire encoding,
+// checking they decode back exactly, and reports sizes and throughput.
+
+static uint32_t xorshift32(uint32_t& state){
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start){
+	auto d = std::chrono::steady_clock::now() - start;
+	return std::chrono::duration<double, std::milli>(d).count();
+}
+
+static void usage(const char *name){
+	fprintf(stderr,
+		"usage: %s [games] [ticks]\n"
+		"    games            random games to take snapshots from (default: 200)\n"
+		"    ticks            ticks each game runs for at most (default: 2000)\n",
+		name);
+}
+
+// a whole positive number, or false
+static bool parse_count(const char *arg, unsigned& out){
+	char *end;
+	unsigned long n = strtoul(arg, &end, 10);
+
+	if (*arg < '0' || *arg > '9' || *end || n < 1 || n > 1000000000ul) {
+		return false;
+	}
+
+	out = n;
+	return true;
+}
+
+int main(int argc, char *argv[]){
+	unsigned games = 200;
+	unsigned ticks = 2000;
+
+	if (argc > 3 || (argc > 1 && !parse_count(argv[1], games))
+	    || (argc > 2 && !parse_count(argv[2], ticks)))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	// record snapshots from a batch of random games first, so the timed
+	// loops only measure the encoding
+	std::vector<tetrode::field_snapshot> snaps;
+	uint32_t rng = 42;
+
+	for (unsigned g = 0; g < games; g++) {
+		tetrode::field_state field(10, 40, g + 1);
+
+		for (unsigned t = 0; t < ticks && !field.topped_out; t++) {
+			field.handle_event(tetrode::event::Tick);
+
+			if (xorshift32(rng) % 8 == 0) {
+				unsigned ev = tetrode::event::RotateLeft + xorshift32(rng) % 6;
+				field.handle_event(static_cast<tetrode::event>(ev));
+			}
+
+			// every tenth tick, roughly what a spectator would be sent
+			if (t % 10 == 0) {
+				snaps.emplace_back();
+				field.save_state(snaps.back());
+			}
+		}
+	}
+
+	std::vector<uint8_t> keyframes, deltas;
+	std::vector<size_t> key_offsets, delta_offsets;
+
+	auto start = std::chrono::steady_clock::now();
+	for (auto& snap : snaps) {
+		key_offsets.push_back(keyframes.size());
+		tetrode::wire::encode(snap, keyframes);
+	}
+	double key_ms = elapsed_ms(start);
+
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 1; i < snaps.size(); i++) {
+		delta_offsets.push_back(deltas.size());
+		tetrode::wire::encode_delta(snaps[i - 1], snaps[i], deltas);
+	}
+	double delta_ms = elapsed_ms(start);
+
+	unsigned errors = 0;
+	tetrode::field_snapshot out;
+
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < snaps.size(); i++) {
+		size_t off = key_offsets[i];
+
+		if (!tetrode::wire::decode(keyframes.data() + off, keyframes.size() - off, out)) {
+			errors++;
+		}
+	}
+	double decode_ms = elapsed_ms(start);
+
+	// check everything after timing, applying deltas on top of keyframes
+	for (size_t i = 0; i < snaps.size(); i++) {
+		size_t off = key_offsets[i];
+		tetrode::wire::decode(keyframes.data() + off, keyframes.size() - off, out);
+		errors += out.checksum() != snaps[i].checksum();
+
+		if (i + 1 < snaps.size()) {
+			size_t doff = delta_offsets[i];
+			tetrode::wire::decode(deltas.data() + doff, deltas.size() - doff, out);
+			errors += out.checksum() != snaps[i + 1].checksum();
+		}
+	}
+
+	if (snaps.empty()) {
+		fprintf(stderr, "no snapshots taken\n");
+		return 1;
+	}
+
+	size_t n = snaps.size();
+	size_t raw = snaps[0].cells.size() * 4;
+
+	printf("%zu snapshots, %u errors\n", n, errors);
+	printf("keyframe: %.1f bytes avg, delta: %.1f bytes avg (board as 4-byte cells: %zu)\n",
+	       (double)keyframes.size() / n, (n > 1)? (double)deltas.size() / (n - 1) : 0.0, raw);
+	printf("encode: %.0f keyframes/ms, %.0f deltas/ms, decode: %.0f keyframes/ms\n",
+	       n / key_ms, (n > 1)? (n - 1) / delta_ms : 0.0, n / decode_ms);
+
+	return errors != 0;
+}
@@ -0,0 +1,141 @@
+#include <tetrode/timer_wheel.hpp>
+
+namespace tetrode {
+
+timer_wheel::timer_wheel(uint64_t start){
+	for (unsigned l = 0; l < levels; l++) {
+		for (unsigned s = 0; s < slots; s++) {
+			wheel[l][s] = nullptr;
+		}
+
+		occupied[l] = 0;
+	}
+
+	ready = nullptr;
+	now = start;
+}
+
+void timer_wheel::link(entry **head, entry *e, uint8_t level, uint8_t slot){
+	e->next = *head;
+	e->pprev = head;
+	e->level = level;
+	e->slot = slot;
+
+	if (*head) {
+		(*head)->pprev = &e->next;
+	}
+
+	*head = e;
+}
+
+void timer_wheel::insert(entry *e){
+	if (e->expires <= now) {
+		link(&ready, e, ready_level, 0);
+		return;
+	}
+
+	const uint64_t range = 1ull << (slot_bits * levels);
+	uint64_t delta = e->expires - now;
+	// too far out for the wheel, park it at the edge of the top level
+	uint64_t at = (delta < range)? e->expires : now + range - 1;
+
+	unsigned level = 0;
+	while (level < levels - 1 && delta >= (1ull << (slot_bits * (level + 1)))) {
+		level++;
+	}
+
+	unsigned slot = (at >> (slot_bits * level)) & (slots - 1);
+	link(&wheel[level][slot], e, level, slot);
+	occupied[level] |= 1ull << slot;
+}
+
+void timer_wheel::schedule(entry *e, uint64_t expires){
+	if (e->scheduled()) {
+		cancel(e);
+	}
+
+	e->expires = expires;
+	insert(e);
+}
+
+void timer_wheel::cancel(entry *e){
+	if (!e->scheduled()) {
+		return;
+	}
+
+	*e->pprev = e->next;
+	if (e->next) {
+		e->next->pprev = e->pprev;
+	}
+
+	if (e->level != ready_level && !wheel[e->level][e->slot]) {
+		occupied[e->level] &= ~(1ull << e->slot);
+	}
+
+	e->next = nullptr;
+	e->pprev = nullptr;
+}
+
+void timer_wheel::cascade(unsigned level, unsigned slot){
+	entry *e = wheel[level][slot];
+
+	wheel[level][slot] = nullptr;
+	occupied[level] &= ~(1ull << slot);
+
+	while (e) {
+		entry *next = e->next;
+		insert(e);
+		e = next;
+	}
+}
+
+void timer_wheel::advance(uint64_t target){
+	while (now < target) {
+		uint64_t t = now + 1;
+
+		// entering a new block: pull the matching slots of the upper
+		// levels down, highest first so entries can drop several levels
+		now = t;
+
+		unsigned top = 0;
+		while (top < levels - 1
+		       && ((t >> (slot_bits * (top + 1))) << (slot_bits * (top + 1))) == t)
+		{
+			top++;
+		}
+
+		for (unsigned l = top; l > 0; l--) {
+			unsigned slot = (t >> (slot_bits * l)) & (slots - 1);
+
+			if (occupied[l] & (1ull << slot)) {
+				cascade(l, slot);
+			}
+		}
+
+		unsigned slot = t & (slots - 1);
+		if (occupied[0] & (1ull << slot)) {
+			cascade(0, slot);
+		}
+
+		// skip to the next occupied slot in this block, or the start of
+		// the next block
+		uint64_t later = (slot + 1 < slots)? occupied[0] >> (slot + 1) << (slot + 1) : 0;
+		uint64_t next = later? (t & ~(uint64_t)(slots - 1)) + __builtin_ctzll(later)
+		                     : (t | (slots - 1)) + 1;
+
+		now = (next - 1 < target)? next - 1 : target;
+	}
+}
+
+timer_wheel::entry *timer_wheel::pop_ready(void){
+	entry *e = ready;
+
+	if (e) {
+		cancel(e);
+	}
+
+	return e;
+}
+
+// namespace tetrode
+}
@@ -0,0 +1,697 @@
+#include <tetrode/wire.hpp>
+
+#include <utility>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+namespace tetrode {
+
+namespace {
+
+enum row_kinds {
+	RowEmpty,
+	RowColored,
+	RowCleared,
+	RowRaw,
+};
+
+enum counter_fields {
+	FieldQueue,
+	FieldActive,
+	FieldHold,
+	FieldSeed,
+	FieldMovementTicks,
+	FieldClearTicks,
+	FieldDropTicks,
+	FieldLevel,
+	FieldScore,
+	FieldLines,
+	FieldHeld,
+	FieldCount,
+};
+
+// colored rows store cells as 3-bit offsets from the first real color
+const uint8_t color_first = block::states::Garbage;
+const uint8_t color_last  = block::states::Orange;
+
+// widest row that gets an occupancy mask, wider rows are always raw
+const unsigned max_mask_width = 32;
+// sanity limit on decoded board sizes
+const unsigned max_dimension = 1024;
+// anything decoded past these can't be a piece or a spin
+const uint8_t max_shape = tetrimino::shape::L;
+const uint8_t max_spin  = field_state::SpinKicked;
+
+class writer {
+	public:
+		writer(std::vector<uint8_t>& o) : out(o) {}
+
+		void byte(uint8_t b){ out.push_back(b); }
+
+		void varint(uint32_t v){
+			while (v >= 0x80) {
+				out.push_back(v | 0x80);
+				v >>= 7;
+			}
+
+			out.push_back(v);
+		}
+
+		void zigzag(int32_t v){
+			varint(((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+		}
+
+		void fixed32(uint32_t v){
+			for (unsigned i = 0; i < 4; i++) {
+				out.push_back(v >> (8 * i));
+			}
+		}
+
+		// bits go in least significant first
+		void bits(uint32_t v, unsigned n){
+			acc |= (uint64_t)v << fill;
+			fill += n;
+
+			while (fill >= 8) {
+				out.push_back(acc);
+				acc >>= 8;
+				fill -= 8;
+			}
+		}
+
+		void align(void){
+			if (fill) {
+				out.push_back(acc);
+			}
+
+			acc = fill = 0;
+		}
+
+	private:
+		std::vector<uint8_t>& out;
+		uint64_t acc = 0;
+		unsigned fill = 0;
+};
+
+class reader {
+	public:
+		reader(const uint8_t *data, size_t len) : p(data), start(data), end(data + len) {}
+
+		uint8_t byte(void){
+			if (p >= end) {
+				ok = false;
+				return 0;
+			}
+
+			return *p++;
+		}
+
+		uint32_t varint(void){
+			uint32_t ret = 0;
+
+			for (unsigned shift = 0; shift < 35; shift += 7) {
+				uint8_t b = byte();
+				ret |= (uint32_t)(b & 0x7f) << shift;
+
+				if (!(b & 0x80)) {
+					return ret;
+				}
+			}
+
+			ok = false;
+			return 0;
+		}
+
+		int32_t zigzag(void){
+			uint32_t v = varint();
+			return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+		}
+
+		uint32_t fixed32(void){
+			uint32_t ret = 0;
+
+			for (unsigned i = 0; i < 4; i++) {
+				ret |= (uint32_t)byte() << (8 * i);
+			}
+
+			return ret;
+		}
+
+		// only pulls in bytes as they're needed, so whatever's left in the
+		// accumulator on align() is padding from the last byte
+		uint32_t bits(unsigned n){
+			while (fill < n) {
+				acc |= (uint64_t)byte() << fill;
+				fill += 8;
+			}
+
+			uint32_t ret = acc & ((1ull << n) - 1);
+			acc >>= n;
+			fill -= n;
+			return ret;
+		}
+
+		void align(void){
+			acc = fill = 0;
+		}
+
+		size_t used(void){ return p - start; }
+
+		bool ok = true;
+
+	private:
+		const uint8_t *p, *start, *end;
+		uint64_t acc = 0;
+		unsigned fill = 0;
+};
+
+struct row_scan {
+	uint32_t occupied;
+	unsigned kind;
+};
+
+#if defined(__SSE2__)
+// rows are packed back to back, so only the last one can't do a full load
+static inline __m128i load_row(const uint8_t *row, unsigned width, const uint8_t *end){
+	if (row + 16 <= end) {
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(row));
+	}
+
+	uint8_t buf[16] = {};
+	memcpy(buf, row, width);
+	return _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf));
+}
+#endif
+
+static row_scan scan_row(const uint8_t *row, unsigned width, const uint8_t *end){
+	row_scan ret = { 0, RowRaw };
+
+#if defined(__SSE2__)
+	if (width <= 16) {
+		const uint32_t lanes = (1u << width) - 1;
+		__m128i v = load_row(row, width, end);
+
+		uint32_t empty   = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+		uint32_t cleared = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(block::states::Cleared)));
+
+		// lanes that come out of clamping to the color range unchanged
+		__m128i clamped = _mm_min_epu8(_mm_max_epu8(v, _mm_set1_epi8(color_first)),
+		                               _mm_set1_epi8(color_last));
+		uint32_t colored = _mm_movemask_epi8(_mm_cmpeq_epi8(clamped, v));
+
+		ret.occupied = ~empty & lanes;
+
+		if (!ret.occupied)                            ret.kind = RowEmpty;
+		else if ((cleared & lanes) == lanes)          ret.kind = RowCleared;
+		else if ((colored & ret.occupied) == ret.occupied) ret.kind = RowColored;
+
+		return ret;
+	}
+#endif
+
+	if (width > max_mask_width) {
+		return ret;
+	}
+
+	bool all_cleared = true;
+	bool all_colored = true;
+
+	for (unsigned x = 0; x < width; x++) {
+		uint8_t cell = row[x];
+
+		if (cell != block::states::Empty) {
+			ret.occupied |= 1u << x;
+			all_colored &= cell >= color_first && cell <= color_last;
+		}
+
+		all_cleared &= cell == block::states::Cleared;
+	}
+
+	if (!ret.occupied)     ret.kind = RowEmpty;
+	else if (all_cleared)  ret.kind = RowCleared;
+	else if (all_colored)  ret.kind = RowColored;
+
+	return ret;
+}
+
+static bool rows_equal(const uint8_t *a, const uint8_t *b, unsigned width,
+                       const uint8_t *end_a, const uint8_t *end_b)
+{
+#if defined(__SSE2__)
+	if (width <= 16) {
+		const uint32_t lanes = (1u << width) - 1;
+		__m128i eq = _mm_cmpeq_epi8(load_row(a, width, end_a), load_row(b, width, end_b));
+		return (_mm_movemask_epi8(eq) & lanes) == lanes;
+	}
+#endif
+
+	return memcmp(a, b, width) == 0;
+}
+
+#if defined(__BMI2__)
+// bytes 0 through n-1 set to `byte`
+static inline uint64_t repeat_bytes(uint8_t byte, unsigned n){
+	return n? (0x0101010101010101ull * byte) >> (64 - 8 * n) : 0;
+}
+#endif
+
+static void write_colors(writer& out, const uint8_t *row, unsigned width, uint32_t occupied){
+#if defined(__BMI2__)
+	// eight cells at a time: pext gathers the occupied cells' bytes, then
+	// squeezes each down to its low three bits
+	for (unsigned base = 0; base < width; base += 8) {
+		unsigned n = (width - base < 8)? width - base : 8;
+		uint8_t mask = (occupied >> base) & 0xff;
+		unsigned count = __builtin_popcount(mask);
+		uint64_t cells = 0;
+
+		if (!count) {
+			continue;
+		}
+
+		memcpy(&cells, row + base, n);
+
+		uint64_t lanes  = _pdep_u64(mask, 0x0101010101010101ull) * 0xff;
+		uint64_t packed = _pext_u64(cells, lanes) - repeat_bytes(color_first, count);
+		out.bits(_pext_u64(packed, 0x0707070707070707ull), 3 * count);
+	}
+#else
+	for (unsigned x = 0; x < width; x++) {
+		if (occupied & (1u << x)) {
+			out.bits(row[x] - color_first, 3);
+		}
+	}
+#endif
+}
+
+static void read_colors(reader& in, uint8_t *row, unsigned width, uint32_t occupied){
+#if defined(__BMI2__)
+	// the reverse of write_colors(), pdep spreads the 3-bit codes out to
+	// bytes and then out to the occupied cells
+	for (unsigned base = 0; base < width; base += 8) {
+		unsigned n = (width - base < 8)? width - base : 8;
+		uint8_t mask = (occupied >> base) & 0xff;
+		unsigned count = __builtin_popcount(mask);
+
+		uint64_t lanes = _pdep_u64(mask, 0x0101010101010101ull) * 0xff;
+		uint64_t codes = count? in.bits(3 * count) : 0;
+		uint64_t bytes = _pdep_u64(codes, 0x0707070707070707ull)
+		               + repeat_bytes(color_first, count);
+		uint64_t cells = _pdep_u64(bytes, lanes);
+
+		memcpy(row + base, &cells, n);
+	}
+#else
+	for (unsigned x = 0; x < width; x++) {
+		row[x] = (occupied & (1u << x))? color_first + in.bits(3)
+		                               : (uint8_t)block::states::Empty;
+	}
+#endif
+}
+
+static void write_row(writer& out, const uint8_t *row, unsigned width, const uint8_t *end){
+	row_scan scan = scan_row(row, width, end);
+
+	out.bits(scan.kind, 2);
+
+	switch (scan.kind) {
+		case RowColored:
+			out.bits(scan.occupied, width);
+			write_colors(out, row, width, scan.occupied);
+			break;
+
+		case RowRaw:
+			for (unsigned x = 0; x < width; x++) {
+				out.bits(row[x] & 0xf, 4);
+			}
+			break;
+
+		default: break;
+	}
+}
+
+static bool read_row(reader& in, uint8_t *row, unsigned width){
+	switch (in.bits(2)) {
+		case RowEmpty:
+			memset(row, block::states::Empty, width);
+			break;
+
+		case RowCleared:
+			memset(row, block::states::Cleared, width);
+			break;
+
+		case RowColored:
+			if (width > max_mask_width) {
+				return false;
+			}
+
+			read_colors(in, row, width, in.bits(width));
+			break;
+
+		case RowRaw:
+			for (unsigned x = 0; x < width; x++) {
+				row[x] = in.bits(4);
+
+				// past the last color there's nothing to draw it with
+				if (row[x] > color_last) {
+					return false;
+				}
+			}
+			break;
+	}
+
+	return in.ok;
+}
+
+static uint32_t changed_fields(const field_snapshot& a, const field_snapshot& b){
+	uint32_t ret = 0;
+
+	if (a.queue_len != b.queue_len || memcmp(a.queue, b.queue, a.queue_len)) {
+		ret |= 1 << FieldQueue;
+	}
+
+	if (a.active_shape != b.active_shape || a.active_x != b.active_x
+	    || a.active_y != b.active_y || a.active_rotations != b.active_rotations
+	    || a.spin != b.spin
+	    || memcmp(a.active_blocks, b.active_blocks, sizeof(a.active_blocks)))
+	{
+		ret |= 1 << FieldActive;
+	}
+
+	if (a.hold_shape != b.hold_shape || a.have_held != b.have_held
+	    || a.already_held != b.already_held || a.topped_out != b.topped_out)
+	{
+		ret |= 1 << FieldHold;
+	}
+
+	ret |= (a.random_seed    != b.random_seed)    << FieldSeed;
+	ret |= (a.movement_ticks != b.movement_ticks) << FieldMovementTicks;
+	ret |= (a.clear_ticks    != b.clear_ticks)    << FieldClearTicks;
+	ret |= (a.drop_ticks     != b.drop_ticks)     << FieldDropTicks;
+	ret |= (a.level          != b.level)          << FieldLevel;
+	ret |= (a.score          != b.score)          << FieldScore;
+	ret |= (a.lines_cleared  != b.lines_cleared)  << FieldLines;
+
+	if (a.held != b.held || a.shift_ticks != b.shift_ticks
+	    || a.soft_drop_ticks != b.soft_drop_ticks)
+	{
+		ret |= 1 << FieldHeld;
+	}
+
+	return ret;
+}
+
+static void write_counters(writer& out, const field_snapshot& snap, uint32_t fields){
+	out.varint(fields);
+
+	if (fields & (1 << FieldQueue)) {
+		// shapes are 0-6, two to a byte
+		out.varint(snap.queue_len);
+
+		for (unsigned i = 0; i < snap.queue_len; i += 2) {
+			uint8_t hi = (i + 1 < snap.queue_len)? snap.queue[i + 1] : 0;
+			out.byte(snap.queue[i] | hi << 4);
+		}
+	}
+
+	if (fields & (1 << FieldActive)) {
+		// shape 0-6, rotations 0-3, spin 0-2
+		out.byte(snap.active_shape | snap.active_rotations << 3 | snap.spin << 5);
+		out.zigzag(snap.active_x);
+		out.zigzag(snap.active_y);
+
+		// block offsets are all within [-2, 2]
+		for (unsigned i = 0; i < 4; i++) {
+			out.byte(((snap.active_blocks[i][0] + 8) & 0xf)
+			         | ((snap.active_blocks[i][1] + 8) & 0xf) << 4);
+		}
+	}
+
+	if (fields & (1 << FieldHold)) {
+		out.byte(snap.hold_shape);
+		out.byte(snap.have_held | snap.already_held << 1 | snap.topped_out << 2);
+	}
+
+	// the seed is effectively random, varints would only make it longer
+	if (fields & (1 << FieldSeed))          out.fixed32(snap.random_seed);
+	if (fields & (1 << FieldMovementTicks)) out.varint(snap.movement_ticks);
+	if (fields & (1 << FieldClearTicks))    out.varint(snap.clear_ticks);
+	if (fields & (1 << FieldDropTicks))     out.varint(snap.drop_ticks);
+	if (fields & (1 << FieldLevel))         out.varint(snap.level);
+	if (fields & (1 << FieldScore))         out.varint(snap.score);
+	if (fields & (1 << FieldLines))         out.varint(snap.lines_cleared);
+
+	if (fields & (1 << FieldHeld)) {
+		out.byte(snap.held);
+		out.varint(snap.shift_ticks);
+		out.varint(snap.soft_drop_ticks);
+	}
+}
+
+static bool read_counters(reader& in, field_snapshot& snap){
+	uint32_t fields = in.varint();
+
+	if (fields & (1 << FieldQueue)) {
+		unsigned len = in.varint();
+
+		if (len > field_snapshot::max_queue) {
+			return false;
+		}
+
+		snap.queue_len = len;
+
+		for (unsigned i = 0; i < len; i += 2) {
+			uint8_t b = in.byte();
+			snap.queue[i] = b & 0xf;
+
+			if (i + 1 < len) {
+				snap.queue[i + 1] = b >> 4;
+			}
+
+			if (snap.queue[i] > max_shape || (i + 1 < len && snap.queue[i + 1] > max_shape)) {
+				return false;
+			}
+		}
+	}
+
+	if (fields & (1 << FieldActive)) {
+		uint8_t active = in.byte();
+		snap.active_shape     = active & 7;
+		snap.active_rotations = (active >> 3) & 3;
+		snap.spin             = active >> 5;
+		snap.active_x = in.zigzag();
+		snap.active_y = in.zigzag();
+
+		if (snap.active_shape > max_shape || snap.spin > max_spin) {
+			return false;
+		}
+
+		for (unsigned i = 0; i < 4; i++) {
+			uint8_t b = in.byte();
+			snap.active_blocks[i][0] = (int)(b & 0xf) - 8;
+			snap.active_blocks[i][1] = (int)(b >> 4) - 8;
+		}
+	}
+
+	if (fields & (1 << FieldHold)) {
+		snap.hold_shape = in.byte();
+
+		if (snap.hold_shape > max_shape) {
+			return false;
+		}
+
+		uint8_t flags = in.byte();
+		snap.have_held    = flags & 1;
+		snap.already_held = flags & 2;
+		snap.topped_out   = flags & 4;
+	}
+
+	if (fields & (1 << FieldSeed))          snap.random_seed    = in.fixed32();
+	if (fields & (1 << FieldMovementTicks)) snap.movement_ticks = in.varint();
+	if (fields & (1 << FieldClearTicks))    snap.clear_ticks    = in.varint();
+	if (fields & (1 << FieldDropTicks))     snap.drop_ticks     = in.varint();
+	if (fields & (1 << FieldLevel))         snap.level          = in.varint();
+	if (fields & (1 << FieldScore))         snap.score          = in.varint();
+	if (fields & (1 << FieldLines))         snap.lines_cleared  = in.varint();
+
+	if (fields & (1 << FieldHeld)) {
+		snap.held            = in.byte();
+		snap.shift_ticks     = in.varint();
+		snap.soft_drop_ticks = in.varint();
+	}
+
+	return in.ok;
+}
+
+// anonymous namespace
+}
+
+size_t wire::encode(const field_snapshot& snap, std::vector<uint8_t>& out){
+	size_t start = out.size();
+	writer w(out);
+
+	const unsigned width = snap.size_x;
+	const uint8_t *cells = snap.cells.data();
+	const uint8_t *end = cells + snap.cells.size();
+
+	// everything above the highest non-empty row is implied
+	unsigned used = snap.size_y;
+	while (used > 0 && scan_row(cells + (used - 1) * width, width, end).kind == RowEmpty) {
+		used--;
+	}
+
+	w.byte(Keyframe | version << 4);
+	w.varint(snap.size_x);
+	w.varint(snap.size_y);
+	w.varint(used);
+
+	for (unsigned y = 0; y < used; y++) {
+		write_row(w, cells + y * width, width, end);
+	}
+
+	w.align();
+	write_counters(w, snap, (1 << FieldCount) - 1);
+
+	return out.size() - start;
+}
+
+size_t wire::encode_delta(const field_snapshot& prev, const field_snapshot& snap,
+                          std::vector<uint8_t>& out)
+{
+	if (prev.size_x != snap.size_x || prev.size_y != snap.size_y) {
+		return encode(snap, out);
+	}
+
+	size_t start = out.size();
+	writer w(out);
+
+	const unsigned width = snap.size_x;
+	const uint8_t *cells = snap.cells.data();
+	const uint8_t *old = prev.cells.data();
+	const uint8_t *end = cells + snap.cells.size();
+	const uint8_t *old_end = old + prev.cells.size();
+
+	// changed rows, as a bitmap so the index gaps can be written first
+	std::vector<uint64_t> changed((snap.size_y + 63) / 64, 0);
+	unsigned num_changed = 0;
+
+	for (int y = 0; y < snap.size_y; y++) {
+		if (!rows_equal(cells + y * width, old + y * width, width, end, old_end)) {
+			changed[y / 64] |= 1ull << (y % 64);
+			num_changed++;
+		}
+	}
+
+	w.byte(Delta | version << 4);
+	w.varint(num_changed);
+
+	int last = -1;
+	for (int y = 0; y < snap.size_y; y++) {
+		if (changed[y / 64] & (1ull << (y % 64))) {
+			w.varint(y - last - 1);
+			last = y;
+		}
+	}
+
+	for (int y = 0; y < snap.size_y; y++) {
+		if (changed[y / 64] & (1ull << (y % 64))) {
+			write_row(w, cells + y * width, width, end);
+		}
+	}
+
+	w.align();
+	write_counters(w, snap, changed_fields(prev, snap));
+
+	return out.size() - start;
+}
+
+size_t wire::decode(const uint8_t *data, size_t len, field_snapshot& snap){
+	reader in(data, len);
+	uint8_t header = in.byte();
+
+	if ((header >> 4) != version) {
+		return 0;
+	}
+
+	// decoded into a copy and only kept if the whole frame checks out, a
+	// bad frame leaves `snap` as it was
+	field_snapshot next = snap;
+
+	if ((header & 0xf) == Keyframe) {
+		unsigned width  = in.varint();
+		unsigned height = in.varint();
+		unsigned used   = in.varint();
+
+		if (!in.ok || width > max_dimension || height > max_dimension || used > height) {
+			return 0;
+		}
+
+		next.size_x = width;
+		next.size_y = height;
+		next.cells.resize(width * height);
+
+		uint8_t *cells = next.cells.data();
+
+		for (unsigned y = 0; y < used; y++) {
+			if (!read_row(in, cells + y * width, width)) {
+				return 0;
+			}
+		}
+
+		memset(cells + used * width, block::states::Empty, (height - used) * width);
+
+	} else if ((header & 0xf) == Delta) {
+		const unsigned width  = next.size_x;
+		const unsigned height = next.size_y;
+		unsigned num_changed = in.varint();
+
+		if (!in.ok || num_changed > height || next.cells.size() != width * height) {
+			return 0;
+		}
+
+		// row indexes come first, then the rows in one bitstream. `row` is
+		// the lowest one the next gap can land on, so a gap can be at most
+		// height - row - 1
+		unsigned rows[max_dimension];
+		unsigned row = 0;
+
+		for (unsigned i = 0; i < num_changed; i++) {
+			uint32_t gap = in.varint();
+
+			if (!in.ok || row >= height || gap > height - row - 1) {
+				return 0;
+			}
+
+			rows[i] = row + gap;
+			row = rows[i] + 1;
+		}
+
+		for (unsigned i = 0; i < num_changed; i++) {
+			if (!read_row(in, next.cells.data() + rows[i] * width, width)) {
+				return 0;
+			}
+		}
+
+	} else {
+		return 0;
+	}
+
+	in.align();
+
+	if (!read_counters(in, next)) {
+		return 0;
+	}
+
+	snap = std::move(next);
+	return in.used();
+}
+
+// namespace tetrode
+}
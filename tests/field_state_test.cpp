@@ -0,0 +1,383 @@
+#include <tetrode/field_state.hpp>
+#include <tetrode/bot.hpp>
+
+#include <algorithm>
+#include <initializer_list>
+#include <string.h>
+#include <stdio.h>
+
+// engine checks, run by `make check`
+
+namespace {
+
+unsigned failures = 0;
+
+void check(bool ok, const char *what){
+	if (!ok) {
+		fprintf(stderr, "FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+// garbage pushing the stack and the falling piece out of the top ends the
+// game rather than leaving the piece above the board to lock there
+void garbage_tops_out(void){
+	tetrode::field_state field(10, 40, 1);
+
+	for (int y = 0; y < 20; y++) {
+		for (int x = 0; x < 9; x++) {
+			field.field[y][x] = tetrode::block::states::Garbage;
+		}
+	}
+
+	field.add_garbage(20, 9);
+	check(field.topped_out, "garbage pushing the piece off the board tops out");
+	check(field.active.second.y <= field.size.y, "piece stays in range after topping out");
+
+	// locking now would write past the top of the field
+	field.handle_event(tetrode::event::Drop);
+	check(field.topped_out, "topped out board ignores a drop");
+}
+
+void garbage_lifts_piece(void){
+	tetrode::field_state field(10, 40, 1);
+	int y = field.active.second.y;
+
+	field.add_garbage(2, 3);
+	check(!field.topped_out, "a little garbage doesn't top out");
+	check(field.active.second.y == y, "piece clear of the garbage stays put");
+	check(field.field[0][3].state == tetrode::block::states::Empty
+	      && field.field[0][4].state == tetrode::block::states::Garbage,
+	      "garbage rows have their hole");
+}
+
+void garbage_hole_range(void){
+	tetrode::field_state field(10, 40, 1);
+	bool threw = false;
+
+	try {
+		field.add_garbage(1, 10);
+
+	} catch (const char *err) {
+		threw = true;
+	}
+
+	check(threw, "a hole outside the board throws");
+	check(field.field[0][0].state == tetrode::block::states::Empty,
+	      "a bad hole leaves the board alone");
+}
+
+// rows top to bottom ending at row 0, '#' for a garbage cell and
+// anything else for an empty one
+template <class field_t>
+void draw(field_t& field, std::initializer_list<const char*> rows){
+	int y = rows.size() - 1;
+
+	for (const char *row : rows) {
+		for (int x = 0; x < field.size.x; x++) {
+			field.field[y][x] = (row[x] == '#')? tetrode::block::states::Garbage
+			                                   : tetrode::block::states::Empty;
+		}
+
+		y--;
+	}
+}
+
+// a T at `x, y` turned `turns` times to the right
+void place_t(tetrode::field_state& field, unsigned turns, int x, int y){
+	tetrode::tetrimino t(tetrode::tetrimino::shape::T);
+
+	for (unsigned i = 0; i < turns; i++) {
+		t.rotate(tetrode::movement::Right);
+	}
+
+	field.active = { t, tetrode::coord_2d(x, y) };
+	field.spin = tetrode::field_state::NoSpin;
+}
+
+// T pointing right turned down into a slot with three filled corners,
+// clearing two lines
+void tspin_double(void){
+	tetrode::field_state field(10, 40, 1);
+	draw(field, {
+		"...#......",
+		"###...####",
+		"####.#####",
+	});
+
+	place_t(field, 1, 4, 1);
+	field.handle_event(tetrode::event::RotateRight);
+	check(field.active.first.rotations == 2 && field.active.second.x == 4
+	      && field.active.second.y == 1, "T turns into the slot without a kick");
+
+	unsigned score = field.score;
+	field.updates = 0;
+	field.handle_event(tetrode::event::Drop);
+
+	check(field.lines_cleared == 2, "T-spin double clears two lines");
+	check(field.updates & tetrode::changes::Tspin, "T-spin double counts as a T-spin");
+	check(field.score - score == tetrode::guideline_rules::tspin_score(2, field.level, false),
+	      "T-spin double scores as a full T-spin");
+}
+
+// three corners filled but only one of the two the T points at
+void tspin_mini(void){
+	tetrode::field_state field(10, 40, 1);
+	draw(field, {
+		"#.........",
+		"..........",
+		"#.#.......",
+	});
+
+	place_t(field, 3, 1, 1);
+	field.handle_event(tetrode::event::RotateRight);
+	check(field.active.first.rotations == 0 && field.active.second.x == 1
+	      && field.active.second.y == 1, "T turns up into the notch without a kick");
+
+	unsigned score = field.score;
+	field.updates = 0;
+	field.handle_event(tetrode::event::Drop);
+
+	check(field.lines_cleared == 0, "T-spin mini clears nothing");
+	check(field.updates & tetrode::changes::Tspin, "T-spin mini counts as a T-spin");
+	check(field.score - score == tetrode::guideline_rules::tspin_score(0, field.level, true),
+	      "T-spin mini scores as a mini");
+}
+
+// a vertical I against the left wall can't lie flat where it is, SRS
+// kicks it two to the right on the third test
+void i_wall_kick(void){
+	tetrode::field_state field(10, 40, 1);
+	tetrode::tetrimino i(tetrode::tetrimino::shape::I);
+	i.rotate(tetrode::movement::Right);
+
+	field.active = { i, tetrode::coord_2d(0, 5) };
+	field.handle_event(tetrode::event::RotateRight);
+
+	int left = 10, right = -1;
+	bool flat = true;
+
+	for (auto& b : field.active.first.blocks) {
+		int x = field.active.second.x + b.second.x;
+		left  = std::min(left, x);
+		right = std::max(right, x);
+		flat &= field.active.second.y + b.second.y == 4;
+	}
+
+	check(field.active.first.rotations == 2, "I at the wall turns");
+	check(flat && left == 0 && right == 3, "I kicks to columns 0-3 on row 4");
+}
+
+// every kick test overlaps, the piece stays exactly as it was
+void blocked_rotation(void){
+	tetrode::field_state field(10, 40, 1);
+	draw(field, {
+		"##########",
+		"####.#####",
+		"###...####",
+		"##########",
+	});
+
+	place_t(field, 0, 4, 1);
+	auto before = field.active;
+	field.updates = 0;
+	field.handle_event(tetrode::event::RotateRight);
+
+	bool same = field.active.first.rotations == before.first.rotations
+	         && field.active.second.x == before.second.x
+	         && field.active.second.y == before.second.y;
+
+	for (unsigned i = 0; i < 4; i++) {
+		same &= field.active.first.blocks[i].second.x == before.first.blocks[i].second.x
+		     && field.active.first.blocks[i].second.y == before.first.blocks[i].second.y;
+	}
+
+	check(same, "a blocked rotation leaves the piece alone");
+	check(field.spin == tetrode::field_state::NoSpin, "a blocked rotation isn't a spin");
+	check(field.updates & tetrode::changes::WallHit, "a blocked rotation hits the wall");
+}
+
+// drop an I into the gap at the end of row 0, clearing it
+template <class field_t>
+void clear_one_line(field_t& field){
+	draw(field, { "######...." });
+
+	field.active = { tetrode::tetrimino(tetrode::tetrimino::shape::I),
+	                 tetrode::coord_2d(7, 5) };
+	field.handle_event(tetrode::event::Drop);
+}
+
+bool same_piece(const std::pair<tetrode::tetrimino, tetrode::coord_2d>& a,
+                const std::pair<tetrode::tetrimino, tetrode::coord_2d>& b)
+{
+	bool ret = a.first.shape == b.first.shape && a.first.rotations == b.first.rotations
+	        && a.second.x == b.second.x && a.second.y == b.second.y;
+
+	for (unsigned i = 0; i < 4; i++) {
+		ret &= a.first.blocks[i].second.x == b.first.blocks[i].second.x
+		    && a.first.blocks[i].second.y == b.first.blocks[i].second.y;
+	}
+
+	return ret;
+}
+
+// a rotation pressed during the clear delay turns the next piece as it
+// spawns (IRS), moves and drops pressed then are thrown away
+void buffered_rotation(void){
+	tetrode::field_state field(10, 40, 1);
+	clear_one_line(field);
+
+	check(field.lines_cleared == 1, "the I clears the row");
+	check(field.clear_ticks == tetrode::guideline_rules::clear_delay,
+	      "the next piece waits out the clear delay");
+
+	// what the piece looks like turned once, with nothing in the way
+	tetrode::field_state turned = field;
+	turned.clear_ticks = 0;
+	turned.handle_event(tetrode::event::RotateRight);
+
+	auto spawned = field.active;
+	field.handle_event(tetrode::event::RotateRight);
+	field.handle_event(tetrode::event::MoveLeft);
+	field.handle_event(tetrode::event::Drop);
+	check(same_piece(field.active, spawned), "nothing moves during the clear delay");
+
+	while (field.clear_ticks > 0) {
+		field.handle_event(tetrode::event::Tick);
+	}
+
+	check(same_piece(field.active, turned.active),
+	      "the buffered rotation applies at spawn, the move and drop don't");
+	check(field.lines_cleared == 1 && field.field[0][0].state == tetrode::block::states::Empty,
+	      "the buffered drop didn't lock anything");
+}
+
+// likewise a hold pressed during the delay swaps the piece out (IHS)
+void buffered_hold(void){
+	tetrode::field_state field(10, 40, 1);
+	clear_one_line(field);
+
+	enum tetrode::tetrimino::shape spawned = field.active.first.shape;
+	enum tetrode::tetrimino::shape next = field.next_pieces.front().shape;
+
+	field.handle_event(tetrode::event::Hold);
+	check(!field.have_held, "hold waits for the clear delay");
+
+	while (field.clear_ticks > 0) {
+		field.handle_event(tetrode::event::Tick);
+	}
+
+	check(field.have_held && field.hold.shape == spawned, "the spawned piece goes to hold");
+	check(field.active.first.shape == next, "the piece after it comes out instead");
+}
+
+// without a clear delay the next piece is out and takes input straight
+// after the lock, before another tick
+void zero_delay_spawn(void){
+	tetrode::zero_delay_field_state field(10, 40, 1);
+	clear_one_line(field);
+
+	check(field.lines_cleared == 1 && field.clear_ticks == 0,
+	      "zero delay clears with no wait");
+
+	int x = field.active.second.x;
+	field.handle_event(tetrode::event::MoveLeft);
+	check(field.active.second.x == x - 1, "zero delay piece moves on the clearing tick");
+}
+
+uint32_t xorshift32(uint32_t& state){
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+template <class field_t>
+uint32_t checksum(field_t& field){
+	tetrode::field_snapshot snap;
+	field.save_state(snap);
+	return snap.checksum();
+}
+
+// advance(n) has to leave the board exactly as n Ticks would, the server,
+// renderer and tournament all skip idle ticks with it. A bot keeps the
+// game going and clearing lines, with the odd random key on top to leave
+// keys held when auto-repeat is on.
+template <class field_t>
+void advance_matches_ticks(bool handling, const char *what){
+	static const tetrode::event keys[] = {
+		tetrode::event::MoveLeft, tetrode::event::MoveRight,
+		tetrode::event::MoveDown, tetrode::event::ReleaseLeft,
+		tetrode::event::ReleaseRight, tetrode::event::ReleaseDown,
+		tetrode::event::RotateLeft, tetrode::event::Hold,
+	};
+
+	field_t ticked(10, 40, 1), skipped(10, 40, 1);
+	ticked.handling.enabled = skipped.handling.enabled = handling;
+
+	tetrode::heuristic_bot bot;
+	uint32_t rng = 99;
+	unsigned games = 1;
+	bool same = true;
+
+	for (unsigned step = 0; step < 20000 && same; step++) {
+		tetrode::event ev = bot.next_move(ticked);
+
+		if (xorshift32(rng) % 64 == 0) {
+			ev = keys[xorshift32(rng) % 8];
+		}
+
+		ticked.updates = 0;
+		ticked.handle_event(ev);
+		skipped.handle_event(ev);
+
+		// mostly a few ticks between moves so the bot keeps up, now and
+		// then long idle stretches
+		unsigned ticks = (xorshift32(rng) % 4)? xorshift32(rng) % 4 : xorshift32(rng) % 120;
+
+		for (unsigned i = 0; i < ticks; i++) {
+			ticked.handle_event(tetrode::event::Tick);
+		}
+
+		skipped.advance(ticks);
+		same = checksum(ticked) == checksum(skipped);
+
+		if (ticked.topped_out) {
+			games++;
+			ticked = skipped = field_t(10, 40, games);
+			ticked.handling.enabled = skipped.handling.enabled = handling;
+		}
+	}
+
+	check(same, what);
+}
+
+// anonymous namespace
+}
+
+int main(void){
+	garbage_tops_out();
+	garbage_lifts_piece();
+	garbage_hole_range();
+	tspin_double();
+	tspin_mini();
+	i_wall_kick();
+	blocked_rotation();
+	buffered_rotation();
+	buffered_hold();
+	zero_delay_spawn();
+
+	advance_matches_ticks<tetrode::field_state>(false, "advance() matches Ticks");
+	advance_matches_ticks<tetrode::field_state>(true, "advance() matches Ticks with auto-repeat");
+	advance_matches_ticks<tetrode::classic_field_state>(true, "advance() matches Ticks, classic");
+	advance_matches_ticks<tetrode::twenty_g_field_state>(true, "advance() matches Ticks, 20G");
+	advance_matches_ticks<tetrode::zero_delay_field_state>(true, "advance() matches Ticks, no clear delay");
+
+	if (failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return 1;
+	}
+
+	puts("all checks passed");
+	return 0;
+}
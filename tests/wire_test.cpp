@@ -0,0 +1,128 @@
+#include <tetrode/wire.hpp>
+#include <tetrode/field_state.hpp>
+
+#include <vector>
+#include <stdio.h>
+
+// decoder checks against broken and hostile frames, run by `make check`
+
+namespace {
+
+unsigned failures = 0;
+
+void check(bool ok, const char *what){
+	if (!ok) {
+		fprintf(stderr, "FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+const uint8_t keyframe = tetrode::wire::Keyframe | tetrode::wire::version << 4;
+const uint8_t delta    = tetrode::wire::Delta | tetrode::wire::version << 4;
+
+tetrode::field_snapshot played_snapshot(void){
+	tetrode::field_state field(10, 40, 7);
+
+	for (unsigned i = 0; i < 30; i++) {
+		field.handle_event(tetrode::event::Drop);
+	}
+
+	tetrode::field_snapshot snap;
+	field.save_state(snap);
+	return snap;
+}
+
+void round_trip(void){
+	tetrode::field_snapshot snap = played_snapshot();
+	tetrode::field_snapshot out;
+	std::vector<uint8_t> buf;
+
+	size_t len = tetrode::wire::encode(snap, buf);
+	check(tetrode::wire::decode(buf.data(), buf.size(), out) == len,
+	      "a keyframe decodes");
+	check(out.checksum() == snap.checksum(), "a keyframe decodes to the same board");
+}
+
+// every cut short version of a good frame fails, and doesn't touch the
+// board it was decoded into
+void truncated(void){
+	tetrode::field_snapshot snap = played_snapshot();
+	tetrode::field_state empty(10, 40, 7);
+	tetrode::field_snapshot prev;
+	empty.save_state(prev);
+
+	std::vector<uint8_t> key, diff;
+	tetrode::wire::encode(snap, key);
+	tetrode::wire::encode_delta(prev, snap, diff);
+
+	bool key_ok = true, diff_ok = true;
+
+	for (size_t n = 0; n < key.size(); n++) {
+		tetrode::field_snapshot out = prev;
+		key_ok &= tetrode::wire::decode(key.data(), n, out) == 0;
+		key_ok &= out.checksum() == prev.checksum();
+	}
+
+	for (size_t n = 0; n < diff.size(); n++) {
+		tetrode::field_snapshot out = prev;
+		diff_ok &= tetrode::wire::decode(diff.data(), n, out) == 0;
+		diff_ok &= out.checksum() == prev.checksum();
+	}
+
+	check(key_ok, "truncated keyframes are rejected");
+	check(diff_ok, "truncated deltas are rejected");
+}
+
+void expect_reject(const std::vector<uint8_t>& frame, const char *what){
+	tetrode::field_state field(10, 40, 7);
+	tetrode::field_snapshot snap;
+	field.save_state(snap);
+	uint32_t sum = snap.checksum();
+
+	check(tetrode::wire::decode(frame.data(), frame.size(), snap) == 0, what);
+	check(snap.checksum() == sum, "a rejected frame leaves the board alone");
+}
+
+void hostile(void){
+	// a gap that wraps the row index around to negative
+	expect_reject({ delta, 1, 0xfe, 0xff, 0xff, 0xff, 0x0f, 0x00, 0x00 },
+	              "a row gap that wraps around is rejected");
+
+	// one past the top row, then a second row after the last one
+	expect_reject({ delta, 1, 40, 0x00, 0x00 }, "a row gap past the top is rejected");
+	expect_reject({ delta, 2, 39, 0, 0x00, 0x00 }, "a row after the top row is rejected");
+
+	// shape 7, then the position and block offsets
+	expect_reject({ delta, 0, 1 << 1, 7, 0, 0, 0x88, 0x88, 0x88, 0x88 },
+	              "an active shape past L is rejected");
+	expect_reject({ delta, 0, 1 << 1, 2 | 3 << 5, 0, 0, 0x88, 0x88, 0x88, 0x88 },
+	              "an unknown spin is rejected");
+	expect_reject({ delta, 0, 1 << 2, 7, 0 }, "a hold shape past L is rejected");
+	expect_reject({ delta, 0, 1 << 0, 2, 0x72 }, "a queued shape past L is rejected");
+
+	// 1x1 board, one raw row holding state 15
+	expect_reject({ keyframe, 1, 1, 1, 3 | 15 << 2, 0 }, "a cell past the palette is rejected");
+
+	tetrode::field_snapshot snap;
+	std::vector<uint8_t> good = { keyframe, 1, 1, 1, 3 | 4 << 2, 0 };
+	check(tetrode::wire::decode(good.data(), good.size(), snap) == good.size()
+	      && snap.cells[0] == tetrode::block::states::Garbage,
+	      "a raw cell within the palette decodes");
+}
+
+// anonymous namespace
+}
+
+int main(void){
+	round_trip();
+	truncated();
+	hostile();
+
+	if (failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return 1;
+	}
+
+	puts("all checks passed");
+	return 0;
+}